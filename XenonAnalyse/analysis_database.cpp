@@ -0,0 +1,228 @@
+#include "analysis_database.h"
+#include <cstring>
+#include <fstream>
+#include <image.h>
+#include <memory_mapped_file.h>
+
+XXH128_hash_t AnalysisDatabase::ComputeImageHash(const Image& image)
+{
+    XXH3_state_t* state = XXH3_createState();
+    XXH3_128bits_reset(state);
+
+    auto update = [&](const void* data, size_t size)
+        {
+            XXH3_128bits_update(state, data, size);
+        };
+
+    const uint64_t base = image.base;
+    update(&base, sizeof(base));
+
+    for (const auto& section : image.sections)
+    {
+        const uint64_t sectionBase = section.base;
+        update(section.name.data(), section.name.size() + 1);
+        update(&sectionBase, sizeof(sectionBase));
+        update(&section.size, sizeof(section.size));
+        update(&section.flags, sizeof(section.flags));
+
+        if (section.data != nullptr)
+            update(section.data, section.size);
+    }
+
+    const XXH128_hash_t hash = XXH3_128bits_digest(state);
+    XXH3_freeState(state);
+    return hash;
+}
+
+bool AnalysisDatabase::Load(const std::filesystem::path& path)
+{
+    *this = {};
+
+    if (!std::filesystem::is_regular_file(path))
+        return false;
+
+    const MemoryMappedFile file(path);
+    if (!file.isOpen())
+        return false;
+
+    const uint8_t* data = file.data();
+    const uint8_t* dataEnd = data + file.size();
+
+    auto read = [&](auto& value)
+        {
+            if (size_t(dataEnd - data) < sizeof(value))
+                return false;
+
+            memcpy(&value, data, sizeof(value));
+            data += sizeof(value);
+            return true;
+        };
+
+    auto readString = [&](std::string& value)
+        {
+            uint32_t size = 0;
+            if (!read(size) || size_t(dataEnd - data) < size)
+                return false;
+
+            value.assign(reinterpret_cast<const char*>(data), size);
+            data += size;
+            return true;
+        };
+
+    auto readCount = [&](uint32_t& count, size_t minElementSize)
+        {
+            return read(count) && size_t(dataEnd - data) / minElementSize >= count;
+        };
+
+    auto fail = [&]()
+        {
+            *this = {};
+            return false;
+        };
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t count = 0;
+
+    if (!read(magic) || !read(version) || magic != c_magic || version != c_version ||
+        !read(imageHash.low64) || !read(imageHash.high64) || !read(functionsHash.low64) || !read(functionsHash.high64))
+    {
+        return fail();
+    }
+
+    if (!readCount(count, sizeof(uint32_t) * 2))
+        return fail();
+
+    helpers.resize(count);
+    for (auto& helper : helpers)
+    {
+        if (!readString(helper.name) || !read(helper.address))
+            return fail();
+    }
+
+    if (!readCount(count, sizeof(uint32_t) * 3))
+        return fail();
+
+    switchTables.resize(count);
+    for (auto& table : switchTables)
+    {
+        uint32_t labelCount = 0;
+        if (!read(table.base) || !read(table.r) || !readCount(labelCount, sizeof(uint32_t)))
+            return fail();
+
+        table.labels.resize(labelCount);
+        memcpy(table.labels.data(), data, labelCount * sizeof(uint32_t));
+        data += labelCount * sizeof(uint32_t);
+    }
+
+    if (!readCount(count, sizeof(uint32_t) * 3))
+        return fail();
+
+    functions.resize(count);
+    for (auto& fn : functions)
+    {
+        uint32_t base = 0;
+        uint32_t size = 0;
+        uint32_t blockCount = 0;
+        if (!read(base) || !read(size) || !readCount(blockCount, sizeof(uint32_t) * 2))
+            return fail();
+
+        fn.base = base;
+        fn.size = size;
+        fn.blocks.resize(blockCount);
+
+        for (auto& block : fn.blocks)
+        {
+            uint32_t blockBase = 0;
+            uint32_t blockSize = 0;
+            read(blockBase);
+            read(blockSize);
+
+            block.base = blockBase;
+            block.size = blockSize;
+        }
+    }
+
+    if (!readCount(count, sizeof(uint32_t) * 3))
+        return fail();
+
+    symbols.resize(count);
+    for (auto& symbol : symbols)
+    {
+        if (!readString(symbol.name) || !read(symbol.address) || !read(symbol.size))
+            return fail();
+    }
+
+    if (data != dataEnd)
+        return fail();
+
+    return true;
+}
+
+bool AnalysisDatabase::Save(const std::filesystem::path& path) const
+{
+    std::string buffer;
+
+    auto write = [&](const auto& value)
+        {
+            buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+
+    auto writeString = [&](const std::string& value)
+        {
+            write(static_cast<uint32_t>(value.size()));
+            buffer += value;
+        };
+
+    write(c_magic);
+    write(c_version);
+    write(imageHash.low64);
+    write(imageHash.high64);
+    write(functionsHash.low64);
+    write(functionsHash.high64);
+
+    write(static_cast<uint32_t>(helpers.size()));
+    for (auto& helper : helpers)
+    {
+        writeString(helper.name);
+        write(helper.address);
+    }
+
+    write(static_cast<uint32_t>(switchTables.size()));
+    for (auto& table : switchTables)
+    {
+        write(table.base);
+        write(table.r);
+        write(static_cast<uint32_t>(table.labels.size()));
+        buffer.append(reinterpret_cast<const char*>(table.labels.data()), table.labels.size() * sizeof(uint32_t));
+    }
+
+    write(static_cast<uint32_t>(functions.size()));
+    for (auto& fn : functions)
+    {
+        write(static_cast<uint32_t>(fn.base));
+        write(static_cast<uint32_t>(fn.size));
+        write(static_cast<uint32_t>(fn.blocks.size()));
+
+        for (auto& block : fn.blocks)
+        {
+            write(static_cast<uint32_t>(block.base));
+            write(static_cast<uint32_t>(block.size));
+        }
+    }
+
+    write(static_cast<uint32_t>(symbols.size()));
+    for (auto& symbol : symbols)
+    {
+        writeString(symbol.name);
+        write(symbol.address);
+        write(symbol.size);
+    }
+
+    std::ofstream stream(path, std::ios::binary);
+    if (!stream.good())
+        return false;
+
+    stream.write(buffer.data(), buffer.size());
+    return stream.good();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <xxhash.h>
+#include "function.h"
+
+struct Image;
+
+// Analysis results of an image, written by XenonAnalyse and XenonRecomp and read back by either
+// of them to skip the work they describe. Every result is tied to the hash of the image.
+struct AnalysisDatabase
+{
+    static constexpr uint32_t c_magic = 0x42444158; // "XADB"
+    static constexpr uint32_t c_version = 2;
+
+    // Part of the functions hash. Bump it whenever Function::Analyze or the function discovery of
+    // XenonRecomp finds different functions in the same image, so stored functions are found again.
+    static constexpr uint32_t c_analysisVersion = 1;
+
+    struct Helper
+    {
+        std::string name;
+        uint32_t address{};
+    };
+
+    struct SwitchTable
+    {
+        uint32_t base{};
+        uint32_t r{};
+        std::vector<uint32_t> labels;
+    };
+
+    struct FunctionSymbol
+    {
+        std::string name;
+        uint32_t address{};
+        uint32_t size{};
+    };
+
+    XXH128_hash_t imageHash{};
+
+    // Hash of everything besides the image that the functions depend on, left zero if there are none.
+    XXH128_hash_t functionsHash{};
+
+    std::vector<Helper> helpers;
+    std::vector<SwitchTable> switchTables;
+    std::vector<Function> functions;
+
+    // Symbols added for the functions, in the order they were added.
+    std::vector<FunctionSymbol> symbols;
+
+    static XXH128_hash_t ComputeImageHash(const Image& image);
+
+    bool Load(const std::filesystem::path& path);
+    bool Save(const std::filesystem::path& path) const;
+};
@@ -1,10 +1,13 @@
 #include "function.h"
 #include <disasm.h>
+#include <instruction_store.h>
 #include <vector>
 #include <bit>
 #include <algorithm>
 #include <cassert>
 #include <byteswap.h>
+#include <array>
+#include <unordered_map>
 
 size_t Function::SearchBlock(size_t address) const
 {
@@ -38,7 +41,126 @@ size_t Function::SearchBlock(size_t address) const
     return -1;
 }
 
-Function Function::Analyze(const void* code, size_t size, size_t base)
+static const powerpc_opcode* FindOpcode(const InstructionStore* instructions, const uint32_t* data, size_t addr)
+{
+    if (instructions != nullptr)
+    {
+        return instructions->FindOpcode(data, addr);
+    }
+
+    ppc_insn insn;
+    ppc::Disassemble(data, addr, insn);
+    return insn.opcode;
+}
+
+// Lowest index of the blocks covering each instruction slot, which is what SearchBlock returns,
+// so that lookups don't scan every block. Fresh blocks cover their first slot. Slots are kept in
+// pages as branches can create blocks far away from the function. Functions with few blocks
+// keep using the linear search, the index is only built once a function grows past them.
+struct BlockIndex
+{
+    static constexpr size_t c_minBlockCount = 16;
+    static constexpr size_t c_pageShift = 8;
+    static constexpr uint32_t c_noBlock = ~0u;
+
+    using Page = std::array<uint32_t, size_t(1) << c_pageShift>;
+
+    const Function& fn;
+    bool built{};
+    std::unordered_map<size_t, Page> pages{};
+    size_t lastPageIndex{ static_cast<size_t>(-1) };
+    Page* lastPage{};
+
+    BlockIndex(const Function& fn)
+        : fn(fn)
+    {
+    }
+
+    Page* FindPage(size_t pageIndex, bool create)
+    {
+        if (pageIndex == lastPageIndex)
+        {
+            return lastPage;
+        }
+
+        auto it = pages.find(pageIndex);
+        if (it == pages.end())
+        {
+            if (!create)
+            {
+                return nullptr;
+            }
+
+            it = pages.emplace(pageIndex, Page{}).first;
+            it->second.fill(c_noBlock);
+        }
+
+        lastPageIndex = pageIndex;
+        lastPage = &it->second;
+        return lastPage;
+    }
+
+    void Claim(size_t offset, size_t block)
+    {
+        const size_t slot = offset / sizeof(uint32_t);
+        auto& owner = (*FindPage(slot >> c_pageShift, true))[slot & ((1 << c_pageShift) - 1)];
+        owner = std::min(owner, static_cast<uint32_t>(block));
+    }
+
+    // Block offsets are relative to the function base.
+    void Add(size_t offset, size_t block)
+    {
+        if (built)
+        {
+            Claim(offset, block);
+        }
+    }
+
+    size_t Search(size_t address)
+    {
+        if (!built)
+        {
+            if (fn.blocks.size() < c_minBlockCount)
+            {
+                return fn.SearchBlock(address);
+            }
+
+            for (size_t i = 0; i < fn.blocks.size(); i++)
+            {
+                const auto& block = fn.blocks[i];
+                Claim(block.base, i);
+                for (size_t offset = 4; offset < block.size; offset += 4)
+                {
+                    Claim(block.base + offset, i);
+                }
+            }
+
+            built = true;
+        }
+
+        if (address < fn.base)
+        {
+            return -1;
+        }
+
+        const size_t slot = (address - fn.base) / sizeof(uint32_t);
+        const auto* page = FindPage(slot >> c_pageShift, false);
+        if (page == nullptr)
+        {
+            return -1;
+        }
+
+        const uint32_t owner = (*page)[slot & ((1 << c_pageShift) - 1)];
+        if (owner == c_noBlock)
+        {
+            return -1;
+        }
+
+        return owner;
+    }
+};
+
+Function Function::Analyze(const void* code, size_t size, size_t base, const InstructionStore* instructions)
 {
     Function fn{ base, 0 };
 
@@ -52,6 +174,8 @@ Function Function::Analyze(const void* code, size_t size, size_t base)
     blocks.reserve(8);
     blocks.emplace_back();
 
+    BlockIndex blockIndex{ fn };
+
     const auto* data = (uint32_t*)code;
     const auto* dataStart = data;
     const auto* dataEnd = (uint32_t*)((uint8_t*)code + size);
@@ -78,9 +202,6 @@ Function Function::Analyze(const void* code, size_t size, size_t base)
         const uint32_t xop = PPC_XOP(instruction);
         const uint32_t isLink = PPC_BL(instruction); // call
 
-        ppc_insn insn;
-        ppc::Disassemble(data, addr, insn);
-
         // Sanity check
         assert(addr == base + curBlock.base  + curBlock.size);
         if (curBlock.projectedSize != -1 && curBlock.size >= curBlock.projectedSize) // fallthrough
@@ -91,6 +212,7 @@ Function Function::Analyze(const void* code, size_t size, size_t base)
         }
 
         curBlock.size += 4;
+        blockIndex.Add(curBlock.base + curBlock.size - 4, blockStack.back());
         if (op == PPC_OP_BC) // conditional branches all originate from one opcode, thanks RISC
         {
             if (isLink) // just a conditional call, nothing to see here
@@ -113,23 +235,25 @@ Function Function::Analyze(const void* code, size_t size, size_t base)
             const size_t rBase = (addr + PPC_BD(instruction)) - base;
 
             // these will be -1 if it's our first time seeing these blocks
-            auto lBlock = fn.SearchBlock(base + lBase);
+            auto lBlock = blockIndex.Search(base + lBase);
 
             if (lBlock == -1)
             {
                 blocks.emplace_back(lBase, 0).projectedSize = rBase - lBase;
                 lBlock = blocks.size() - 1;
+                blockIndex.Add(lBase, lBlock);
 
                 // push this first, this gets overriden by the true case as it'd be further away
                 DEBUG(blocks[lBlock].parent = blockBase);
                 blockStack.emplace_back(lBlock);
             }
 
-            size_t rBlock = fn.SearchBlock(base + rBase);
+            size_t rBlock = blockIndex.Search(base + rBase);
             if (rBlock == -1)
             {
                 blocks.emplace_back(branchDest - base, 0);
                 rBlock = blocks.size() - 1;
+                blockIndex.Add(branchDest - base, rBlock);
 
                 DEBUG(blocks[rBlock].parent = blockBase);
                 blockStack.emplace_back(rBlock);
@@ -149,7 +273,7 @@ Function Function::Analyze(const void* code, size_t size, size_t base)
                     const size_t branchDest = addr + PPC_BI(instruction);
 
                     const size_t branchBase = branchDest - base;
-                    const size_t branchBlock = fn.SearchBlock(branchDest);
+                    const size_t branchBlock = blockIndex.Search(branchDest);
 
                     if (branchDest < base)
                     {
@@ -170,6 +294,7 @@ Function Function::Analyze(const void* code, size_t size, size_t base)
                     if (branchBlock == -1)
                     {
                         blocks.emplace_back(branchBase, 0, sizeProjection);
+                        blockIndex.Add(branchBase, blocks.size() - 1);
 
                         blockStack.emplace_back(blocks.size() - 1);
                         
@@ -186,11 +311,12 @@ Function Function::Analyze(const void* code, size_t size, size_t base)
                     {
                         // right block's just going to return
                         const size_t lBase = (addr - base) + 4;
-                        size_t lBlock = fn.SearchBlock(lBase);
+                        size_t lBlock = blockIndex.Search(lBase);
                         if (lBlock == -1)
                         {
                             blocks.emplace_back(lBase, 0);
                             lBlock = blocks.size() - 1;
+                            blockIndex.Add(lBase, lBlock);
 
                             DEBUG(blocks[lBlock].parent = blockBase);
                             blockStack.emplace_back(lBlock);
@@ -203,7 +329,7 @@ Function Function::Analyze(const void* code, size_t size, size_t base)
                 RESTORE_DATA();
             }
         }
-        else if (insn.opcode == nullptr)
+        else if (FindOpcode(instructions, data, addr) == nullptr)
         {
             blockStack.pop_back();
             RESTORE_DATA();
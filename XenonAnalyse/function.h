@@ -3,6 +3,8 @@
 #include <cstddef>
 #include <vector>
 
+struct InstructionStore;
+
 #ifdef _DEBUG
 #define DEBUG(X) X
 #else
@@ -47,5 +49,5 @@ struct Function
     }
     
     size_t SearchBlock(size_t address) const;
-    static Function Analyze(const void* code, size_t size, size_t base);
+    static Function Analyze(const void* code, size_t size, size_t base, const InstructionStore* instructions = nullptr);
 };
@@ -1,17 +1,23 @@
 #include <cassert>
 #include <iterator>
+#include <byte_pattern_search.h>
 #include <file.h>
 #include <disasm.h>
 #include <image.h>
+#include <instruction_store.h>
+#include <parallel.h>
 #include <xbox.h>
 #include <fmt/core.h>
+#include "analysis_database.h"
 #include "function.h"
 
 //Added Search for and print out register save/load locations
 //modificated from this fork: https://github.com/hedge-dev/XenonRecomp/pull/108
 #include "fmt/xchar.h"
+#include <toml++/toml.hpp>
 #include "function.h"
 #include <algorithm>
+#include <unordered_map>
 #include <file.h>
 
 #define SWITCH_ABSOLUTE 0
@@ -37,59 +43,77 @@ static const uint8_t SAVEVMX_14[] = { 0x39, 0x60, 0xfe, 0xe0, 0x7d, 0xcb, 0x61,
 static const uint8_t RESTVMX_64[] = { 0x39, 0x60, 0xfc, 0x00, 0x10, 0x0b, 0x60, 0xcb };
 static const uint8_t SAVEVMX_64[] = { 0x39, 0x60, 0xfc, 0x00, 0x10, 0x0b, 0x61, 0xcb };
 
-uint32_t BytePatternSearch(uint8_t* data, const uint32_t dataSize, const uint32_t baseAddress, const uint8_t pattern[], const size_t patternSize)
+void AddRegisterFunctionSignatures(BytePatternSearch& search)
 {
-    auto result = std::search(data, data + dataSize, pattern, pattern + patternSize);
-    if (result != data + dataSize) {
-        return baseAddress + std::distance(data, result);
-    }
-
-    return UINT32_MAX;
+    search.Add("restgprlr_14", RESTGPRLR_14, sizeof(RESTGPRLR_14));
+    search.Add("savegprlr_14", SAVEGPRLR_14, sizeof(SAVEGPRLR_14));
+    search.Add("restfpr_14", RESTFPR_14, sizeof(RESTFPR_14));
+    search.Add("savefpr_14", SAVEFPR_14, sizeof(SAVEFPR_14));
+    search.Add("restvmx_14", RESTVMX_14, sizeof(RESTVMX_14));
+    search.Add("savevmx_14", SAVEVMX_14, sizeof(SAVEVMX_14));
+    search.Add("restvmx_64", RESTVMX_64, sizeof(RESTVMX_64));
+    search.Add("savevmx_64", SAVEVMX_64, sizeof(SAVEVMX_64));
 }
 
-void RegisterFunctionsSearch(Image& image)
+// Adds the [[signature]] entries of a TOML file, each with a name and a byte pattern.
+void LoadSignatures(const char* path, BytePatternSearch& search)
 {
-    uint32_t baseAddress = UINT32_MAX;
+    toml::table toml = toml::parse_file(path)
+#if !TOML_EXCEPTIONS
+        .table()
+#endif
+        ;
+
+    if (auto signatureArray = toml["signature"].as_array())
+    {
+        for (auto& entry : *signatureArray)
+        {
+            auto* signatureTable = entry.as_table();
+            if (signatureTable == nullptr)
+                continue;
+
+            BytePattern pattern;
+            pattern.name = (*signatureTable)["name"].value_or<std::string>("");
+            auto bytes = (*signatureTable)["bytes"].value_or<std::string>("");
+
+            if (pattern.name.empty() || !BytePattern::Parse(bytes, pattern))
+            {
+                fmt::println("ERROR: Invalid signature \"{}\" with bytes \"{}\"", pattern.name, bytes);
+                continue;
+            }
 
+            search.Add(std::move(pattern));
+        }
+    }
+}
+
+void RegisterFunctionsSearch(Image& image, const BytePatternSearch& search, AnalysisDatabase& database)
+{
     for (const auto& section : image.sections) {
         if (section.name == ".text") {
-            baseAddress = section.base;
+            auto offsets = search.FindFirst(section.data, section.size);
 
-            if (baseAddress == UINT32_MAX) {
-                fmt::println("Could not find \".text\" section.");
-                return;
-            }
+            for (size_t i = 0; i < search.patterns.size(); i++)
+            {
+                uint32_t address = offsets[i] != SIZE_MAX ? uint32_t(section.base + offsets[i]) : UINT32_MAX;
+                fmt::println("{}_address = 0x{:X}", search.patterns[i].name, address);
 
-            uint32_t restgprlr_14 = BytePatternSearch(section.data, section.size, baseAddress, RESTGPRLR_14, sizeof(RESTGPRLR_14));
-            uint32_t savegprlr_14 = BytePatternSearch(section.data, section.size, baseAddress, SAVEGPRLR_14, sizeof(SAVEGPRLR_14));
-            uint32_t restfpr_14 = BytePatternSearch(section.data, section.size, baseAddress, RESTFPR_14, sizeof(RESTFPR_14));
-            uint32_t savefpr_14 = BytePatternSearch(section.data, section.size, baseAddress, SAVEFPR_14, sizeof(SAVEFPR_14));
-            uint32_t restvmx_14 = BytePatternSearch(section.data, section.size, baseAddress, RESTVMX_14, sizeof(RESTVMX_14));
-            uint32_t savevmx_14 = BytePatternSearch(section.data, section.size, baseAddress, SAVEVMX_14, sizeof(SAVEVMX_14));
-            uint32_t restvmx_64 = BytePatternSearch(section.data, section.size, baseAddress, RESTVMX_64, sizeof(RESTVMX_64));
-            uint32_t savevmx_64 = BytePatternSearch(section.data, section.size, baseAddress, SAVEVMX_64, sizeof(SAVEVMX_64));
-
-            fmt::println("restgprlr_14_address = 0x{:X}", restgprlr_14);
-            fmt::println("savegprlr_14_address = 0x{:X}", savegprlr_14);
-            fmt::println("restfpr_14_address = 0x{:X}", restfpr_14);
-            fmt::println("savefpr_14_address = 0x{:X}", savefpr_14);
-            fmt::println("restvmx_14_address = 0x{:X}", restvmx_14);
-            fmt::println("savevmx_14_address = 0x{:X}", savevmx_14);
-            fmt::println("restvmx_64_address = 0x{:X}", restvmx_64);
-            fmt::println("savevmx_64_address = 0x{:X}", savevmx_64);
+                if (address != UINT32_MAX)
+                    database.helpers.push_back({ search.patterns[i].name, address });
+            }
         }
     }
 }
 
-void ReadTable(Image& image, SwitchTable& table)
+void ReadTable(Image& image, const InstructionStore& instructions, SwitchTable& table)
 {
     uint32_t pOffset;
     ppc_insn insn;
     auto* code = (uint32_t*)image.Find(table.base);
-    ppc::Disassemble(code, table.base, insn);
+    instructions.Disassemble(code, table.base, insn);
     pOffset = insn.operands[1] << 16;
 
-    ppc::Disassemble(code + 1, table.base + 4, insn);
+    instructions.Disassemble(code + 1, table.base + 4, insn);
     pOffset += insn.operands[2];
 
     if (table.type == SWITCH_ABSOLUTE)
@@ -106,13 +130,13 @@ void ReadTable(Image& image, SwitchTable& table)
         uint32_t shift;
         const auto* offsets = (uint8_t*)image.Find(pOffset);
 
-        ppc::Disassemble(code + 4, table.base + 0x10, insn);
+        instructions.Disassemble(code + 4, table.base + 0x10, insn);
         base = insn.operands[1] << 16;
 
-        ppc::Disassemble(code + 5, table.base + 0x14, insn);
+        instructions.Disassemble(code + 5, table.base + 0x14, insn);
         base += insn.operands[2];
 
-        ppc::Disassemble(code + 3, table.base + 0x0C, insn);
+        instructions.Disassemble(code + 3, table.base + 0x0C, insn);
         shift = insn.operands[2];
 
         for (size_t i = 0; i < table.labels.size(); i++)
@@ -127,10 +151,10 @@ void ReadTable(Image& image, SwitchTable& table)
             const auto* offsets = (uint8_t*)image.Find(pOffset);
             uint32_t base;
 
-            ppc::Disassemble(code + 3, table.base + 0x0C, insn);
+            instructions.Disassemble(code + 3, table.base + 0x0C, insn);
             base = insn.operands[1] << 16;
 
-            ppc::Disassemble(code + 4, table.base + 0x10, insn);
+            instructions.Disassemble(code + 4, table.base + 0x10, insn);
             base += insn.operands[2];
 
             for (size_t i = 0; i < table.labels.size(); i++)
@@ -143,10 +167,10 @@ void ReadTable(Image& image, SwitchTable& table)
             const auto* offsets = (be<uint16_t>*)image.Find(pOffset);
             uint32_t base;
 
-            ppc::Disassemble(code + 4, table.base + 0x10, insn);
+            instructions.Disassemble(code + 4, table.base + 0x10, insn);
             base = insn.operands[1] << 16;
 
-            ppc::Disassemble(code + 5, table.base + 0x14, insn);
+            instructions.Disassemble(code + 5, table.base + 0x14, insn);
             base += insn.operands[2];
 
             for (size_t i = 0; i < table.labels.size(); i++)
@@ -161,13 +185,13 @@ void ReadTable(Image& image, SwitchTable& table)
     }
 }
 
-void ScanTable(const uint32_t* code, size_t base, SwitchTable& table)
+void ScanTable(const InstructionStore& instructions, const uint32_t* code, size_t base, SwitchTable& table)
 {
     ppc_insn insn;
     uint32_t cr{ (uint32_t)-1 };
     for (int i = 0; i < 32; i++)
     {
-        ppc::Disassemble(&code[-i], base - (4 * i), insn);
+        instructions.Disassemble(&code[-i], base - (4 * i), insn);
         if (insn.opcode == nullptr)
         {
             continue;
@@ -204,33 +228,134 @@ void MakeMask(const uint32_t* instructions, size_t count)
     }
 }
 
-void* SearchMask(const void* source, const uint32_t* compare, size_t compareCount, size_t size)
+// Aho-Corasick automaton over opcode ids, finding every occurrence of a set of instruction
+// sequences in a single pass over the decoded instructions.
+struct OpcodePatternMatcher
 {
-    assert(size % 4 == 0);
-    uint32_t* src = (uint32_t*)source;
-    size_t count = size / 4;
-    ppc_insn insn;
+    // powerpc_opcodes index to symbol, 0 for opcodes that no pattern uses.
+    std::vector<uint8_t> symbols;
+    size_t symbolCount{ 1 };
 
-    for (size_t i = 0; i < count; i++)
+    // state * symbolCount + symbol to next state.
+    std::vector<uint32_t> transitions;
+
+    // Patterns ending in each state.
+    std::vector<std::vector<size_t>> outputs;
+
+    std::vector<std::vector<uint32_t>> patterns;
+    size_t maxLength{};
+
+    // Returns the index of the pattern, reported back by Scan.
+    size_t Add(const uint32_t* pattern, size_t count)
+    {
+        patterns.emplace_back(pattern, pattern + count);
+        maxLength = std::max(maxLength, count);
+        return patterns.size() - 1;
+    }
+
+    void Build()
     {
-        size_t c = 0;
-        for (c = 0; c < compareCount; c++)
+        std::unordered_map<uint32_t, uint8_t> idSymbols;
+        for (const auto& pattern : patterns)
         {
-            ppc::Disassemble(&src[i + c], 0, insn);
-            if (insn.opcode == nullptr || insn.opcode->id != compare[c])
+            for (uint32_t id : pattern)
             {
-                break;
+                if (idSymbols.emplace(id, symbolCount).second)
+                    symbolCount++;
             }
         }
 
-        if (c == compareCount)
+        assert(symbolCount <= 0x100);
+
+        symbols.assign(powerpc_num_opcodes, 0);
+        for (int i = 0; i < powerpc_num_opcodes; i++)
         {
-            return &src[i];
+            auto it = idSymbols.find(powerpc_opcodes[i].id);
+            if (it != idSymbols.end())
+                symbols[i] = it->second;
+        }
+
+        constexpr uint32_t c_none = UINT32_MAX;
+        transitions.assign(symbolCount, c_none);
+        outputs.resize(1);
+
+        for (size_t i = 0; i < patterns.size(); i++)
+        {
+            uint32_t state = 0;
+            for (uint32_t id : patterns[i])
+            {
+                const size_t transition = state * symbolCount + idSymbols[id];
+                if (transitions[transition] == c_none)
+                {
+                    transitions[transition] = outputs.size();
+                    transitions.resize(transitions.size() + symbolCount, c_none);
+                    outputs.emplace_back();
+                }
+
+                state = transitions[transition];
+            }
+
+            outputs[state].push_back(i);
+        }
+
+        // Breadth first, so the failure state of every state is complete before its children are visited.
+        std::vector<uint32_t> failures(outputs.size());
+        std::vector<uint32_t> queue;
+
+        for (size_t symbol = 0; symbol < symbolCount; symbol++)
+        {
+            auto& next = transitions[symbol];
+            if (next == c_none)
+                next = 0;
+            else
+                queue.push_back(next);
+        }
+
+        for (size_t i = 0; i < queue.size(); i++)
+        {
+            const uint32_t state = queue[i];
+            const uint32_t failure = failures[state];
+            const auto& failureOutputs = outputs[failure];
+            outputs[state].insert(outputs[state].end(), failureOutputs.begin(), failureOutputs.end());
+
+            for (size_t symbol = 0; symbol < symbolCount; symbol++)
+            {
+                auto& next = transitions[state * symbolCount + symbol];
+                if (next == c_none)
+                {
+                    next = transitions[failure * symbolCount + symbol];
+                }
+                else
+                {
+                    failures[next] = transitions[failure * symbolCount + symbol];
+                    queue.push_back(next);
+                }
+            }
         }
     }
 
-    return nullptr;
-}
+    // Calls function(index, pattern) for every match starting in [begin, end) that lies before limit.
+    template<typename TFunction>
+    void Scan(const InstructionStore& instructions, size_t begin, size_t end, size_t limit, const TFunction& function) const
+    {
+        limit = std::min(limit, end + maxLength - 1);
+
+        uint32_t state = 0;
+        for (size_t i = begin; i < limit; i++)
+        {
+            const uint16_t opcode = instructions.opcodes[i];
+            const uint8_t symbol = opcode != InstructionStore::c_invalidOpcode ? symbols[opcode] : 0;
+            state = transitions[state * symbolCount + symbol];
+
+            for (size_t pattern : outputs[state])
+            {
+                const size_t index = i + 1 - patterns[pattern].size();
+                if (index < end)
+                    function(index, pattern);
+            }
+        }
+    }
+};
 
 static std::string out;
 
@@ -245,14 +370,26 @@ int main(int argc, char** argv)
 {
     if (argc < 3)
     {
-        printf("Usage: XenonAnalyse [input XEX file path] [output jump table TOML file path]");
+        printf("Usage: XenonAnalyse [input XEX file path] [output jump table TOML file path] [optional signature TOML file path] [optional output analysis database file path]");
         return EXIT_SUCCESS;
     }
 
-    const auto file = LoadFile(argv[1]);
-    auto image = Image::ParseImage(file.data(), file.size());
+    BytePatternSearch signatures;
+    AddRegisterFunctionSignatures(signatures);
+
+    // An empty signature path only skips the signatures, to still allow writing the database.
+    if (argc > 3 && argv[3][0] != '\0')
+        LoadSignatures(argv[3], signatures);
 
-       RegisterFunctionsSearch(image);
+    auto image = Image::ParseImage(std::filesystem::path(argv[1]));
+
+    const size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    InstructionStore instructions;
+    instructions.Build(image, threadCount);
+
+    AnalysisDatabase database;
+    RegisterFunctionsSearch(image, signatures, database);
     
     auto printTable = [&](const SwitchTable& table)
         {
@@ -274,44 +411,6 @@ int main(int argc, char** argv)
 
     println("# Generated by XenonAnalyse");
 
-    auto scanPattern = [&](uint32_t* pattern, size_t count, size_t type)
-        {
-            for (const auto& section : image.sections)
-            {
-                if (!(section.flags & SectionFlags_Code))
-                {
-                    continue;
-                }
-
-                size_t base = section.base;
-                uint8_t* data = section.data;
-                uint8_t* dataStart = section.data;
-                uint8_t* dataEnd = section.data + section.size;
-                while (data < dataEnd && data != nullptr)
-                {
-                    data = (uint8_t*)SearchMask(data, pattern, count, dataEnd - data);
-
-                    if (data != nullptr)
-                    {
-                        SwitchTable table{};
-                        table.type = type;
-                        ScanTable((uint32_t*)data, base + (data - dataStart), table);
-
-                        // fmt::println("{:X} ; jmptable - {}", base + (data - dataStart), table.labels.size());
-                        if (table.base != 0)
-                        {
-                            ReadTable(image, table);
-                            printTable(table);
-                            switches.emplace_back(std::move(table));
-                        }
-
-                        data += 4;
-                    }
-                    continue;
-                }
-            }
-        };
-
     uint32_t absoluteSwitch[] =
     {
         PPC_INST_LIS,
@@ -357,18 +456,99 @@ int main(int argc, char** argv)
         PPC_INST_MTCTR,
     };
 
+    // Added in SWITCH_* order, so the pattern index is the table type.
+    OpcodePatternMatcher matcher;
+    matcher.Add(absoluteSwitch, std::size(absoluteSwitch));
+    matcher.Add(computedSwitch, std::size(computedSwitch));
+    matcher.Add(offsetSwitch, std::size(offsetSwitch));
+    matcher.Add(wordOffsetSwitch, std::size(wordOffsetSwitch));
+    matcher.Build();
+
+    constexpr size_t c_chunkSize = 0x4000;
+
+    struct ScanChunk
+    {
+        const InstructionStore::Range* range;
+        size_t begin;
+        size_t end;
+        std::vector<SwitchTable> tables;
+    };
+
+    std::vector<ScanChunk> chunks;
+    for (const auto& range : instructions.ranges)
+    {
+        const size_t indexEnd = range.index + range.size / sizeof(uint32_t);
+        for (size_t index = range.index; index < indexEnd; index += c_chunkSize)
+            chunks.push_back({ &range, index, std::min(index + c_chunkSize, indexEnd) });
+    }
+
+    ParallelFor(threadCount, chunks.size(), [&](size_t i)
+        {
+            auto& chunk = chunks[i];
+            const auto& range = *chunk.range;
+            const size_t indexEnd = range.index + range.size / sizeof(uint32_t);
+
+            matcher.Scan(instructions, chunk.begin, chunk.end, indexEnd, [&](size_t index, size_t pattern)
+                {
+                    size_t base = range.base + (index - range.index) * sizeof(uint32_t);
+
+                    SwitchTable table{};
+                    table.type = pattern;
+                    ScanTable(instructions, (const uint32_t*)image.Find(base), base, table);
+
+                    // fmt::println("{:X} ; jmptable - {}", base, table.labels.size());
+                    if (table.base != 0)
+                    {
+                        ReadTable(image, instructions, table);
+                        chunk.tables.emplace_back(std::move(table));
+                    }
+                });
+        });
+
+    // Chunks are in address order, so this prints each type the same way a separate scan per pattern would.
+    auto printTables = [&](uint32_t type)
+        {
+            for (auto& chunk : chunks)
+            {
+                for (auto& table : chunk.tables)
+                {
+                    if (table.type == type)
+                    {
+                        printTable(table);
+                        switches.emplace_back(std::move(table));
+                    }
+                }
+            }
+        };
+
     println("# ---- ABSOLUTE JUMPTABLE ----");
-    scanPattern(absoluteSwitch, std::size(absoluteSwitch), SWITCH_ABSOLUTE);
+    printTables(SWITCH_ABSOLUTE);
 
     println("# ---- COMPUTED JUMPTABLE ----");
-    scanPattern(computedSwitch, std::size(computedSwitch), SWITCH_COMPUTED);
+    printTables(SWITCH_COMPUTED);
 
     println("# ---- OFFSETED JUMPTABLE ----");
-    scanPattern(offsetSwitch, std::size(offsetSwitch), SWITCH_BYTEOFFSET);
-    scanPattern(wordOffsetSwitch, std::size(wordOffsetSwitch), SWITCH_SHORTOFFSET);
+    printTables(SWITCH_BYTEOFFSET);
+    printTables(SWITCH_SHORTOFFSET);
 
     std::ofstream f(argv[2]);
     f.write(out.data(), out.size());
 
+    if (argc > 4)
+    {
+        database.imageHash = AnalysisDatabase::ComputeImageHash(image);
+
+        for (auto& table : switches)
+        {
+            auto& entry = database.switchTables.emplace_back();
+            entry.base = uint32_t(table.base);
+            entry.r = table.r;
+            entry.labels.assign(table.labels.begin(), table.labels.end());
+        }
+
+        if (!database.Save(argv[4]))
+            fmt::println("ERROR: Unable to save the analysis database: {}", argv[4]);
+    }
+
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,89 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+#include <function.h>
+#include <image.h>
+#include <instruction_store.h>
+#include <fmt/core.h>
+
+int AnalyzeBenchmark(int argc, char* argv[])
+{
+    if (argc < 1)
+    {
+        fmt::println("ERROR: An image file path is required");
+        return EXIT_FAILURE;
+    }
+
+    const size_t functionCount = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100;
+    const auto image = Image::ParseImage(std::filesystem::path(argv[0]));
+
+    InstructionStore instructions;
+    instructions.Build(image);
+
+    struct Entry
+    {
+        const uint8_t* data;
+        size_t size;
+        size_t base;
+        size_t functionSize;
+    };
+
+    // Discover functions by analyzing the code sections back to back.
+    std::vector<Entry> entries;
+    for (const auto& section : image.sections)
+    {
+        if (!(section.flags & SectionFlags_Code))
+            continue;
+
+        const uint8_t* data = section.data;
+        const uint8_t* dataEnd = section.data + section.size;
+        size_t base = section.base;
+
+        while (data < dataEnd)
+        {
+            if (*reinterpret_cast<const uint32_t*>(data) == 0)
+            {
+                data += 4;
+                base += 4;
+                continue;
+            }
+
+            auto fn = Function::Analyze(data, dataEnd - data, base, &instructions);
+            entries.push_back({ data, static_cast<size_t>(dataEnd - data), base, fn.size });
+
+            data += fn.size;
+            base += fn.size;
+        }
+    }
+
+    if (entries.empty())
+    {
+        fmt::println("ERROR: No functions found in {}", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) { return lhs.functionSize > rhs.functionSize; });
+    entries.resize(std::min(entries.size(), functionCount));
+
+    size_t instructionCount = 0;
+    size_t blockCount = 0;
+    double seconds = MeasureAverage([&]()
+        {
+            instructionCount = 0;
+            blockCount = 0;
+
+            for (const auto& entry : entries)
+            {
+                auto fn = Function::Analyze(entry.data, entry.size, entry.base, &instructions);
+                instructionCount += fn.size / 4;
+                blockCount += fn.blocks.size();
+            }
+        });
+
+    fmt::println("Analyzed the {} biggest functions ({} instructions, {} blocks, largest 0x{:X} bytes at 0x{:X}) in {:.3f} ms",
+        entries.size(), instructionCount, blockCount, entries.front().functionSize, entries.front().base, seconds * 1000.0);
+    fmt::println("{:.2f} million instructions per second", instructionCount / seconds / 1000000.0);
+
+    return EXIT_SUCCESS;
+}
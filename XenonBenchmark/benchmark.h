@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <string_view>
+
+struct Benchmark
+{
+    std::string_view name;
+    std::string_view usage;
+    int (*function)(int argc, char* argv[]);
+};
+
+int DecodeBenchmark(int argc, char* argv[]);
+int AnalyzeBenchmark(int argc, char* argv[]);
+int PipelineBenchmark(int argc, char* argv[]);
+
+// Writes a synthetic image with a recompiler config for the other benchmarks.
+int GenerateImage(int argc, char* argv[]);
+
+// Runs the given function until at least the minimum duration passed and returns the average seconds per run.
+template<typename TFunction>
+double MeasureAverage(TFunction&& function, double minimumSeconds = 1.0)
+{
+    size_t runCount = 0;
+    auto begin = std::chrono::steady_clock::now();
+    double elapsed = 0.0;
+
+    do
+    {
+        function();
+        ++runCount;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    } while (elapsed < minimumSeconds);
+
+    return elapsed / runCount;
+}
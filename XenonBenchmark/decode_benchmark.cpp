@@ -0,0 +1,58 @@
+#include "benchmark.h"
+#include <random>
+#include <vector>
+#include <disasm.h>
+#include <image.h>
+#include <fmt/core.h>
+
+int DecodeBenchmark(int argc, char* argv[])
+{
+    std::vector<uint32_t> code;
+    uint64_t base = 0x82000000;
+
+    if (argc > 0)
+    {
+        const auto image = Image::ParseImage(std::filesystem::path(argv[0]));
+        for (const auto& section : image.sections)
+        {
+            if ((section.flags & SectionFlags_Code) != 0)
+            {
+                const auto* data = reinterpret_cast<const uint32_t*>(section.data);
+                code.insert(code.end(), data, data + section.size / sizeof(uint32_t));
+            }
+        }
+
+        if (code.empty())
+        {
+            fmt::println("ERROR: No code found in {}", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        // Random words hit every major opcode, including the ones with large extended opcode tables.
+        std::mt19937 random(0);
+        code.resize(1 << 20);
+        for (auto& word : code)
+            word = random();
+    }
+
+    size_t validCount = 0;
+    double seconds = MeasureAverage([&]()
+        {
+            ppc_insn insn;
+            validCount = 0;
+
+            for (size_t i = 0; i < code.size(); i++)
+            {
+                ppc::Disassemble(&code[i], base + i * 4, insn);
+                if (insn.opcode != nullptr)
+                    ++validCount;
+            }
+        });
+
+    fmt::println("Decoded {} instructions ({} valid) in {:.3f} ms", code.size(), validCount, seconds * 1000.0);
+    fmt::println("{:.2f} million instructions per second", code.size() / seconds / 1000000.0);
+
+    return EXIT_SUCCESS;
+}
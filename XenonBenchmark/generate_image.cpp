@@ -0,0 +1,119 @@
+#include "benchmark.h"
+#include "synthetic_image.h"
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <fmt/core.h>
+
+static bool ParseOption(std::string_view argument, SyntheticImageOptions& options)
+{
+    const size_t separator = argument.find('=');
+    if (separator == std::string_view::npos)
+        return false;
+
+    const auto key = argument.substr(0, separator);
+    const std::string value(argument.substr(separator + 1));
+    const double number = strtod(value.c_str(), nullptr);
+
+    if (key == "seed")
+        options.seed = uint32_t(strtoul(value.c_str(), nullptr, 10));
+    else if (key == "functions")
+        options.functionCount = size_t(strtoull(value.c_str(), nullptr, 10));
+    else if (key == "integer_blocks")
+        options.integerBlocks = number;
+    else if (key == "float_blocks")
+        options.floatBlocks = number;
+    else if (key == "vector_blocks")
+        options.vectorBlocks = number;
+    else if (key == "branches")
+        options.branches = number;
+    else if (key == "loops")
+        options.loops = number;
+    else if (key == "calls")
+        options.calls = number;
+    else if (key == "jump_tables")
+        options.jumpTables = number;
+    else if (key == "helper_ratio")
+        options.helperRatio = number;
+    else if (key == "pdata_ratio")
+        options.pdataRatio = number;
+    else
+        return false;
+
+    return true;
+}
+
+static bool WriteFile(const std::filesystem::path& path, const void* data, size_t size)
+{
+    std::ofstream stream(path, std::ios::binary);
+    if (!stream.good())
+    {
+        fmt::println("ERROR: Unable to write {}", path.string());
+        return false;
+    }
+
+    stream.write(reinterpret_cast<const char*>(data), size);
+    return true;
+}
+
+int GenerateImage(int argc, char* argv[])
+{
+    if (argc < 1)
+    {
+        fmt::println("ERROR: An output directory path is required");
+        return EXIT_FAILURE;
+    }
+
+    SyntheticImageOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!ParseOption(argv[i], options))
+        {
+            fmt::println("ERROR: Unknown option {}", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (options.functionCount == 0)
+    {
+        fmt::println("ERROR: At least one function is required");
+        return EXIT_FAILURE;
+    }
+
+    const std::filesystem::path directoryPath(argv[0]);
+    std::filesystem::create_directories(directoryPath / "synthetic_out");
+
+    const auto image = GenerateSyntheticImage(options);
+    if (!WriteFile(directoryPath / "synthetic.elf", image.file.data(), image.file.size()))
+        return EXIT_FAILURE;
+
+    std::string switchTables = "# Generated by XenonBenchmark\n";
+    for (const auto& table : image.switchTables)
+    {
+        switchTables += fmt::format("[[switch]]\nbase = 0x{:X}\nr = {}\ndefault = 0x{:X}\nlabels = [\n", table.base, table.r, table.defaultLabel);
+        for (uint32_t label : table.labels)
+            switchTables += fmt::format("    0x{:X},\n", label);
+
+        switchTables += "]\n\n";
+    }
+
+    if (!WriteFile(directoryPath / "synthetic_switch_tables.toml", switchTables.data(), switchTables.size()))
+        return EXIT_FAILURE;
+
+    std::string config = "[main]\n";
+    config += "file_path = \"synthetic.elf\"\n";
+    config += "out_directory_path = \"synthetic_out\"\n";
+    config += "switch_table_file_path = \"synthetic_switch_tables.toml\"\n\n";
+
+    for (const auto& [name, address] : image.helpers)
+        config += fmt::format("{}_address = 0x{:X}\n", name, address);
+
+    if (!WriteFile(directoryPath / "synthetic.toml", config.data(), config.size()))
+        return EXIT_FAILURE;
+
+    fmt::println("Generated {} functions, {} instructions, {} jump tables ({:.1f} MiB)", image.functionCount,
+        image.instructionCount, image.switchTables.size(), image.file.size() / (1024.0 * 1024.0));
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,29 @@
+#include "benchmark.h"
+#include <cstdlib>
+#include <fmt/core.h>
+
+static const Benchmark Benchmarks[] =
+{
+    { "decode", "[image file path]", DecodeBenchmark },
+    { "analyze", "[image file path] [function count]", AnalyzeBenchmark },
+    { "pipeline", "[config TOML file path] [PPC context header file path] [optional JSON report file path]", PipelineBenchmark },
+    { "generate", "[output directory path] [optional key=value options]", GenerateImage },
+};
+
+int main(int argc, char* argv[])
+{
+    if (argc >= 2)
+    {
+        for (const auto& benchmark : Benchmarks)
+        {
+            if (benchmark.name == argv[1])
+                return benchmark.function(argc - 2, argv + 2);
+        }
+    }
+
+    fmt::println("Usage: XenonBenchmark [benchmark] [arguments]");
+    for (const auto& benchmark : Benchmarks)
+        fmt::println("    {} {}", benchmark.name, benchmark.usage);
+
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,113 @@
+#include "benchmark.h"
+#include <recompiler.h>
+
+static std::string EscapeJson(std::string_view text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+
+        escaped += c;
+    }
+
+    return escaped;
+}
+
+int PipelineBenchmark(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fmt::println("ERROR: A config file path and a PPC context header file path are required");
+        return EXIT_FAILURE;
+    }
+
+    const auto begin = ProcessStats::Capture();
+
+    Recompiler recompiler;
+    if (!recompiler.LoadConfig(argv[0]))
+        return EXIT_FAILURE;
+
+    recompiler.Analyse();
+
+    // Same as XenonRecomp, so the output matches a regular run.
+    auto entry = recompiler.image.symbols.find(recompiler.image.entry_point);
+    if (entry != nullptr)
+        entry->name = "_xstart";
+
+    recompiler.Recompile(argv[1]);
+
+    const auto end = ProcessStats::Capture();
+    const auto total = RecompilerPhaseTiming::Measure("total", begin, end);
+
+    const size_t functionCount = recompiler.functions.size();
+    size_t instructionCount = 0;
+    for (const auto& fn : recompiler.functions)
+        instructionCount += fn.size / sizeof(uint32_t);
+
+    auto perSecond = [](size_t count, double seconds)
+        {
+            return seconds > 0.0 ? count / seconds : 0.0;
+        };
+
+    fmt::println("");
+    fmt::println("{} functions, {} instructions, {} threads", functionCount, instructionCount, recompiler.GetThreadCount());
+    fmt::println("{:<10} {:>10} {:>10} {:>10} {:>14} {:>16}", "phase", "wall ms", "cpu ms", "peak MiB", "functions/s", "instructions/s");
+
+    auto printTiming = [&](const RecompilerPhaseTiming& timing)
+        {
+            fmt::println("{:<10} {:>10.1f} {:>10.1f} {:>10.1f} {:>14.0f} {:>16.0f}", timing.name, timing.seconds * 1000.0, timing.cpuSeconds * 1000.0,
+                timing.peakResidentBytes / (1024.0 * 1024.0), perSecond(functionCount, timing.seconds), perSecond(instructionCount, timing.seconds));
+        };
+
+    for (const auto& timing : recompiler.timings)
+        printTiming(timing);
+
+    printTiming(total);
+
+    if (argc < 3)
+        return EXIT_SUCCESS;
+
+    std::string json;
+    auto appendTiming = [&](const RecompilerPhaseTiming& timing, std::string_view indent)
+        {
+            json += fmt::format("{}{{ \"name\": \"{}\", \"wall_seconds\": {:.6f}, \"cpu_seconds\": {:.6f}, \"peak_resident_bytes\": {}, "
+                "\"functions_per_second\": {:.1f}, \"instructions_per_second\": {:.1f} }}",
+                indent, timing.name, timing.seconds, timing.cpuSeconds, timing.peakResidentBytes,
+                perSecond(functionCount, timing.seconds), perSecond(instructionCount, timing.seconds));
+        };
+
+    auto appendTimings = [&](std::string_view name, const std::vector<RecompilerPhaseTiming>& timings)
+        {
+            json += fmt::format("  \"{}\": [\n", name);
+            for (size_t i = 0; i < timings.size(); i++)
+            {
+                appendTiming(timings[i], "    ");
+                json += i + 1 < timings.size() ? ",\n" : "\n";
+            }
+
+            json += "  ],\n";
+        };
+
+    json += "{\n";
+    json += fmt::format("  \"config\": \"{}\",\n", EscapeJson(argv[0]));
+    json += fmt::format("  \"functions\": {},\n", functionCount);
+    json += fmt::format("  \"instructions\": {},\n", instructionCount);
+    json += fmt::format("  \"threads\": {},\n", recompiler.GetThreadCount());
+    appendTimings("phases", recompiler.timings);
+    appendTimings("analysis_phases", recompiler.analysisTimings);
+    json += "  \"total\":\n";
+    appendTiming(total, "    ");
+    json += "\n}\n";
+
+    std::ofstream stream(argv[2]);
+    if (!stream.good())
+    {
+        fmt::println("ERROR: Unable to write the report file: {}", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    stream.write(json.data(), json.size());
+    return EXIT_SUCCESS;
+}
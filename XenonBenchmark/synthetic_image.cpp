@@ -0,0 +1,651 @@
+#include "synthetic_image.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <byteswap.h>
+#include <elf.h>
+
+static constexpr uint32_t c_imageBase = 0x82000000;
+static constexpr uint32_t c_textBase = c_syntheticTextBase;
+static constexpr uint32_t c_sectionAlignment = 0x1000;
+static constexpr uint16_t c_machinePpc = 20;
+
+static constexpr uint32_t c_mflrR12 = 0x7D8802A6;
+static constexpr uint32_t c_mtlrR12 = 0x7D8803A6;
+static constexpr uint32_t c_blr = 0x4E800020;
+static constexpr uint32_t c_bctr = 0x4E800420;
+
+// BO and BI of the conditional branches.
+static constexpr uint32_t c_boTrue = 12;
+static constexpr uint32_t c_boFalse = 4;
+static constexpr uint32_t c_boDecrementNotZero = 16;
+static constexpr uint32_t c_biCr6Greater = 25;
+
+// The standard distributions differ between standard libraries, so values are derived
+// from the engine output directly to keep images identical everywhere.
+struct SyntheticRandom
+{
+    std::mt19937 engine;
+
+    explicit SyntheticRandom(uint32_t seed) : engine(seed)
+    {
+    }
+
+    // Value in [min, max].
+    uint32_t Range(uint32_t min, uint32_t max)
+    {
+        return min + engine() % (max - min + 1);
+    }
+
+    int32_t SignedRange(int32_t min, int32_t max)
+    {
+        return min + int32_t(engine() % uint32_t(max - min + 1));
+    }
+
+    bool Chance(double probability)
+    {
+        return engine() < probability * 4294967296.0;
+    }
+
+    // Average rounded up or down, so the expected value matches it.
+    size_t Count(double average)
+    {
+        size_t count = size_t(average);
+        if (Chance(average - count))
+            count++;
+
+        return count;
+    }
+
+    uint32_t IntegerRegister()
+    {
+        return Range(3, 31);
+    }
+};
+
+static uint32_t DForm(uint32_t op, uint32_t d, uint32_t a, int32_t immediate)
+{
+    return (op << 26) | (d << 21) | (a << 16) | (uint32_t(immediate) & 0xFFFF);
+}
+
+static uint32_t XForm(uint32_t op, uint32_t d, uint32_t a, uint32_t b, uint32_t xo, uint32_t rc = 0)
+{
+    return (op << 26) | (d << 21) | (a << 16) | (b << 11) | (xo << 1) | rc;
+}
+
+static uint32_t AForm(uint32_t op, uint32_t d, uint32_t a, uint32_t b, uint32_t c, uint32_t xo)
+{
+    return (op << 26) | (d << 21) | (a << 16) | (b << 11) | (c << 6) | (xo << 1);
+}
+
+static uint32_t VXForm(uint32_t d, uint32_t a, uint32_t b, uint32_t xo)
+{
+    return (4 << 26) | (d << 21) | (a << 16) | (b << 11) | xo;
+}
+
+static uint32_t VAForm(uint32_t d, uint32_t a, uint32_t b, uint32_t c, uint32_t xo)
+{
+    return (4 << 26) | (d << 21) | (a << 16) | (b << 11) | (c << 6) | xo;
+}
+
+static uint32_t Addi(uint32_t d, uint32_t a, int32_t immediate) { return DForm(14, d, a, immediate); }
+static uint32_t Addis(uint32_t d, uint32_t a, int32_t immediate) { return DForm(15, d, a, immediate); }
+static uint32_t Lwz(uint32_t d, uint32_t a, int32_t offset) { return DForm(32, d, a, offset); }
+static uint32_t Stw(uint32_t s, uint32_t a, int32_t offset) { return DForm(36, s, a, offset); }
+static uint32_t Stwu(uint32_t s, uint32_t a, int32_t offset) { return DForm(37, s, a, offset); }
+static uint32_t Ld(uint32_t d, uint32_t a, int32_t offset) { return DForm(58, d, a, offset & ~3); }
+static uint32_t Std(uint32_t s, uint32_t a, int32_t offset) { return DForm(62, s, a, offset & ~3); }
+static uint32_t Lfd(uint32_t d, uint32_t a, int32_t offset) { return DForm(50, d, a, offset); }
+static uint32_t Stfd(uint32_t s, uint32_t a, int32_t offset) { return DForm(54, s, a, offset); }
+static uint32_t Cmpwi(uint32_t cr, uint32_t a, int32_t immediate) { return DForm(11, cr << 2, a, immediate); }
+static uint32_t Cmplwi(uint32_t cr, uint32_t a, uint32_t immediate) { return DForm(10, cr << 2, a, int32_t(immediate)); }
+static uint32_t Mtctr(uint32_t s) { return XForm(31, s, 9, 0, 467); }
+static uint32_t Lvx(uint32_t d, uint32_t a, uint32_t b) { return XForm(31, d, a, b, 103); }
+static uint32_t Stvx(uint32_t s, uint32_t a, uint32_t b) { return XForm(31, s, a, b, 231); }
+
+static uint32_t Rlwinm(uint32_t a, uint32_t s, uint32_t shift, uint32_t mb, uint32_t me)
+{
+    return (21 << 26) | (s << 21) | (a << 16) | (shift << 11) | (mb << 6) | (me << 1);
+}
+
+// VMX128 forms split the register number into the usual 5 bit field and 2 extra bits.
+static uint32_t Lvx128(uint32_t d, uint32_t a, uint32_t b)
+{
+    return 0x100000C3 | ((d & 31) << 21) | (a << 16) | (b << 11) | ((d >> 5) << 2);
+}
+
+static uint32_t Stvx128(uint32_t s, uint32_t a, uint32_t b)
+{
+    return 0x100001C3 | ((s & 31) << 21) | (a << 16) | (b << 11) | ((s >> 5) << 2);
+}
+
+static uint32_t Bc(uint32_t bo, uint32_t bi, int32_t offset)
+{
+    return (16 << 26) | (bo << 21) | (bi << 16) | (uint32_t(offset) & 0xFFFC);
+}
+
+static uint32_t B(int32_t offset, bool link = false)
+{
+    return (18 << 26) | (uint32_t(offset) & 0x3FFFFFC) | (link ? 1 : 0);
+}
+
+static uint32_t AlignUp(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+namespace
+{
+    enum class BlockKind
+    {
+        Integer,
+        Float,
+        Vector,
+        Branch,
+        Loop,
+        Call,
+        JumpTable
+    };
+
+    struct GeneratedFunction
+    {
+        std::vector<uint32_t> code;
+
+        // Instructions that branch to another function, or to a fixed address when the index is -1.
+        struct Call
+        {
+            size_t index;
+            size_t function;
+            uint32_t address;
+            bool link;
+        };
+
+        std::vector<Call> calls;
+
+        // Instruction of the lis that loads the table, with the instructions of the cases.
+        struct JumpTable
+        {
+            size_t index;
+            size_t defaultIndex;
+            std::vector<size_t> cases;
+        };
+
+        std::vector<JumpTable> jumpTables;
+        bool inPdata{};
+    };
+}
+
+// Helpers are laid out like the ones in retail images, each entry point falling through to the next.
+static void GenerateHelpers(std::vector<uint32_t>& code, SyntheticImage& image)
+{
+    auto begin = [&](const char* name)
+        {
+            image.helpers.emplace_back(name, c_textBase + uint32_t(code.size() * sizeof(uint32_t)));
+        };
+
+    begin("savegprlr_14");
+    for (uint32_t i = 14; i < 32; i++)
+        code.push_back(Std(i, 1, -0x98 + int32_t(i - 14) * 8));
+    code.push_back(Stw(12, 1, -0x8));
+    code.push_back(c_blr);
+
+    begin("restgprlr_14");
+    for (uint32_t i = 14; i < 32; i++)
+        code.push_back(Ld(i, 1, -0x98 + int32_t(i - 14) * 8));
+    code.push_back(Lwz(12, 1, -0x8));
+    code.push_back(c_mtlrR12);
+    code.push_back(c_blr);
+
+    begin("savefpr_14");
+    for (uint32_t i = 14; i < 32; i++)
+        code.push_back(Stfd(i, 12, -0x90 + int32_t(i - 14) * 8));
+    code.push_back(c_blr);
+
+    begin("restfpr_14");
+    for (uint32_t i = 14; i < 32; i++)
+        code.push_back(Lfd(i, 12, -0x90 + int32_t(i - 14) * 8));
+    code.push_back(c_blr);
+
+    begin("savevmx_14");
+    for (uint32_t i = 14; i < 32; i++)
+    {
+        code.push_back(Addi(11, 0, -0x120 + int32_t(i - 14) * 0x10));
+        code.push_back(Stvx(i, 11, 12));
+    }
+    code.push_back(c_blr);
+
+    begin("restvmx_14");
+    for (uint32_t i = 14; i < 32; i++)
+    {
+        code.push_back(Addi(11, 0, -0x120 + int32_t(i - 14) * 0x10));
+        code.push_back(Lvx(i, 11, 12));
+    }
+    code.push_back(c_blr);
+
+    begin("savevmx_64");
+    for (uint32_t i = 64; i < 128; i++)
+    {
+        code.push_back(Addi(11, 0, -0x400 + int32_t(i - 64) * 0x10));
+        code.push_back(Stvx128(i, 11, 12));
+    }
+    code.push_back(c_blr);
+
+    begin("restvmx_64");
+    for (uint32_t i = 64; i < 128; i++)
+    {
+        code.push_back(Addi(11, 0, -0x400 + int32_t(i - 64) * 0x10));
+        code.push_back(Lvx128(i, 11, 12));
+    }
+    code.push_back(c_blr);
+}
+
+static uint32_t FindHelper(const SyntheticImage& image, const char* name)
+{
+    for (const auto& [helperName, address] : image.helpers)
+    {
+        if (helperName == name)
+            return address;
+    }
+
+    return 0;
+}
+
+static void GenerateBlock(SyntheticRandom& random, BlockKind kind, size_t functionCount, GeneratedFunction& fn)
+{
+    auto& code = fn.code;
+
+    switch (kind)
+    {
+    case BlockKind::Integer:
+    {
+        const size_t count = random.Range(1, 8);
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint32_t d = random.IntegerRegister();
+            const uint32_t a = random.IntegerRegister();
+            const uint32_t b = random.IntegerRegister();
+
+            switch (random.Range(0, 10))
+            {
+            case 0: code.push_back(Addi(d, a, random.SignedRange(-100, 100))); break;
+            case 1: code.push_back(XForm(31, d, a, b, 266, random.Range(0, 1))); break; // add
+            case 2: code.push_back(XForm(31, d, a, b, 40)); break;                      // subf
+            case 3: code.push_back(XForm(31, d, a, b, 235)); break;                     // mullw
+            case 4: code.push_back(XForm(31, a, d, b, 28, random.Range(0, 1))); break;  // and
+            case 5: code.push_back(XForm(31, a, d, d ^ 1, 444)); break;                 // or, never the or rx, rx, rx hints
+            case 6: code.push_back(XForm(31, a, d, b, 316)); break;                     // xor
+            case 7: code.push_back(XForm(31, a, d, random.Range(0, 31), 824)); break;   // srawi
+            case 8: code.push_back(Rlwinm(d, a, random.Range(0, 31), random.Range(0, 15), random.Range(16, 31))); break;
+            case 9: code.push_back(Lwz(d, 1, random.Range(0, 20) * 4)); break;
+            default: code.push_back(Stw(d, 1, random.Range(0, 20) * 4)); break;
+            }
+        }
+        break;
+    }
+
+    case BlockKind::Float:
+    {
+        const size_t count = random.Range(1, 6);
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint32_t d = random.Range(0, 31);
+            const uint32_t a = random.Range(0, 31);
+            const uint32_t b = random.Range(0, 31);
+            const uint32_t c = random.Range(0, 31);
+
+            switch (random.Range(0, 6))
+            {
+            case 0: code.push_back(AForm(63, d, a, b, 0, 21)); break; // fadd
+            case 1: code.push_back(AForm(63, d, a, b, 0, 20)); break; // fsub
+            case 2: code.push_back(AForm(63, d, a, 0, c, 25)); break; // fmul
+            case 3: code.push_back(AForm(63, d, a, b, c, 29)); break; // fmadd
+            case 4: code.push_back(AForm(59, d, a, b, 0, 21)); break; // fadds
+            case 5: code.push_back(Lfd(d, 1, random.Range(0, 8) * 8)); break;
+            default: code.push_back(Stfd(d, 1, random.Range(0, 8) * 8)); break;
+            }
+        }
+        break;
+    }
+
+    case BlockKind::Vector:
+    {
+        const size_t count = random.Range(8, 32);
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint32_t d = random.Range(0, 31);
+            const uint32_t a = random.Range(0, 31);
+            const uint32_t b = random.Range(0, 31);
+            const uint32_t c = random.Range(0, 31);
+
+            switch (random.Range(0, 9))
+            {
+            case 0: code.push_back(VXForm(d, a, b, 10)); break;                    // vaddfp
+            case 1: code.push_back(VXForm(d, a, b, 74)); break;                    // vsubfp
+            case 2: code.push_back(VAForm(d, a, b, c, 46)); break;                 // vmaddfp
+            case 3: code.push_back(VAForm(d, a, b, c, 43)); break;                 // vperm
+            case 4: code.push_back(VXForm(d, a, b, 1028)); break;                  // vand
+            case 5: code.push_back(VXForm(d, a, b, 1156)); break;                  // vor
+            case 6: code.push_back(VXForm(d, a, b, 1220)); break;                  // vxor
+            case 7: code.push_back(VXForm(d, random.Range(0, 3), b, 652)); break;  // vspltw
+            case 8: code.push_back(Lvx(d, 0, 1)); break;
+            default: code.push_back(Stvx(d, 0, 1)); break;
+            }
+        }
+        break;
+    }
+
+    case BlockKind::Branch:
+    {
+        const uint32_t cr = random.Range(0, 7);
+        const size_t skipCount = random.Range(1, 6);
+        code.push_back(Cmpwi(cr, random.IntegerRegister(), random.SignedRange(-5, 5)));
+        code.push_back(Bc(random.Chance(0.5) ? c_boTrue : c_boFalse, cr * 4 + random.Range(0, 2), int32_t(skipCount + 1) * 4));
+
+        for (size_t i = 0; i < skipCount; i++)
+            code.push_back(Addi(random.IntegerRegister(), random.IntegerRegister(), 1));
+
+        break;
+    }
+
+    case BlockKind::Loop:
+    {
+        code.push_back(Addi(11, 0, random.Range(1, 9)));
+        code.push_back(Mtctr(11));
+
+        const size_t top = code.size();
+        const size_t bodyCount = random.Range(1, 4);
+        for (size_t i = 0; i < bodyCount; i++)
+            code.push_back(Addi(3, 3, 2));
+
+        code.push_back(Bc(c_boDecrementNotZero, 0, -int32_t(code.size() - top) * 4));
+        break;
+    }
+
+    case BlockKind::Call:
+        fn.calls.push_back({ code.size(), random.Range(0, uint32_t(functionCount - 1)), 0, true });
+        code.push_back(0);
+        break;
+
+    case BlockKind::JumpTable:
+    {
+        // The absolute jump table idiom XenonAnalyse detects.
+        const size_t caseCount = random.Range(2, 8);
+        const size_t begin = code.size();
+
+        code.push_back(Cmplwi(6, 3, uint32_t(caseCount - 1)));
+        code.push_back(0); // bgt cr6, default
+        code.push_back(0); // lis r11, table@ha
+        code.push_back(0); // addi r11, r11, table@l
+        code.push_back(Rlwinm(0, 3, 2, 0, 29));
+        code.push_back(XForm(31, 0, 11, 0, 23)); // lwzx
+        code.push_back(Mtctr(0));
+        code.push_back(c_bctr);
+
+        GeneratedFunction::JumpTable table;
+        table.index = begin + 2;
+
+        for (size_t i = 0; i < caseCount; i++)
+        {
+            table.cases.push_back(code.size());
+            code.push_back(Addi(3, 3, int32_t(i)));
+            code.push_back(0); // b end
+        }
+
+        const size_t end = code.size();
+        table.defaultIndex = end;
+        code[begin + 1] = Bc(c_boTrue, c_biCr6Greater, int32_t(end - (begin + 1)) * 4);
+
+        for (size_t index : table.cases)
+            code[index + 1] = B(int32_t(end - (index + 1)) * 4);
+
+        fn.jumpTables.push_back(std::move(table));
+        break;
+    }
+    }
+}
+
+static GeneratedFunction GenerateFunction(SyntheticRandom& random, const SyntheticImageOptions& options, const SyntheticImage& image)
+{
+    GeneratedFunction fn;
+    auto& code = fn.code;
+
+    const int32_t frameSize = int32_t(random.Range(6, 32)) * 16;
+    const bool useHelpers = random.Chance(options.helperRatio);
+    const uint32_t firstSavedRegister = random.Range(14, 29);
+
+    code.push_back(c_mflrR12);
+
+    if (useHelpers)
+    {
+        const uint32_t address = FindHelper(image, "savegprlr_14") + (firstSavedRegister - 14) * 4;
+        fn.calls.push_back({ code.size(), size_t(-1), address, true });
+        code.push_back(0);
+    }
+    else
+    {
+        code.push_back(Stw(12, 1, -0x8));
+    }
+
+    code.push_back(Stwu(1, 1, -frameSize));
+
+    std::vector<BlockKind> blocks;
+    auto addBlocks = [&](BlockKind kind, double average)
+        {
+            blocks.insert(blocks.end(), random.Count(average), kind);
+        };
+
+    addBlocks(BlockKind::Integer, options.integerBlocks);
+    addBlocks(BlockKind::Float, options.floatBlocks);
+    addBlocks(BlockKind::Vector, options.vectorBlocks);
+    addBlocks(BlockKind::Branch, options.branches);
+    addBlocks(BlockKind::Loop, options.loops);
+    addBlocks(BlockKind::Call, options.calls);
+    addBlocks(BlockKind::JumpTable, options.jumpTables);
+
+    for (size_t i = blocks.size(); i > 1; i--)
+        std::swap(blocks[i - 1], blocks[random.Range(0, uint32_t(i - 1))]);
+
+    for (auto kind : blocks)
+        GenerateBlock(random, kind, options.functionCount, fn);
+
+    code.push_back(Addi(1, 1, frameSize));
+
+    if (useHelpers)
+    {
+        const uint32_t address = FindHelper(image, "restgprlr_14") + (firstSavedRegister - 14) * 4;
+        fn.calls.push_back({ code.size(), size_t(-1), address, false });
+        code.push_back(0);
+    }
+    else
+    {
+        code.push_back(Lwz(12, 1, -0x8));
+        code.push_back(c_mtlrR12);
+        code.push_back(c_blr);
+    }
+
+    // Function analysis can't see past the bctr of a jump table, so such functions always need
+    // their boundaries from .pdata, as they have in retail images.
+    fn.inPdata = random.Chance(options.pdataRatio) || !fn.jumpTables.empty();
+    return fn;
+}
+
+// Sections are stored at their offset from the image base, followed by the section names and headers.
+static void WriteImage(SyntheticImage& image, const std::vector<uint32_t>& text, uint32_t rdataBase, std::vector<uint32_t> rdata,
+    const std::vector<uint32_t>& pdata, uint32_t entry)
+{
+    const uint32_t textSize = uint32_t(text.size() * sizeof(uint32_t));
+
+    if (rdata.empty())
+        rdata.push_back(0);
+
+    const uint32_t rdataSize = uint32_t(rdata.size() * sizeof(uint32_t));
+    const uint32_t pdataBase = AlignUp(rdataBase + rdataSize, c_sectionAlignment);
+    const uint32_t pdataSize = uint32_t(pdata.size() * sizeof(uint32_t));
+
+    static const char c_sectionNames[] = "\0.text\0.rdata\0.pdata\0.shstrtab";
+    const uint32_t namesOffset = pdataBase + pdataSize - c_imageBase;
+    const uint32_t headersOffset = AlignUp(namesOffset + sizeof(c_sectionNames), 4);
+
+    struct SectionInfo
+    {
+        uint32_t name;
+        uint32_t type;
+        uint32_t flags;
+        uint32_t address;
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    const SectionInfo sections[] =
+    {
+        { 0, SHT_NULL, 0, 0, 0, 0 },
+        { 1, SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, c_textBase, c_textBase - c_imageBase, textSize },
+        { 7, SHT_PROGBITS, SHF_ALLOC, rdataBase, rdataBase - c_imageBase, rdataSize },
+        { 14, SHT_PROGBITS, SHF_ALLOC, pdataBase, pdataBase - c_imageBase, pdataSize },
+        { 21, SHT_STRTAB, 0, 0, namesOffset, sizeof(c_sectionNames) },
+    };
+
+    constexpr size_t c_sectionCount = std::size(sections);
+    auto& file = image.file;
+    file.resize(headersOffset + c_sectionCount * sizeof(Elf32_Shdr));
+
+    auto writeWords = [&](uint32_t offset, const std::vector<uint32_t>& words)
+        {
+            auto* destination = reinterpret_cast<uint32_t*>(file.data() + offset);
+            for (size_t i = 0; i < words.size(); i++)
+                destination[i] = ByteSwap(words[i]);
+        };
+
+    writeWords(c_textBase - c_imageBase, text);
+    writeWords(rdataBase - c_imageBase, rdata);
+    writeWords(pdataBase - c_imageBase, pdata);
+    memcpy(file.data() + namesOffset, c_sectionNames, sizeof(c_sectionNames));
+
+    auto* headers = reinterpret_cast<Elf32_Shdr*>(file.data() + headersOffset);
+    for (size_t i = 0; i < c_sectionCount; i++)
+    {
+        auto& header = headers[i];
+        header.sh_name = ByteSwap(sections[i].name);
+        header.sh_type = ByteSwap(sections[i].type);
+        header.sh_flags = ByteSwap(sections[i].flags);
+        header.sh_addr = ByteSwap(sections[i].address);
+        header.sh_offset = ByteSwap(sections[i].offset);
+        header.sh_size = ByteSwap(sections[i].size);
+        header.sh_addralign = ByteSwap(uint32_t(4));
+    }
+
+    auto* header = reinterpret_cast<Elf32_Ehdr*>(file.data());
+    header->e_ident[EI_MAG0] = ELFMAG0;
+    header->e_ident[EI_MAG1] = ELFMAG1;
+    header->e_ident[EI_MAG2] = ELFMAG2;
+    header->e_ident[EI_MAG3] = ELFMAG3;
+    header->e_ident[EI_CLASS] = ELFCLASS32;
+    header->e_ident[EI_DATA] = ELFDATA2MSB;
+    header->e_ident[EI_VERSION] = EV_CURRENT;
+    header->e_type = ByteSwap(uint16_t(ET_EXEC));
+    header->e_machine = ByteSwap(c_machinePpc);
+    header->e_version = ByteSwap(uint32_t(EV_CURRENT));
+    header->e_entry = ByteSwap(entry);
+    header->e_phoff = ByteSwap(uint32_t(sizeof(Elf32_Ehdr)));
+    header->e_shoff = ByteSwap(headersOffset);
+    header->e_ehsize = ByteSwap(uint16_t(sizeof(Elf32_Ehdr)));
+    header->e_phentsize = ByteSwap(uint16_t(sizeof(Elf32_Phdr)));
+    header->e_phnum = ByteSwap(uint16_t(1));
+    header->e_shentsize = ByteSwap(uint16_t(sizeof(Elf32_Shdr)));
+    header->e_shnum = ByteSwap(uint16_t(c_sectionCount));
+    header->e_shstrndx = ByteSwap(uint16_t(c_sectionCount - 1));
+
+    auto* programHeader = reinterpret_cast<Elf32_Phdr*>(file.data() + sizeof(Elf32_Ehdr));
+    programHeader->p_type = ByteSwap(uint32_t(PT_LOAD));
+    programHeader->p_vaddr = ByteSwap(c_imageBase);
+    programHeader->p_paddr = ByteSwap(c_imageBase);
+    programHeader->p_filesz = ByteSwap(namesOffset);
+    programHeader->p_memsz = ByteSwap(namesOffset);
+    programHeader->p_flags = ByteSwap(uint32_t(PF_R | PF_W | PF_X));
+    programHeader->p_align = ByteSwap(c_sectionAlignment);
+}
+
+SyntheticImage GenerateSyntheticImage(const SyntheticImageOptions& options)
+{
+    SyntheticImage image;
+    SyntheticRandom random(options.seed);
+
+    std::vector<uint32_t> text;
+    GenerateHelpers(text, image);
+
+    std::vector<GeneratedFunction> functions;
+    functions.reserve(options.functionCount);
+
+    std::vector<uint32_t> addresses;
+    addresses.reserve(options.functionCount);
+
+    for (size_t i = 0; i < options.functionCount; i++)
+    {
+        functions.push_back(GenerateFunction(random, options, image));
+        addresses.push_back(c_textBase + uint32_t(text.size() * sizeof(uint32_t)));
+        text.resize(text.size() + functions.back().code.size());
+    }
+
+    const uint32_t textSize = uint32_t(text.size() * sizeof(uint32_t));
+    const uint32_t rdataBase = AlignUp(c_textBase + textSize, c_sectionAlignment);
+
+    std::vector<uint32_t> rdata;
+    std::vector<uint32_t> pdata;
+
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        auto& fn = functions[i];
+        const uint32_t address = addresses[i];
+
+        for (const auto& call : fn.calls)
+        {
+            const uint32_t source = address + uint32_t(call.index * sizeof(uint32_t));
+            const uint32_t target = call.function != size_t(-1) ? addresses[call.function] : call.address;
+            fn.code[call.index] = B(int32_t(target - source), call.link);
+        }
+
+        for (const auto& table : fn.jumpTables)
+        {
+            const uint32_t tableAddress = rdataBase + uint32_t(rdata.size() * sizeof(uint32_t));
+            const int32_t high = int32_t((tableAddress + 0x8000) >> 16);
+            fn.code[table.index] = Addis(11, 0, high);
+            fn.code[table.index + 1] = Addi(11, 11, int32_t(tableAddress - (uint32_t(high) << 16)));
+
+            SyntheticSwitchTable& switchTable = image.switchTables.emplace_back();
+            switchTable.base = address + uint32_t(table.index * sizeof(uint32_t));
+            switchTable.r = 3;
+            switchTable.defaultLabel = address + uint32_t(table.defaultIndex * sizeof(uint32_t));
+
+            for (size_t index : table.cases)
+            {
+                const uint32_t label = address + uint32_t(index * sizeof(uint32_t));
+                switchTable.labels.push_back(label);
+                rdata.push_back(label);
+            }
+        }
+
+        if (fn.inPdata)
+        {
+            // Prolog length, function length in instructions and the 32-bit flag.
+            pdata.push_back(address);
+            pdata.push_back(3 | (uint32_t(fn.code.size()) << 8) | (1u << 30));
+        }
+
+        std::copy(fn.code.begin(), fn.code.end(), text.begin() + (address - c_textBase) / sizeof(uint32_t));
+        image.instructionCount += fn.code.size();
+    }
+
+    image.functionCount = functions.size();
+
+    WriteImage(image, text, rdataBase, rdata, pdata, addresses.empty() ? c_textBase : addresses.front());
+    return image;
+}
+
+SyntheticImage BuildSyntheticImage(const SyntheticSections& sections)
+{
+    SyntheticImage image;
+    image.instructionCount = sections.text.size();
+
+    WriteImage(image, sections.text, sections.rdataBase, sections.rdata, {}, c_textBase);
+    return image;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Address of the first instruction in every synthetic image.
+static constexpr uint32_t c_syntheticTextBase = 0x82001000;
+
+struct SyntheticImageOptions
+{
+    uint32_t seed{};
+    size_t functionCount{ 100000 };
+
+    // Average amount of each kind of block in a function.
+    double integerBlocks{ 3.0 };
+    double floatBlocks{ 0.5 };
+    double vectorBlocks{ 1.0 };
+    double branches{ 2.0 };
+    double loops{ 0.5 };
+    double calls{ 1.0 };
+    double jumpTables{ 0.1 };
+
+    // Share of functions that save registers through the __savegprlr/__restgprlr helpers.
+    double helperRatio{ 0.3 };
+
+    // Share of functions listed in .pdata, the rest have to be found through calls and gaps.
+    double pdataRatio{ 0.7 };
+};
+
+struct SyntheticSwitchTable
+{
+    // Address of the table lookup, as XenonAnalyse reports it.
+    uint32_t base{};
+    uint32_t r{};
+    uint32_t defaultLabel{};
+    std::vector<uint32_t> labels;
+};
+
+struct SyntheticImage
+{
+    // Big endian PPC ELF file.
+    std::vector<uint8_t> file;
+    std::vector<SyntheticSwitchTable> switchTables;
+
+    // Register save/restore helpers, named like their config properties without the "_address" suffix.
+    std::vector<std::pair<std::string, uint32_t>> helpers;
+
+    size_t functionCount{};
+    size_t instructionCount{};
+};
+
+// Code and read-only data written by hand, for images that need exact instruction sequences.
+// The code starts at c_syntheticTextBase, the data at rdataBase, which must come after the code.
+struct SyntheticSections
+{
+    std::vector<uint32_t> text;
+    uint32_t rdataBase{};
+    std::vector<uint32_t> rdata;
+};
+
+// Generates the same image for the same options on every platform.
+SyntheticImage GenerateSyntheticImage(const SyntheticImageOptions& options);
+
+SyntheticImage BuildSyntheticImage(const SyntheticSections& sections);
@@ -28,7 +28,7 @@ int main(int argc, char* argv[])
         recompiler.Analyse();
 
         auto entry = recompiler.image.symbols.find(recompiler.image.entry_point);
-        if (entry != recompiler.image.symbols.end())
+        if (entry != nullptr)
         {
             entry->name = "_xstart";
         }
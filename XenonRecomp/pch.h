@@ -1,15 +1,25 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <cstring>
 #include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <disasm.h>
 #include <file.h>
 #include <filesystem>
 #include <fstream>
 #include <function.h>
+#include <functional>
 #include <image.h>
+#include <map>
+#include <mutex>
+#include <thread>
 #include <toml++/toml.hpp>
 #include <unordered_map>
 #include <unordered_set>
@@ -1,6 +1,8 @@
 //#include "pch.h"
 #include "recompiler.h"
 #include <xex_patcher.h>
+#include <memory_mapped_file.h>
+#include <parallel.h>
 #include <sstream>
 
 static uint64_t ComputeMask(uint32_t mstart, uint32_t mstop)
@@ -13,89 +15,210 @@ static uint64_t ComputeMask(uint32_t mstart, uint32_t mstop)
 
 bool Recompiler::LoadConfig(const std::string_view& configFilePath)
 {
+    timings.clear();
+
+    auto phaseBegin = ProcessStats::Capture();
+    auto endPhase = [&](const char* name)
+        {
+            const auto now = ProcessStats::Capture();
+            timings.push_back(RecompilerPhaseTiming::Measure(name, phaseBegin, now));
+            phaseBegin = now;
+        };
+
     config.Load(configFilePath);
 
-    std::vector<uint8_t> file;
-    if (!config.patchedFilePath.empty())
-        file = LoadFile((config.directoryPath + config.patchedFilePath).c_str());
+    // Images are parsed straight from a mapping of the input file whenever no patching is needed.
+    const std::string patchedFilePath = config.directoryPath + config.patchedFilePath;
+    if (!config.patchedFilePath.empty() && std::filesystem::is_regular_file(patchedFilePath))
+    {
+        endPhase("load");
+        endPhase("patch");
+        image = Image::ParseImage(std::filesystem::path(patchedFilePath));
+        endPhase("parse");
+        return true;
+    }
 
-    if (file.empty())
+    if (config.patchFilePath.empty())
     {
-        file = LoadFile((config.directoryPath + config.filePath).c_str());
+        endPhase("load");
+        endPhase("patch");
+        image = Image::ParseImage(std::filesystem::path(config.directoryPath + config.filePath));
+        endPhase("parse");
+        return true;
+    }
 
-        if (!config.patchFilePath.empty())
-        {
-            const auto patchFile = LoadFile((config.directoryPath + config.patchFilePath).c_str());
-            if (!patchFile.empty())
-            {
-                std::vector<uint8_t> outBytes;
-                auto result = XexPatcher::apply(file.data(), file.size(), patchFile.data(), patchFile.size(), outBytes, false);
-                if (result == XexPatcher::Result::Success)
-                {
-                    std::exchange(file, outBytes);
+    const MemoryMappedFile xexFile(config.directoryPath + config.filePath);
+    const auto patchFile = LoadFile((config.directoryPath + config.patchFilePath).c_str());
+    if (patchFile.empty())
+    {
+        fmt::println("ERROR: Unable to load the patch file");
+        return false;
+    }
 
-                    if (!config.patchedFilePath.empty())
-                    {
-                        std::ofstream stream(config.directoryPath + config.patchedFilePath, std::ios::binary);
-                        if (stream.good())
-                        {
-                            stream.write(reinterpret_cast<const char*>(file.data()), file.size());
-                            stream.close();
-                        }
-                    }
-                }
-                else
-                {
-                    fmt::print("ERROR: Unable to apply the patch file, ");
+    endPhase("load");
 
-                    switch (result)
-                    {
-                    case XexPatcher::Result::XexFileUnsupported:
-                        fmt::println("XEX file unsupported");
-                        break;
+    std::vector<uint8_t> file;
+    auto result = XexPatcher::apply(xexFile.data(), xexFile.size(), patchFile.data(), patchFile.size(), file, false);
+    if (result != XexPatcher::Result::Success)
+    {
+        fmt::print("ERROR: Unable to apply the patch file, ");
 
-                    case XexPatcher::Result::XexFileInvalid:
-                        fmt::println("XEX file invalid");
-                        break;
+        switch (result)
+        {
+        case XexPatcher::Result::XexFileUnsupported:
+            fmt::println("XEX file unsupported");
+            break;
 
-                    case XexPatcher::Result::PatchFileInvalid:
-                        fmt::println("patch file invalid");
-                        break;
+        case XexPatcher::Result::XexFileInvalid:
+            fmt::println("XEX file invalid");
+            break;
 
-                    case XexPatcher::Result::PatchIncompatible:
-                        fmt::println("patch file incompatible");
-                        break;
+        case XexPatcher::Result::PatchFileInvalid:
+            fmt::println("patch file invalid");
+            break;
 
-                    case XexPatcher::Result::PatchFailed:
-                        fmt::println("patch failed");
-                        break;
+        case XexPatcher::Result::PatchIncompatible:
+            fmt::println("patch file incompatible");
+            break;
 
-                    case XexPatcher::Result::PatchUnsupported:
-                        fmt::println("patch unsupported");
-                        break;
+        case XexPatcher::Result::PatchFailed:
+            fmt::println("patch failed");
+            break;
 
-                    default:
-                        fmt::println("reason unknown");
-                        break;
-                    }
+        case XexPatcher::Result::PatchUnsupported:
+            fmt::println("patch unsupported");
+            break;
 
-                    return false;
-                }
-            }
-            else
-            {
-                fmt::println("ERROR: Unable to load the patch file");
-                return false;
-            }
+        default:
+            fmt::println("reason unknown");
+            break;
+        }
+
+        return false;
+    }
+
+    if (!config.patchedFilePath.empty())
+    {
+        std::ofstream stream(patchedFilePath, std::ios::binary);
+        if (stream.good())
+        {
+            stream.write(reinterpret_cast<const char*>(file.data()), file.size());
+            stream.close();
         }
     }
 
+    endPhase("patch");
     image = Image::ParseImage(file.data(), file.size());
+    endPhase("parse");
     return true;
 }
 
+// Helper functions that XenonAnalyse searches for, named like their config keys without the "_address" suffix.
+static constexpr std::pair<std::string_view, uint32_t RecompilerConfig::*> c_helperAddresses[] =
+{
+    { "restgprlr_14", &RecompilerConfig::restGpr14Address },
+    { "savegprlr_14", &RecompilerConfig::saveGpr14Address },
+    { "restfpr_14", &RecompilerConfig::restFpr14Address },
+    { "savefpr_14", &RecompilerConfig::saveFpr14Address },
+    { "restvmx_14", &RecompilerConfig::restVmx14Address },
+    { "savevmx_14", &RecompilerConfig::saveVmx14Address },
+    { "restvmx_64", &RecompilerConfig::restVmx64Address },
+    { "savevmx_64", &RecompilerConfig::saveVmx64Address },
+    { "longjmp", &RecompilerConfig::longJmpAddress },
+    { "setjmp", &RecompilerConfig::setJmpAddress },
+};
+
+size_t Recompiler::GetThreadCount() const
+{
+    if (config.threadCount != 0)
+        return config.threadCount;
+
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
 void Recompiler::Analyse()
 {
+    analysisTimings.clear();
+
+    const auto analysisBegin = ProcessStats::Capture();
+    auto phaseBegin = analysisBegin;
+    auto endPhase = [&](const char* name)
+        {
+            const auto now = ProcessStats::Capture();
+            analysisTimings.push_back(RecompilerPhaseTiming::Measure(name, phaseBegin, now));
+            phaseBegin = now;
+        };
+
+    auto finish = [&]()
+        {
+            timings.push_back(RecompilerPhaseTiming::Measure("analyse", analysisBegin, phaseBegin));
+
+            double totalSeconds = 0.0;
+            std::string phases;
+            for (auto& timing : analysisTimings)
+            {
+                totalSeconds += timing.seconds;
+                phases += fmt::format("{}{} {:.3f}s", phases.empty() ? "" : ", ", timing.name, timing.seconds);
+            }
+
+            fmt::println("Analysed {} functions in {:.3f}s ({})", functions.size(), totalSeconds, phases);
+        };
+
+    const size_t threadCount = GetThreadCount();
+
+    instructions.Build(image, threadCount);
+    endPhase("decode");
+
+    // Results are only taken from a database of the same image, and functions only if they were
+    // found with the same config as well.
+    const bool useDatabase = !config.analysisDatabaseFilePath.empty();
+    const std::string databaseFilePath = config.directoryPath + config.analysisDatabaseFilePath;
+    AnalysisDatabase database;
+    XXH128_hash_t imageHash{};
+    XXH128_hash_t analysisHash{};
+
+    if (useDatabase)
+    {
+        imageHash = AnalysisDatabase::ComputeImageHash(image);
+        if (database.Load(databaseFilePath) && XXH128_isEqual(database.imageHash, imageHash))
+            ApplyAnalysisDatabase(database);
+        else
+            database = {};
+    }
+
+    if (config.restGpr14Address == 0) fmt::println("ERROR: __restgprlr_14 address is unspecified");
+    if (config.saveGpr14Address == 0) fmt::println("ERROR: __savegprlr_14 address is unspecified");
+    if (config.restFpr14Address == 0) fmt::println("ERROR: __restfpr_14 address is unspecified");
+    if (config.saveFpr14Address == 0) fmt::println("ERROR: __savefpr_14 address is unspecified");
+    if (config.restVmx14Address == 0) fmt::println("ERROR: __restvmx_14 address is unspecified");
+    if (config.saveVmx14Address == 0) fmt::println("ERROR: __savevmx_14 address is unspecified");
+    if (config.restVmx64Address == 0) fmt::println("ERROR: __restvmx_64 address is unspecified");
+    if (config.saveVmx64Address == 0) fmt::println("ERROR: __savevmx_64 address is unspecified");
+
+    if (useDatabase)
+    {
+        analysisHash = ComputeAnalysisHash();
+        if (!database.functions.empty() && XXH128_isEqual(database.functionsHash, analysisHash))
+        {
+            for (auto& symbol : database.symbols)
+                image.symbols.emplace(symbol.name, symbol.address, symbol.size, Symbol_Function);
+
+            functions = std::move(database.functions);
+            image.symbols.freeze();
+            endPhase("database");
+            finish();
+            return;
+        }
+    }
+
+    // Symbols of the image itself, to tell them apart from the ones added below when saving the database.
+    std::vector<size_t> imageSymbolAddresses;
+    if (useDatabase)
+    {
+        for (auto& symbol : image.symbols)
+            imageSymbolAddresses.push_back(symbol.address);
+    }
+
     for (size_t i = 14; i < 128; i++)
     {
         if (i < 32)
@@ -105,7 +228,7 @@ void Recompiler::Analyse()
                 auto& restgpr = functions.emplace_back();
                 restgpr.base = config.restGpr14Address + (i - 14) * 4;
                 restgpr.size = (32 - i) * 4 + 12;
-                image.symbols.emplace(Symbol{ fmt::format("__restgprlr_{}", i), restgpr.base, restgpr.size, Symbol_Function });
+                image.symbols.emplace(fmt::format("__restgprlr_{}", i), restgpr.base, restgpr.size, Symbol_Function);
             }
 
             if (config.saveGpr14Address != 0)
@@ -184,7 +307,7 @@ void Recompiler::Analyse()
         fn.BeginAddress = ByteSwap(fn.BeginAddress);
         fn.Data = ByteSwap(fn.Data);
 
-        if (image.symbols.find(fn.BeginAddress) == image.symbols.end())
+        if (image.symbols.find(fn.BeginAddress) == nullptr)
         {
             auto& f = functions.emplace_back();
             f.base = fn.BeginAddress;
@@ -194,125 +317,413 @@ void Recompiler::Analyse()
         }
     }
 
+    endPhase("symbols");
+
+    // Function discovery only ever looks up symbols at exact addresses, and the functions it finds
+    // don't depend on the symbols, so the work below is split between threads against a read-only
+    // table. Results are merged in the order a serial scan of each section would find them, which
+    // keeps the output identical no matter how many threads are used.
+    std::vector<const Section*> codeSections;
     for (const auto& section : image.sections)
     {
-        if (!(section.flags & SectionFlags_Code))
-        {
-            continue;
-        }
-        size_t base = section.base;
-        uint8_t* data = section.data;
-        uint8_t* dataEnd = section.data + section.size;
+        if (section.flags & SectionFlags_Code)
+            codeSections.push_back(&section);
+    }
+
+    struct CallScanChunk
+    {
+        size_t sectionIndex;
+        size_t begin;
+        size_t end;
+        std::vector<size_t> targets;
+    };
+
+    constexpr size_t c_callScanChunkSize = 0x10000;
 
-        while (data < dataEnd)
+    std::vector<CallScanChunk> callScanChunks;
+    for (size_t i = 0; i < codeSections.size(); i++)
+    {
+        for (size_t offset = 0; offset < codeSections[i]->size; offset += c_callScanChunkSize)
+            callScanChunks.push_back({ i, offset, std::min<size_t>(offset + c_callScanChunkSize, codeSections[i]->size) });
+    }
+
+    const auto& symbols = image.symbols;
+
+    // Targets of bl instructions that aren't known functions yet.
+    ParallelFor(threadCount, callScanChunks.size(), [&](size_t i)
         {
-            uint32_t insn = ByteSwap(*(uint32_t*)data);
-            if (PPC_OP(insn) == PPC_OP_B && PPC_BL(insn))
-            {
-                size_t address = base + (data - section.data) + PPC_BI(insn);
+            auto& chunk = callScanChunks[i];
+            const auto& section = *codeSections[chunk.sectionIndex];
 
-                if (address >= section.base && address < section.base + section.size && image.symbols.find(address) == image.symbols.end())
+            for (size_t offset = chunk.begin; offset < chunk.end; offset += sizeof(uint32_t))
+            {
+                uint32_t insn = ByteSwap(*(uint32_t*)(section.data + offset));
+                if (PPC_OP(insn) == PPC_OP_B && PPC_BL(insn))
                 {
-                    auto data = section.data + address - section.base;
-                    auto& fn = functions.emplace_back(Function::Analyze(data, section.base + section.size - address, address));
-                    image.symbols.emplace(fmt::format("sub_{:X}", fn.base), fn.base, fn.size, Symbol_Function);
+                    size_t address = section.base + offset + PPC_BI(insn);
+                    if (address >= section.base && address < section.base + section.size && symbols.find(address) == nullptr)
+                        chunk.targets.push_back(address);
                 }
             }
-            data += 4;
+        });
+
+    struct CallTarget
+    {
+        size_t sectionIndex;
+        size_t address;
+    };
+
+    std::vector<CallTarget> callTargets;
+    std::unordered_set<size_t> seenCallTargets;
+
+    for (auto& chunk : callScanChunks)
+    {
+        for (auto address : chunk.targets)
+        {
+            if (seenCallTargets.emplace(address).second)
+                callTargets.push_back({ chunk.sectionIndex, address });
         }
+    }
+
+    std::vector<Function> callFunctions(callTargets.size());
+    ParallelFor(threadCount, callTargets.size(), [&](size_t i)
+        {
+            const auto& target = callTargets[i];
+            const auto& section = *codeSections[target.sectionIndex];
+            callFunctions[i] = Function::Analyze(section.data + target.address - section.base, section.base + section.size - target.address, target.address, &instructions);
+        });
+
+    // Kept per section to append them in the original discovery order.
+    std::vector<std::vector<Function>> sectionFunctions(codeSections.size());
 
-        data = section.data;
+    for (size_t i = 0; i < callTargets.size(); i++)
+    {
+        auto& fn = sectionFunctions[callTargets[i].sectionIndex].emplace_back(std::move(callFunctions[i]));
+        image.symbols.emplace(fmt::format("sub_{:X}", fn.base), fn.base, fn.size, Symbol_Function);
+    }
 
-        while (data < dataEnd)
+    callFunctions.clear();
+    image.symbols.freeze();
+    endPhase("calls");
+
+    // Gaps between known functions are walked from every known function start up to the next one,
+    // as if the serial walk had arrived there. The serial walk is then replayed, jumping over the
+    // parts it lands on exactly and only walking itself when a function runs past the next start.
+    struct GapSegment
+    {
+        const Section* section;
+        size_t begin;
+        size_t limit;
+        size_t end;
+        std::vector<Function> functions;
+    };
+
+    // Advances the gap walk by one step, analysing a new function if nothing is known at the address.
+    auto walkGap = [&](const Section& section, size_t address, std::vector<Function>& found) -> size_t
         {
+            const uint8_t* data = section.data + address - section.base;
+
             auto invalidInstr = config.invalidInstructions.find(ByteSwap(*(uint32_t*)data));
             if (invalidInstr != config.invalidInstructions.end())
+                return address + invalidInstr->second;
+
+            auto fnSymbol = symbols.find(address);
+            if (fnSymbol != nullptr && fnSymbol->address == address && fnSymbol->type == Symbol_Function)
+                return address + fnSymbol->size;
+
+            auto& fn = found.emplace_back(Function::Analyze(data, section.base + section.size - address, address, &instructions));
+            return address + fn.size;
+        };
+
+    std::vector<GapSegment> gapSegments;
+    std::vector<size_t> sectionSegmentBegins;
+
+    for (auto* section : codeSections)
+    {
+        sectionSegmentBegins.push_back(gapSegments.size());
+        gapSegments.push_back({ section, section->base });
+
+        auto it = std::lower_bound(symbols.begin(), symbols.end(), section->base, SymbolComparer());
+        for (; it != symbols.end() && it->address < section->base + section->size; ++it)
+        {
+            if (it->address != gapSegments.back().begin)
             {
-                base += invalidInstr->second;
-                data += invalidInstr->second;
-                continue;
+                auto fnSymbol = symbols.find(it->address);
+                if (fnSymbol != nullptr && fnSymbol->type == Symbol_Function)
+                    gapSegments.push_back({ section, it->address });
             }
+        }
 
-            auto fnSymbol = image.symbols.find(base);
-            if (fnSymbol != image.symbols.end() && fnSymbol->address == base && fnSymbol->type == Symbol_Function)
-            {
-                assert(fnSymbol->address == base);
+        for (size_t i = sectionSegmentBegins.back(); i < gapSegments.size(); i++)
+            gapSegments[i].limit = i + 1 < gapSegments.size() ? gapSegments[i + 1].begin : section->base + section->size;
+    }
+
+    sectionSegmentBegins.push_back(gapSegments.size());
+
+    ParallelFor(threadCount, gapSegments.size(), [&](size_t i)
+        {
+            auto& segment = gapSegments[i];
+            size_t address = segment.begin;
+            while (address < segment.limit)
+                address = walkGap(*segment.section, address, segment.functions);
+
+            segment.end = address;
+        });
+
+    for (size_t i = 0; i < codeSections.size(); i++)
+    {
+        const auto& section = *codeSections[i];
+        auto& found = sectionFunctions[i];
+
+        auto segment = gapSegments.begin() + sectionSegmentBegins[i];
+        auto segmentsEnd = gapSegments.begin() + sectionSegmentBegins[i + 1];
+
+        const size_t gapFunctionsBegin = found.size();
+        size_t address = section.base;
 
-                base += fnSymbol->size;
-                data += fnSymbol->size;
+        while (address < section.base + section.size)
+        {
+            while (segment != segmentsEnd && segment->begin < address)
+                ++segment;
+
+            if (segment != segmentsEnd && segment->begin == address)
+            {
+                std::move(segment->functions.begin(), segment->functions.end(), std::back_inserter(found));
+                address = segment->end;
             }
             else
             {
-                auto& fn = functions.emplace_back(Function::Analyze(data, dataEnd - data, base));
-                image.symbols.emplace(fmt::format("sub_{:X}", fn.base), fn.base, fn.size, Symbol_Function);
-
-                base += fn.size;
-                data += fn.size;
+                address = walkGap(section, address, found);
             }
         }
+
+        for (size_t j = gapFunctionsBegin; j < found.size(); j++)
+            image.symbols.emplace(fmt::format("sub_{:X}", found[j].base), found[j].base, found[j].size, Symbol_Function);
     }
 
+    for (auto& found : sectionFunctions)
+        std::move(found.begin(), found.end(), std::back_inserter(functions));
+
+    endPhase("gaps");
+
     std::sort(functions.begin(), functions.end(), [](auto& lhs, auto& rhs) { return lhs.base < rhs.base; });
+
+    // No more symbols get added past this point, recompilation threads only read from the table.
+    image.symbols.freeze();
+    endPhase("sort");
+
+    if (useDatabase)
+    {
+        database.imageHash = imageHash;
+        database.functionsHash = analysisHash;
+        database.functions = functions;
+
+        database.helpers.clear();
+        for (auto& [name, address] : c_helperAddresses)
+        {
+            if (config.*address != 0)
+                database.helpers.push_back({ std::string(name), config.*address });
+        }
+
+        std::map<uint32_t, const RecompilerSwitchTable*> sortedSwitchTables;
+        for (auto& [base, table] : config.switchTables)
+            sortedSwitchTables.emplace(base, &table);
+
+        database.switchTables.clear();
+        for (auto& [base, table] : sortedSwitchTables)
+            database.switchTables.push_back({ base, table->r, table->labels });
+
+        // Symbols sharing an address keep their insertion order, and the ones of the image came first.
+        database.symbols.clear();
+        auto imageSymbol = imageSymbolAddresses.begin();
+        for (auto& symbol : image.symbols)
+        {
+            if (imageSymbol != imageSymbolAddresses.end() && *imageSymbol == symbol.address)
+                ++imageSymbol;
+            else
+                database.symbols.push_back({ std::string(symbol.name), uint32_t(symbol.address), uint32_t(symbol.size) });
+        }
+
+        if (!database.Save(databaseFilePath))
+            fmt::println("ERROR: Unable to save the analysis database: {}", databaseFilePath);
+
+        endPhase("database");
+    }
+
+    finish();
+}
+
+void Recompiler::ApplyAnalysisDatabase(const AnalysisDatabase& database)
+{
+    for (auto& helper : database.helpers)
+    {
+        for (auto& [name, address] : c_helperAddresses)
+        {
+            if (helper.name == name && config.*address == 0)
+                config.*address = helper.address;
+        }
+    }
+
+    if (config.switchTables.empty())
+    {
+        for (auto& table : database.switchTables)
+            config.switchTables.emplace(table.base, RecompilerSwitchTable{ table.r, table.labels });
+    }
+}
+
+XXH128_hash_t Recompiler::ComputeAnalysisHash() const
+{
+    std::string buffer;
+
+    auto append = [&](const auto& value)
+        {
+            buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+
+    // The analysis itself is an input too.
+    append(AnalysisDatabase::c_analysisVersion);
+
+    for (auto& [name, address] : c_helperAddresses)
+        append(config.*address);
+
+    std::vector<std::pair<uint32_t, uint32_t>> sortedFunctions(config.functions.begin(), config.functions.end());
+    std::sort(sortedFunctions.begin(), sortedFunctions.end());
+    for (auto& [address, size] : sortedFunctions)
+    {
+        append(address);
+        append(size);
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> sortedInvalidInstructions(config.invalidInstructions.begin(), config.invalidInstructions.end());
+    std::sort(sortedInvalidInstructions.begin(), sortedInvalidInstructions.end());
+    for (auto& [data, size] : sortedInvalidInstructions)
+    {
+        append(data);
+        append(size);
+    }
+
+    return XXH3_128bits(buffer.data(), buffer.size());
 }
 
-bool Recompiler::Recompile(
+// Register names as context members and as local variables, formatted once up front.
+template<size_t N>
+struct RecompilerRegisterNames
+{
+    std::array<std::string, N> context;
+    std::array<std::string, N> local;
+
+    RecompilerRegisterNames(std::string_view prefix)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            context[i] = fmt::format("ctx.{}{}", prefix, i);
+            local[i] = fmt::format("{}{}", prefix, i);
+        }
+    }
+};
+
+static const RecompilerRegisterNames<32> gGprNames("r");
+static const RecompilerRegisterNames<32> gFprNames("f");
+static const RecompilerRegisterNames<128> gVprNames("v");
+static const RecompilerRegisterNames<8> gCrNames("cr");
+
+bool RecompilerEmitter::Recompile(
     const Function& fn,
-    uint32_t base,
-    const ppc_insn& insn,
-    const uint32_t* data,
-    std::unordered_map<uint32_t, RecompilerSwitchTable>::iterator& switchTable,
+    const RecompilerIRInstruction& instruction,
     RecompilerLocalVariables& localVariables,
     CSRState& csrState)
 {
+    const uint32_t base = instruction.address;
+    const ppc_insn& insn = instruction.insn;
+    const uint32_t* data = instruction.data;
+
     println("\t// {} {}", insn.opcode->name, insn.op_str);
 
-    // TODO: we could cache these formats in an array
-    auto r = [&](size_t index)
+    // CR fields the printed code refers to, to sanity check record forms.
+    uint8_t printedCrFields = 0;
+
+    // Flags that are read later. Hooks after the instruction could read the others too.
+    const size_t instructionIndex = &instruction - ir.instructions.data();
+    const bool eliminateDeadFlags = config.eliminateDeadFlags && !instruction.HasFlag(RecompilerIRInstruction::c_hook);
+    const uint8_t liveCrFields = eliminateDeadFlags ? flagLiveness.crLiveOut[instructionIndex] : 0xFF;
+    const bool carryLive = !eliminateDeadFlags || flagLiveness.carryLiveOut[instructionIndex] != 0;
+    const bool recordForm = strchr(insn.opcode->name, '.') != nullptr && (instruction.defs.cr & liveCrFields) != 0;
+
+    auto r = [&](size_t index) -> std::string_view
         {
+            if (promotion.promoted.HasR(index))
+            {
+                promotedAccesses.AddR(index);
+                localVariables.r[index] = true;
+                return gGprNames.local[index];
+            }
+
             if ((config.nonArgumentRegistersAsLocalVariables && (index == 0 || index == 2 || index == 11 || index == 12)) ||
                 (config.nonVolatileRegistersAsLocalVariables && index >= 14))
             {
                 localVariables.r[index] = true;
-                return fmt::format("r{}", index);
+                return gGprNames.local[index];
             }
-            return fmt::format("ctx.r{}", index);
+            return gGprNames.context[index];
         };
 
-    auto f = [&](size_t index)
+    auto f = [&](size_t index) -> std::string_view
         {
+            if (promotion.promoted.HasF(index))
+            {
+                promotedAccesses.AddF(index);
+                localVariables.f[index] = true;
+                return gFprNames.local[index];
+            }
+
             if ((config.nonArgumentRegistersAsLocalVariables && index == 0) ||
                 (config.nonVolatileRegistersAsLocalVariables && index >= 14))
             {
                 localVariables.f[index] = true;
-                return fmt::format("f{}", index);
+                return gFprNames.local[index];
             }
-            return fmt::format("ctx.f{}", index);
+            return gFprNames.context[index];
         };
 
-    auto v = [&](size_t index)
+    auto v = [&](size_t index) -> std::string_view
         {
+            if (promotion.promoted.HasV(index))
+            {
+                promotedAccesses.AddV(index);
+                localVariables.v[index] = true;
+                return gVprNames.local[index];
+            }
+
             if ((config.nonArgumentRegistersAsLocalVariables && (index >= 32 && index <= 63)) ||
                 (config.nonVolatileRegistersAsLocalVariables && ((index >= 14 && index <= 31) || (index >= 64 && index <= 127))))
             {
                 localVariables.v[index] = true;
-                return fmt::format("v{}", index);
+                return gVprNames.local[index];
             }
-            return fmt::format("ctx.v{}", index);
+            return gVprNames.context[index];
         };
 
-    auto cr = [&](size_t index)
+    auto cr = [&](size_t index) -> std::string_view
         {
-            if (config.crRegistersAsLocalVariables)
+            printedCrFields |= 1 << index;
+
+            if (promotion.promoted.HasCr(index))
+                promotedAccesses.AddCr(index);
+
+            if (config.crRegistersAsLocalVariables || promotion.promoted.HasCr(index))
             {
                 localVariables.cr[index] = true;
-                return fmt::format("cr{}", index);
+                return gCrNames.local[index];
             }
-            return fmt::format("ctx.cr{}", index);
+            return gCrNames.context[index];
         };
 
     auto ctr = [&]()
         {
-            if (config.ctrAsLocalVariable)
+            if (promotion.promoted.special & RecompilerRegisterSet::c_ctr)
+                promotedAccesses.special |= RecompilerRegisterSet::c_ctr;
+
+            if (config.ctrAsLocalVariable || (promotion.promoted.special & RecompilerRegisterSet::c_ctr))
             {
                 localVariables.ctr = true;
                 return "ctr";
@@ -322,7 +733,10 @@ bool Recompiler::Recompile(
 
     auto xer = [&]()
         {
-            if (config.xerAsLocalVariable)
+            if (promotion.promoted.special & RecompilerRegisterSet::c_xer)
+                promotedAccesses.special |= RecompilerRegisterSet::c_xer;
+
+            if (config.xerAsLocalVariable || (promotion.promoted.special & RecompilerRegisterSet::c_xer))
             {
                 localVariables.xer = true;
                 return "xer";
@@ -387,7 +801,7 @@ bool Recompiler::Recompile(
             {
                 auto targetSymbol = image.symbols.find(address);
 
-                if (targetSymbol != image.symbols.end() && targetSymbol->address == address && targetSymbol->type == Symbol_Function)
+                if (targetSymbol != nullptr && targetSymbol->address == address && targetSymbol->type == Symbol_Function)
                 {
                     if (config.nonVolatileRegistersAsLocalVariables && (targetSymbol->name.find("__rest") == 0 || targetSymbol->name.find("__save") == 0))
                     {
@@ -405,48 +819,69 @@ bool Recompiler::Recompile(
             }
         };
 
-    auto printConditionalBranch = [&](bool not_, const std::string_view& cond)
+    auto printIndirectCall = [&]()
         {
-            if (insn.operands[1] < fn.base || insn.operands[1] >= fn.base + fn.size)
+            // CTR always holds the same function, so call it directly instead of looking it up.
+            auto targetSymbol = FindDevirtualizedTarget(instruction);
+            if (targetSymbol != nullptr)
             {
-                println("\tif ({}{}.{}) {{", not_ ? "!" : "", cr(insn.operands[0]), cond);
-                print("\t");
-                printFunctionCall(insn.operands[1]);
-                println("\t\treturn;");
-                println("\t}}");
+                println("\t{}(ctx, base);", targetSymbol->name);
             }
             else
             {
-                println("\tif ({}{}.{}) goto loc_{:X};", not_ ? "!" : "", cr(insn.operands[0]), cond, insn.operands[1]);
+                println("\tPPC_CALL_INDIRECT_FUNC({}.u32);", ctr());
             }
         };
 
-    auto printSetFlushMode = [&](bool enable)
+    // Branches to other functions become guaranteed tail calls if enabled, as long as they're plain calls.
+    auto printTailCall = [&](uint32_t address, std::string_view indent)
         {
-            auto newState = enable ? CSRState::VMX : CSRState::FPU;
-            if (csrState != newState)
-            {
-                auto prefix = enable ? "enable" : "disable";
-                auto suffix = csrState != CSRState::Unknown ? "Unconditional" : "";
-                println("\tctx.fpscr.{}FlushMode{}();", prefix, suffix);
+            if (!config.guaranteedTailCalls || address == config.longJmpAddress || address == config.setJmpAddress)
+                return false;
+
+            auto targetSymbol = image.symbols.find(address);
+            if (targetSymbol == nullptr || targetSymbol->address != address || targetSymbol->type != Symbol_Function)
+                return false;
+
+            if (config.nonVolatileRegistersAsLocalVariables && (targetSymbol->name.find("__rest") == 0 || targetSymbol->name.find("__save") == 0))
+                return false;
+
+            println("{}PPC_TAIL_CALL_FUNC({});", indent, targetSymbol->name);
+            return true;
+        };
 
-                csrState = newState;
+    auto printConditionalBranch = [&](bool not_, const std::string_view& cond)
+        {
+            if (insn.operands[1] < fn.base || insn.operands[1] >= fn.base + fn.size)
+            {
+                println("\tif ({}{}.{}) {{", not_ ? "!" : "", cr(insn.operands[0]), cond);
+                if (!printTailCall(insn.operands[1], "\t\t"))
+                {
+                    print("\t");
+                    printFunctionCall(insn.operands[1]);
+                    println("\t\treturn;");
+                }
+                println("\t}}");
+            }
+            else
+            {
+                println("\tif ({}{}.{}) goto loc_{:X};", not_ ? "!" : "", cr(insn.operands[0]), cond, insn.operands[1]);
             }
         };
 
-    auto midAsmHook = config.midAsmHooks.find(base);
+    const auto* midAsmHook = instruction.midAsmHook;
 
     auto printMidAsmHook = [&]()
         {
-            bool returnsBool = midAsmHook->second.returnOnFalse || midAsmHook->second.returnOnTrue ||
-                midAsmHook->second.jumpAddressOnFalse != NULL || midAsmHook->second.jumpAddressOnTrue != NULL;
+            bool returnsBool = midAsmHook->returnOnFalse || midAsmHook->returnOnTrue ||
+                midAsmHook->jumpAddressOnFalse != NULL || midAsmHook->jumpAddressOnTrue != NULL;
 
             print("\t");
             if (returnsBool)
                 print("if (");
 
-            print("{}(", midAsmHook->second.name);
-            for (auto& reg : midAsmHook->second.registers)
+            print("{}(", midAsmHook->name);
+            for (auto& reg : midAsmHook->registers)
             {
                 if (out.back() != '(')
                     out += ", ";
@@ -473,7 +908,10 @@ bool Recompiler::Recompile(
 
                 case 'f':
                     if (reg == "fpscr")
+                    {
                         out += "ctx.fpscr";
+                        csrState = CSRState::Unknown; // the hook could change it
+                    }
                     else
                         out += f(std::atoi(reg.c_str() + 1));
                     break;
@@ -488,19 +926,19 @@ bool Recompiler::Recompile(
             {
                 println(")) {{");
 
-                if (midAsmHook->second.returnOnTrue)
+                if (midAsmHook->returnOnTrue)
                     println("\t\treturn;");
-                else if (midAsmHook->second.jumpAddressOnTrue != NULL)
-                    println("\t\tgoto loc_{:X};", midAsmHook->second.jumpAddressOnTrue);
+                else if (midAsmHook->jumpAddressOnTrue != NULL)
+                    println("\t\tgoto loc_{:X};", midAsmHook->jumpAddressOnTrue);
 
                 println("\t}}");
 
                 println("\telse {{");
 
-                if (midAsmHook->second.returnOnFalse)
+                if (midAsmHook->returnOnFalse)
                     println("\t\treturn;");
-                else if (midAsmHook->second.jumpAddressOnFalse != NULL)
-                    println("\t\tgoto loc_{:X};", midAsmHook->second.jumpAddressOnFalse);
+                else if (midAsmHook->jumpAddressOnFalse != NULL)
+                    println("\t\tgoto loc_{:X};", midAsmHook->jumpAddressOnFalse);
 
                 println("\t}}");
             }
@@ -508,14 +946,14 @@ bool Recompiler::Recompile(
             {
                 println(");");
 
-                if (midAsmHook->second.ret)
+                if (midAsmHook->ret)
                     println("\treturn;");
-                else if (midAsmHook->second.jumpAddress != NULL)
-                    println("\tgoto loc_{:X};", midAsmHook->second.jumpAddress);
+                else if (midAsmHook->jumpAddress != NULL)
+                    println("\tgoto loc_{:X};", midAsmHook->jumpAddress);
             }
         };
 
-    if (midAsmHook != config.midAsmHooks.end() && !midAsmHook->second.afterInstruction)
+    if (midAsmHook != nullptr && !midAsmHook->afterInstruction)
         printMidAsmHook();
 
     int id = insn.opcode->id;
@@ -524,6 +962,21 @@ bool Recompiler::Recompile(
     if (id == PPC_INST_VUPKHSB128 && insn.operands[2] == 0x60) id = PPC_INST_VUPKHSH128;
     else if (id == PPC_INST_VUPKLSB128 && insn.operands[2] == 0x60) id = PPC_INST_VUPKLSH128;
 
+    // Comparisons whose result is overwritten before anything reads it.
+    if (instruction.op == RecompilerIROp::Compare && (instruction.defs.cr & liveCrFields) == 0)
+        return true;
+
+    // Switch to the flush mode the instruction relies on.
+    const CSRState requiredCsrState = GetRequiredCSRState(id);
+    if (requiredCsrState != CSRState::Unknown && csrState != requiredCsrState)
+    {
+        auto prefix = requiredCsrState == CSRState::VMX ? "enable" : "disable";
+        auto suffix = csrState != CSRState::Unknown ? "Unconditional" : "";
+        println("\tctx.fpscr.{}FlushMode{}();", prefix, suffix);
+
+        csrState = requiredCsrState;
+    }
+
   
    
 
@@ -532,16 +985,17 @@ bool Recompiler::Recompile(
                 {
             case PPC_INST_ADD:
                 println("\t{}.u64 = {}.u64 + {}.u64;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-                if (strchr(insn.opcode->name, '.'))
+                if (recordForm)
                     println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
                 break;
                 }
 
 
             case PPC_INST_ADDC:
-                println("\t{}.ca = ({}.u32 + {}.u32 < {}.u32);", xer(), r(insn.operands[1]), r(insn.operands[2]), r(insn.operands[1]));
+                if (carryLive)
+                    println("\t{}.ca = ({}.u32 + {}.u32 < {}.u32);", xer(), r(insn.operands[1]), r(insn.operands[2]), r(insn.operands[1]));
                 println("\t{}.u64 = {}.u64 + {}.u64;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-                if (strchr(insn.opcode->name, '.'))
+                if (recordForm)
                     println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
                 break;
 
@@ -550,7 +1004,7 @@ bool Recompiler::Recompile(
                 println("\t{}.u8 = ({}.u32 + {}.u32 < {}.u32) | ({}.u32 + {}.u32 + {}.ca < {}.ca);", temp(), r(insn.operands[1]), r(insn.operands[2]), r(insn.operands[1]), r(insn.operands[1]), r(insn.operands[2]), xer(), xer());
                 println("\t{}.u64 = {}.u64 + {}.u64 + {}.ca;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]), xer());
                 println("\t{}.ca = {}.u8;", xer(), temp());
-                if (strchr(insn.opcode->name, '.'))
+                if (recordForm)
                     println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
                 break;
 
@@ -564,9 +1018,10 @@ bool Recompiler::Recompile(
 
 
             case PPC_INST_ADDIC:
-                println("\t{}.ca = {}.u32 > {};", xer(), r(insn.operands[1]), ~insn.operands[2]);
+                if (carryLive)
+                    println("\t{}.ca = {}.u32 > {};", xer(), r(insn.operands[1]), ~insn.operands[2]);
                 println("\t{}.s64 = {}.s64 + {};", r(insn.operands[0]), r(insn.operands[1]), int32_t(insn.operands[2]));
-                if (strchr(insn.opcode->name, '.'))
+                if (recordForm)
                     println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
                 break;
 
@@ -584,7 +1039,7 @@ bool Recompiler::Recompile(
                 println("\t{}.ca = ({}.u64 > {}.u64) || ({}.u64 == {}.u64 && {}.ca);", xer(),
                     r(insn.operands[1]), temp(), r(insn.operands[1]), temp(), xer());
                 println("\t{}.u64 = {}.u64;", r(insn.operands[0]), temp());
-                if (strchr(insn.opcode->name, '.'))
+                if (recordForm)
                     println("\t{}.compare<int32_t>({}.s32, 0, {});",
                         cr(0), r(insn.operands[0]), xer());
                 break;
@@ -594,21 +1049,21 @@ bool Recompiler::Recompile(
                 println("\t{}.s64 = {}.s64 + {}.ca;", temp(), r(insn.operands[1]), xer());
                 println("\t{}.ca = {}.u32 < {}.u32;", xer(), temp(), r(insn.operands[1]));
                 println("\t{}.s64 = {}.s64;", r(insn.operands[0]), temp());
-                if (strchr(insn.opcode->name, '.'))
+                if (recordForm)
                     println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
                 break;
 
 
             case PPC_INST_AND:
                 println("\t{}.u64 = {}.u64 & {}.u64;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-                if (strchr(insn.opcode->name, '.'))
+                if (recordForm)
                     println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
                 break;
 
 
             case PPC_INST_ANDC:
                 println("\t{}.u64 = {}.u64 & ~{}.u64;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-                if (strchr(insn.opcode->name, '.'))
+                if (recordForm)
                     println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
                 break;
 
@@ -633,8 +1088,11 @@ bool Recompiler::Recompile(
             case PPC_INST_B:
                 if (insn.operands[0] < fn.base || insn.operands[0] >= fn.base + fn.size)
                 {
-                    printFunctionCall(insn.operands[0]);
-                    println("\treturn;");
+                    if (!printTailCall(insn.operands[0], "\t"))
+                    {
+                        printFunctionCall(insn.operands[0]);
+                        println("\treturn;");
+                    }
                 }
                 else
                 {
@@ -645,14 +1103,14 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_BCTR:
-        if (switchTable != config.switchTables.end())
+        if (instruction.switchTable != nullptr)
         {
-            println("\tswitch ({}.u64) {{", r(switchTable->second.r));
+            println("\tswitch ({}.u64) {{", r(instruction.switchTable->r));
 
-            for (size_t i = 0; i < switchTable->second.labels.size(); i++)
+            for (size_t i = 0; i < instruction.switchTable->labels.size(); i++)
             {
                 println("\tcase {}:", i);
-                auto label = switchTable->second.labels[i];
+                auto label = instruction.switchTable->labels[i];
                 if (label < fn.base || label >= fn.base + fn.size)
                 {
                     println("\t\t// ERROR: 0x{:X}", label);
@@ -668,13 +1126,16 @@ bool Recompiler::Recompile(
             println("\tdefault:");
             println("\t\t__builtin_unreachable();");
             println("\t}}");
-
-            switchTable = config.switchTables.end();
         }
         else
         {
-            println("\tPPC_CALL_INDIRECT_FUNC({}.u32);", ctr());
-            println("\treturn;");
+            // A known CTR makes it a branch to another function like any other.
+            auto targetSymbol = FindDevirtualizedTarget(instruction);
+            if (targetSymbol == nullptr || !printTailCall(targetSymbol->address, "\t"))
+            {
+                printIndirectCall();
+                println("\treturn;");
+            }
         }
         break;
 
@@ -683,8 +1144,7 @@ bool Recompiler::Recompile(
     case PPC_INST_BCTRL:
         if (!config.skipLr)
             println("\tctx.lr = 0x{:X};", base + 4);
-        println("\tPPC_CALL_INDIRECT_FUNC({}.u32);", ctr());
-        csrState = CSRState::Unknown; // the call could change it
+        printIndirectCall();
         break;
 
 
@@ -754,7 +1214,6 @@ bool Recompiler::Recompile(
         if (!config.skipLr)
             println("\tctx.lr = 0x{:X};", base + 4);
         printFunctionCall(insn.operands[0]);
-        csrState = CSRState::Unknown; // the call could change it
         break;
 
 
@@ -823,7 +1282,7 @@ bool Recompiler::Recompile(
 
     case PPC_INST_CLRLWI:
         println("\t{}.u64 = {}.u32 & 0x{:X};", r(insn.operands[0]), r(insn.operands[1]), (1ull << (32 - insn.operands[2])) - 1);
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -922,21 +1381,21 @@ bool Recompiler::Recompile(
 
     case PPC_INST_DIVDU:
         println("\t{}.u64 = {}.u64 / {}.u64;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
 
     case PPC_INST_DIVW:
         println("\t{}.s32 = {}.s32 / {}.s32;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
 
     case PPC_INST_DIVWU:
         println("\t{}.u32 = {}.u32 / {}.u32;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -949,209 +1408,179 @@ bool Recompiler::Recompile(
     case PPC_INST_EQV:
         // rA = ~(rS XOR rB)
         println("\t{}.u64 = ~({}.u64 ^ {}.u64);", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
 
     case PPC_INST_EXTSB:
         println("\t{}.s64 = {}.s8;", r(insn.operands[0]), r(insn.operands[1]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
 
     case PPC_INST_EXTSH:
         println("\t{}.s64 = {}.s16;", r(insn.operands[0]), r(insn.operands[1]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
 
     case PPC_INST_EXTSW:
         println("\t{}.s64 = {}.s32;", r(insn.operands[0]), r(insn.operands[1]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
 
     case PPC_INST_FABS:
-        printSetFlushMode(false);
         println("\t{}.u64 = {}.u64 & ~0x8000000000000000;", f(insn.operands[0]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FADD:
-        printSetFlushMode(false);
         println("\t{}.f64 = {}.f64 + {}.f64;", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]));
         break;
 
 
     case PPC_INST_FADDS:
-        printSetFlushMode(false);
         println("\t{}.f64 = double(float({}.f64 + {}.f64));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]));
         break;
 
 
     case PPC_INST_FCFID:
-        printSetFlushMode(false);
         println("\t{}.f64 = double({}.s64);", f(insn.operands[0]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FCMPU:
-        printSetFlushMode(false);
         println("\t{}.compare({}.f64, {}.f64);", cr(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]));
         break;
 
 
     case PPC_INST_FCTID:
-        printSetFlushMode(false);
         println("\t{}.s64 = ({}.f64 > double(LLONG_MAX)) ? LLONG_MAX : _mm_cvtsd_si64(_mm_load_sd(&{}.f64));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FCTIDZ:
-        printSetFlushMode(false);
         println("\t{}.s64 = ({}.f64 > double(LLONG_MAX)) ? LLONG_MAX : _mm_cvttsd_si64(_mm_load_sd(&{}.f64));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FCTIWZ:
-        printSetFlushMode(false);
         println("\t{}.s64 = ({}.f64 > double(INT_MAX)) ? INT_MAX : _mm_cvttsd_si32(_mm_load_sd(&{}.f64));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FDIV:
-        printSetFlushMode(false);
         println("\t{}.f64 = {}.f64 / {}.f64;", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]));
         break;
 
 
     case PPC_INST_FDIVS:
-        printSetFlushMode(false);
         println("\t{}.f64 = double(float({}.f64 / {}.f64));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]));
         break;
 
 
     case PPC_INST_FMADD:
-        printSetFlushMode(false);
         println("\t{}.f64 = {}.f64 * {}.f64 + {}.f64;", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]), f(insn.operands[3]));
         break;
 
 
     case PPC_INST_FMADDS:
-        printSetFlushMode(false);
         println("\t{}.f64 = double(float({}.f64 * {}.f64 + {}.f64));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]), f(insn.operands[3]));
         break;
 
 
     case PPC_INST_FMR:
-        printSetFlushMode(false);
         println("\t{}.f64 = {}.f64;", f(insn.operands[0]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FMSUB:
-        printSetFlushMode(false);
         println("\t{}.f64 = {}.f64 * {}.f64 - {}.f64;", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]), f(insn.operands[3]));
         break;
 
 
     case PPC_INST_FMSUBS:
-        printSetFlushMode(false);
         println("\t{}.f64 = double(float({}.f64 * {}.f64 - {}.f64));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]), f(insn.operands[3]));
         break;
 
 
     case PPC_INST_FMUL:
-        printSetFlushMode(false);
         println("\t{}.f64 = {}.f64 * {}.f64;", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]));
         break;
 
 
     case PPC_INST_FMULS:
-        printSetFlushMode(false);
         println("\t{}.f64 = double(float({}.f64 * {}.f64));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]));
         break;
 
 
     case PPC_INST_FNABS:
-        printSetFlushMode(false);
         println("\t{}.u64 = {}.u64 | 0x8000000000000000;", f(insn.operands[0]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FNEG:
-        printSetFlushMode(false);
         println("\t{}.u64 = {}.u64 ^ 0x8000000000000000;", f(insn.operands[0]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FNMADDS:
-        printSetFlushMode(false);
         println("\t{}.f64 = double(float(-({}.f64 * {}.f64 + {}.f64)));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]), f(insn.operands[3]));
         break;
 
 
     case PPC_INST_FNMSUB:
-        printSetFlushMode(false);
         println("\t{}.f64 = -({}.f64 * {}.f64 - {}.f64);", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]), f(insn.operands[3]));
         break;
 
 
     case PPC_INST_FNMSUBS:
-        printSetFlushMode(false);
         println("\t{}.f64 = double(float(-({}.f64 * {}.f64 - {}.f64)));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]), f(insn.operands[3]));
         break;
 
 
     case PPC_INST_FRES:
-        printSetFlushMode(false);
         println("\t{}.f64 = float(1.0 / {}.f64);", f(insn.operands[0]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FRSP:
-        printSetFlushMode(false);
         println("\t{}.f64 = double(float({}.f64));", f(insn.operands[0]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FSEL:
-        printSetFlushMode(false);
         println("\t{}.f64 = {}.f64 >= 0.0 ? {}.f64 : {}.f64;", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]), f(insn.operands[3]));
         break;
 
 
     case PPC_INST_FRSQRTE:
         // TODO(crack): I sure hope the c++ optimizer can optimize this. Fixme with some simd magic later
-        printSetFlushMode(false);
         println("\t{}.f64 = double(1.0f / sqrtf(float({}.f64)));", f(insn.operands[0]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FSQRT:
-        printSetFlushMode(false);
         println("\t{}.f64 = sqrt({}.f64);", f(insn.operands[0]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FSQRTS:
-        printSetFlushMode(false);
         println("\t{}.f64 = double(float(sqrt({}.f64)));", f(insn.operands[0]), f(insn.operands[1]));
         break;
 
 
     case PPC_INST_FSUB:
-        printSetFlushMode(false);
         println("\t{}.f64 = {}.f64 - {}.f64;", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]));
         break;
 
 
     case PPC_INST_FSUBS:
-        printSetFlushMode(false);
         println("\t{}.f64 = double(float({}.f64 - {}.f64));", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]));
         break;
 
@@ -1212,7 +1641,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_LFD:
-        printSetFlushMode(false);
         print("\t{}.u64 = PPC_LOAD_U64(", f(insn.operands[0]));
         if (insn.operands[2] != 0)
             print("{}.u32 + ", r(insn.operands[2]));
@@ -1221,7 +1649,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_LFDX:
-        printSetFlushMode(false);
         print("\t{}.u64 = PPC_LOAD_U64(", f(insn.operands[0]));
         if (insn.operands[1] != 0)
             print("{}.u32 + ", r(insn.operands[1]));
@@ -1230,7 +1657,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_LFS:
-        printSetFlushMode(false);
         print("\t{}.u32 = PPC_LOAD_U32(", temp());
         if (insn.operands[2] != 0)
             print("{}.u32 + ", r(insn.operands[2]));
@@ -1240,7 +1666,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_LFSX:
-        printSetFlushMode(false);
         print("\t{}.u32 = PPC_LOAD_U32(", temp());
         if (insn.operands[1] != 0)
             print("{}.u32 + ", r(insn.operands[1]));
@@ -1432,7 +1857,7 @@ bool Recompiler::Recompile(
 
     case PPC_INST_MR:
         println("\t{}.u64 = {}.u64;", r(insn.operands[0]), r(insn.operands[1]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1483,7 +1908,7 @@ bool Recompiler::Recompile(
 
     case PPC_INST_MULHWU:
         println("\t{}.u64 = (uint64_t({}.u32) * uint64_t({}.u32)) >> 32;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1500,7 +1925,7 @@ bool Recompiler::Recompile(
 
     case PPC_INST_MULLW:
         println("\t{}.s64 = int64_t({}.s32) * int64_t({}.s32);", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1508,7 +1933,7 @@ bool Recompiler::Recompile(
     case PPC_INST_MULHD:
         println("\t{}.s64 = __mulh({}.s64, {}.s64);",
             r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});",
                 cr(0), r(insn.operands[0]), xer());
         break;
@@ -1517,7 +1942,7 @@ bool Recompiler::Recompile(
     case PPC_INST_MULHDU:
         println("\t{}.u64 = __mulhu({}.u64, {}.u64);",
             r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});",
                 cr(0), r(insn.operands[0]), xer());
         break;
@@ -1530,7 +1955,7 @@ bool Recompiler::Recompile(
 
     case PPC_INST_NEG:
         println("\t{}.s64 = -{}.s64;", r(insn.operands[0]), r(insn.operands[1]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1547,14 +1972,14 @@ bool Recompiler::Recompile(
 
     case PPC_INST_NOT:
         println("\t{}.u64 = ~{}.u64;", r(insn.operands[0]), r(insn.operands[1]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
 
     case PPC_INST_OR:
         println("\t{}.u64 = {}.u64 | {}.u64;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1602,7 +2027,7 @@ bool Recompiler::Recompile(
 
     case PPC_INST_RLWINM:
         println("\t{}.u64 = __builtin_rotateleft64({}.u32 | ({}.u64 << 32), {}) & 0x{:X};", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[1]), insn.operands[2], ComputeMask(insn.operands[3] + 32, insn.operands[4] + 32));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1611,7 +2036,7 @@ bool Recompiler::Recompile(
         println("\t{}.u64 = __builtin_rotateleft64({}.u32 | ({}.u64 << 32), {}.u8 & 0x1F) & 0x{:X};",
             r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[1]),
             r(insn.operands[2]), ComputeMask(insn.operands[3] + 32, insn.operands[4] + 32));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1628,7 +2053,7 @@ bool Recompiler::Recompile(
 
     case PPC_INST_ROTLWI:
         println("\t{}.u64 = __builtin_rotateleft32({}.u32, {});", r(insn.operands[0]), r(insn.operands[1]), insn.operands[2]);
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1640,7 +2065,7 @@ bool Recompiler::Recompile(
 
     case PPC_INST_SLW:
         println("\t{}.u64 = {}.u8 & 0x20 ? 0 : ({}.u32 << ({}.u8 & 0x3F));", r(insn.operands[0]), r(insn.operands[2]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1648,7 +2073,8 @@ bool Recompiler::Recompile(
     case PPC_INST_SRAD:
         println("\t{}.u64 = {}.u64 & 0x7F;", temp(), r(insn.operands[2]));
         println("\tif ({}.u64 > 0x3F) {}.u64 = 0x3F;", temp(), temp());
-        println("\t{}.ca = ({}.s64 < 0) & ((({}.s64 >> {}.u64) << {}.u64) != {}.s64);", xer(), r(insn.operands[1]), r(insn.operands[1]), temp(), temp(), r(insn.operands[1]));
+        if (carryLive)
+            println("\t{}.ca = ({}.s64 < 0) & ((({}.s64 >> {}.u64) << {}.u64) != {}.s64);", xer(), r(insn.operands[1]), r(insn.operands[1]), temp(), temp(), r(insn.operands[1]));
         println("\t{}.s64 = {}.s64 >> {}.u64;", r(insn.operands[0]), r(insn.operands[1]), temp());
         break;
 
@@ -1656,12 +2082,14 @@ bool Recompiler::Recompile(
     case PPC_INST_SRADI:
         if (insn.operands[2] != 0)
         {
-            println("\t{}.ca = ({}.s64 < 0) & (({}.u64 & 0x{:X}) != 0);", xer(), r(insn.operands[1]), r(insn.operands[1]), ComputeMask(64 - insn.operands[2], 63));
+            if (carryLive)
+                println("\t{}.ca = ({}.s64 < 0) & (({}.u64 & 0x{:X}) != 0);", xer(), r(insn.operands[1]), r(insn.operands[1]), ComputeMask(64 - insn.operands[2], 63));
             println("\t{}.s64 = {}.s64 >> {};", r(insn.operands[0]), r(insn.operands[1]), insn.operands[2]);
         }
         else
         {
-            println("\t{}.ca = 0;", xer());
+            if (carryLive)
+                println("\t{}.ca = 0;", xer());
             println("\t{}.s64 = {}.s64;", r(insn.operands[0]), r(insn.operands[1]));
         }
         break;
@@ -1671,9 +2099,10 @@ bool Recompiler::Recompile(
     case PPC_INST_SRAW:
         println("\t{}.u32 = {}.u32 & 0x3F;", temp(), r(insn.operands[2]));
         println("\tif ({}.u32 > 0x1F) {}.u32 = 0x1F;", temp(), temp());
-        println("\t{}.ca = ({}.s32 < 0) & ((({}.s32 >> {}.u32) << {}.u32) != {}.s32);", xer(), r(insn.operands[1]), r(insn.operands[1]), temp(), temp(), r(insn.operands[1]));
+        if (carryLive)
+            println("\t{}.ca = ({}.s32 < 0) & ((({}.s32 >> {}.u32) << {}.u32) != {}.s32);", xer(), r(insn.operands[1]), r(insn.operands[1]), temp(), temp(), r(insn.operands[1]));
         println("\t{}.s64 = {}.s32 >> {}.u32;", r(insn.operands[0]), r(insn.operands[1]), temp());
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1681,15 +2110,17 @@ bool Recompiler::Recompile(
     case PPC_INST_SRAWI:
         if (insn.operands[2] != 0)
         {
-            println("\t{}.ca = ({}.s32 < 0) & (({}.u32 & 0x{:X}) != 0);", xer(), r(insn.operands[1]), r(insn.operands[1]), ComputeMask(64 - insn.operands[2], 63));
+            if (carryLive)
+                println("\t{}.ca = ({}.s32 < 0) & (({}.u32 & 0x{:X}) != 0);", xer(), r(insn.operands[1]), r(insn.operands[1]), ComputeMask(64 - insn.operands[2], 63));
             println("\t{}.s64 = {}.s32 >> {};", r(insn.operands[0]), r(insn.operands[1]), insn.operands[2]);
         }
         else
         {
-            println("\t{}.ca = 0;", xer());
+            if (carryLive)
+                println("\t{}.ca = 0;", xer());
             println("\t{}.s64 = {}.s32;", r(insn.operands[0]), r(insn.operands[1]));
         }
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1702,7 +2133,7 @@ bool Recompiler::Recompile(
 
     case PPC_INST_SRW:
         println("\t{}.u64 = {}.u8 & 0x20 ? 0 : ({}.u32 >> ({}.u8 & 0x3F));", r(insn.operands[0]), r(insn.operands[2]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1765,7 +2196,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_STFD:
-        printSetFlushMode(false);
         print("{}", mmioStore() ? "\tPPC_MM_STORE_U64(" : "\tPPC_STORE_U64(");
         if (insn.operands[2] != 0)
             print("{}.u32 + ", r(insn.operands[2]));
@@ -1774,7 +2204,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_STFDX:
-        printSetFlushMode(false);
         print("{}", mmioStore() ? "\tPPC_MM_STORE_U64(" : "\tPPC_STORE_U64(");
         if (insn.operands[1] != 0)
             print("{}.u32 + ", r(insn.operands[1]));
@@ -1783,7 +2212,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_STFIWX:
-        printSetFlushMode(false);
         print("{}", mmioStore() ? "\tPPC_MM_STORE_U32(" : "\tPPC_STORE_U32(");
         if (insn.operands[1] != 0)
             print("{}.u32 + ", r(insn.operands[1]));
@@ -1792,7 +2220,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_STFS:
-        printSetFlushMode(false);
         println("\t{}.f32 = float({}.f64);", temp(), f(insn.operands[0]));
         print("{}", mmioStore() ? "\tPPC_MM_STORE_U32(" : "\tPPC_STORE_U32(");
         if (insn.operands[2] != 0)
@@ -1802,7 +2229,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_STFSX:
-        printSetFlushMode(false);
         println("\t{}.f32 = float({}.f64);", temp(), f(insn.operands[0]));
         print("{}", mmioStore() ? "\tPPC_MM_STORE_U32(" : "\tPPC_STORE_U32(");
         if (insn.operands[1] != 0)
@@ -1946,15 +2372,16 @@ bool Recompiler::Recompile(
 
     case PPC_INST_SUBF:
         println("\t{}.s64 = {}.s64 - {}.s64;", r(insn.operands[0]), r(insn.operands[2]), r(insn.operands[1]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
 
     case PPC_INST_SUBFC:
-        println("\t{}.ca = {}.u32 >= {}.u32;", xer(), r(insn.operands[2]), r(insn.operands[1]));
+        if (carryLive)
+            println("\t{}.ca = {}.u32 >= {}.u32;", xer(), r(insn.operands[2]), r(insn.operands[1]));
         println("\t{}.s64 = {}.s64 - {}.s64;", r(insn.operands[0]), r(insn.operands[2]), r(insn.operands[1]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -1963,13 +2390,14 @@ bool Recompiler::Recompile(
         println("\t{}.u8 = (~{}.u32 + {}.u32 < ~{}.u32) | (~{}.u32 + {}.u32 + {}.ca < {}.ca);", temp(), r(insn.operands[1]), r(insn.operands[2]), r(insn.operands[1]), r(insn.operands[1]), r(insn.operands[2]), xer(), xer());
         println("\t{}.u64 = ~{}.u64 + {}.u64 + {}.ca;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]), xer());
         println("\t{}.ca = {}.u8;", xer(), temp());
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
 
     case PPC_INST_SUBFIC:
-        println("\t{}.ca = {}.u32 <= {};", xer(), r(insn.operands[1]), insn.operands[2]);
+        if (carryLive)
+            println("\t{}.ca = {}.u32 <= {};", xer(), r(insn.operands[1]), insn.operands[2]);
         println("\t{}.s64 = {} - {}.s64;", r(insn.operands[0]), int32_t(insn.operands[2]), r(insn.operands[1]));
         break;
 
@@ -1979,7 +2407,7 @@ bool Recompiler::Recompile(
         println("\t{}.ca = ({}.u64 < ~{}.u64) || ({}.u64 == ~{}.u64 && {}.ca);", xer(),
             temp(), r(insn.operands[1]), temp(), r(insn.operands[1]), xer());
         println("\t{}.u64 = {}.u64;", r(insn.operands[0]), temp());
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});",
                 cr(0), r(insn.operands[0]), xer());
         break;
@@ -1989,7 +2417,7 @@ bool Recompiler::Recompile(
         println("\t{}.u64 = ~{}.u64 + {}.ca;", temp(), r(insn.operands[1]), xer());
         println("\t{}.ca = {}.u64 < {}.ca;", xer(), temp(), xer());
         println("\t{}.u64 = {}.u64;", r(insn.operands[0]), temp());
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -2253,7 +2681,6 @@ bool Recompiler::Recompile(
 
     case PPC_INST_VADDFP:
     case PPC_INST_VADDFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_add_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
         break;
 
@@ -2335,7 +2762,6 @@ bool Recompiler::Recompile(
 
     case PPC_INST_VCTSXS:
     case PPC_INST_VCFPSXWS128:
-        printSetFlushMode(true);
         print("\t_mm_store_si128((__m128i*){}.s32, _mm_vctsxs(", v(insn.operands[0]));
         if (insn.operands[2] != 0)
             println("_mm_mul_ps(_mm_load_ps({}.f32), _mm_set1_ps({}))));", v(insn.operands[1]), 1u << insn.operands[2]);
@@ -2346,7 +2772,6 @@ bool Recompiler::Recompile(
 
     case PPC_INST_VCTUXS:
     case PPC_INST_VCFPUXWS128:
-        printSetFlushMode(true);
         print("\t_mm_store_si128((__m128i*){}.u32, _mm_vctuxs(", v(insn.operands[0]));
         if (insn.operands[2] != 0)
             println("_mm_mul_ps(_mm_load_ps({}.f32), _mm_set1_ps({}))));", v(insn.operands[1]), 1u << insn.operands[2]);
@@ -2358,7 +2783,6 @@ bool Recompiler::Recompile(
     case PPC_INST_VCFSX:
     case PPC_INST_VCSXWFP128:
     {
-        printSetFlushMode(true);
         print("\t_mm_store_ps({}.f32, ", v(insn.operands[0]));
         if (insn.operands[2] != 0)
         {
@@ -2376,7 +2800,6 @@ bool Recompiler::Recompile(
     case PPC_INST_VCFUX:
     case PPC_INST_VCUXWFP128:
     {
-        printSetFlushMode(true);
         print("\t_mm_store_ps({}.f32, ", v(insn.operands[0]));
         if (insn.operands[2] != 0)
         {
@@ -2393,26 +2816,24 @@ bool Recompiler::Recompile(
 
     case PPC_INST_VCMPBFP:
     case PPC_INST_VCMPBFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_vcmpbfp(_mm_load_ps({}.f32), _mm_load_ps({}.f32)));",
             v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.setFromMask(_mm_load_ps({}.f32), 0xF);", cr(6), v(insn.operands[0]));
         break;
 
 
     case PPC_INST_VCMPEQFP:
     case PPC_INST_VCMPEQFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_cmpeq_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.setFromMask(_mm_load_ps({}.f32), 0xF);", cr(6), v(insn.operands[0]));
         break;
 
 
     case PPC_INST_VCMPEQUB:
         println("\t_mm_store_si128((__m128i*){}.u8, _mm_cmpeq_epi8(_mm_load_si128((__m128i*){}.u8), _mm_load_si128((__m128i*){}.u8)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.setFromMask(_mm_load_si128((__m128i*){}.u8), 0xFFFF);", cr(6), v(insn.operands[0]));
         break;
 
@@ -2420,25 +2841,23 @@ bool Recompiler::Recompile(
     case PPC_INST_VCMPEQUW:
     case PPC_INST_VCMPEQUW128:
         println("\t_mm_store_si128((__m128i*){}.u8, _mm_cmpeq_epi32(_mm_load_si128((__m128i*){}.u32), _mm_load_si128((__m128i*){}.u32)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.setFromMask(_mm_load_ps({}.f32), 0xF);", cr(6), v(insn.operands[0]));
         break;
 
 
     case PPC_INST_VCMPGEFP:
     case PPC_INST_VCMPGEFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_cmpge_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.setFromMask(_mm_load_ps({}.f32), 0xF);", cr(6), v(insn.operands[0]));
         break;
 
 
     case PPC_INST_VCMPGTFP:
     case PPC_INST_VCMPGTFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_cmpgt_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.setFromMask(_mm_load_ps({}.f32), 0xF);", cr(6), v(insn.operands[0]));
         break;
 
@@ -2456,7 +2875,6 @@ bool Recompiler::Recompile(
     case PPC_INST_VEXPTEFP:
     case PPC_INST_VEXPTEFP128:
         // TODO: vectorize
-        printSetFlushMode(true);
         for (size_t i = 0; i < 4; i++)
             println("\t{}.f32[{}] = exp2f({}.f32[{}]);", v(insn.operands[0]), i, v(insn.operands[1]), i);
         break;
@@ -2465,7 +2883,6 @@ bool Recompiler::Recompile(
     case PPC_INST_VLOGEFP:
     case PPC_INST_VLOGEFP128:
         // TODO: vectorize
-        printSetFlushMode(true);
         for (size_t i = 0; i < 4; i++)
             println("\t{}.f32[{}] = log2f({}.f32[{}]);", v(insn.operands[0]), i, v(insn.operands[1]), i);
         break;
@@ -2474,14 +2891,12 @@ bool Recompiler::Recompile(
     case PPC_INST_VMADDCFP128:
     case PPC_INST_VMADDFP:
     case PPC_INST_VMADDFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_add_ps(_mm_mul_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32)), _mm_load_ps({}.f32)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]), v(insn.operands[3]));
         break;
 
 
     case PPC_INST_VMAXFP:
     case PPC_INST_VMAXFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_max_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
         break;
 
@@ -2505,7 +2920,6 @@ bool Recompiler::Recompile(
 
     case PPC_INST_VMINFP:
     case PPC_INST_VMINFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_min_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
         break;
 
@@ -2556,26 +2970,22 @@ bool Recompiler::Recompile(
 
     case PPC_INST_VMSUM3FP128:
         // NOTE: accounting for full vector reversal here. should dot product yzw instead of xyz
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_dp_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32), 0xEF));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
         break;
 
 
     case PPC_INST_VMSUM4FP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_dp_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32), 0xFF));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
         break;
 
 
     case PPC_INST_VMULFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_mul_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
         break;
 
 
     case PPC_INST_VNMSUBFP:
     case PPC_INST_VNMSUBFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_xor_ps(_mm_sub_ps(_mm_mul_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32)), _mm_load_ps({}.f32)), _mm_castsi128_ps(_mm_set1_epi32(int(0x80000000)))));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]), v(insn.operands[3]));
         break;
 
@@ -2619,7 +3029,6 @@ bool Recompiler::Recompile(
     case PPC_INST_VPKD3D128:
         // TODO: vectorize somehow?
         // NOTE: handling vector reversal here too
-        printSetFlushMode(true);
         switch (insn.operands[2])
         {
         case 0: // D3D color
@@ -2749,28 +3158,24 @@ bool Recompiler::Recompile(
     case PPC_INST_VREFP:
     case PPC_INST_VREFP128:
         // TODO: see if we can use rcp safely
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_div_ps(_mm_set1_ps(1), _mm_load_ps({}.f32)));", v(insn.operands[0]), v(insn.operands[1]));
         break;
 
 
     case PPC_INST_VRFIM:
     case PPC_INST_VRFIM128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_round_ps(_mm_load_ps({}.f32), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC));", v(insn.operands[0]), v(insn.operands[1]));
         break;
 
 
     case PPC_INST_VRFIN:
     case PPC_INST_VRFIN128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_round_ps(_mm_load_ps({}.f32), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));", v(insn.operands[0]), v(insn.operands[1]));
         break;
 
 
     case PPC_INST_VRFIZ:
     case PPC_INST_VRFIZ128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_round_ps(_mm_load_ps({}.f32), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));", v(insn.operands[0]), v(insn.operands[1]));
         break;
 
@@ -2787,7 +3192,6 @@ bool Recompiler::Recompile(
     case PPC_INST_VRSQRTEFP128:
         // TODO: see if we can use rsqrt safely
         // TODO: we can detect if the input is from a dot product and apply logic only on one value
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_div_ps(_mm_set1_ps(1), _mm_sqrt_ps(_mm_load_ps({}.f32))));", v(insn.operands[0]), v(insn.operands[1]));
         break;
 
@@ -2926,7 +3330,6 @@ bool Recompiler::Recompile(
 
     case PPC_INST_VSUBFP:
     case PPC_INST_VSUBFP128:
-        printSetFlushMode(true);
         println("\t_mm_store_ps({}.f32, _mm_sub_ps(_mm_load_ps({}.f32), _mm_load_ps({}.f32)));", v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
         break;
 
@@ -3029,7 +3432,7 @@ bool Recompiler::Recompile(
 
     case PPC_INST_XOR:
         println("\t{}.u64 = {}.u64 ^ {}.u64;", r(insn.operands[0]), r(insn.operands[1]), r(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.compare<int32_t>({}.s32, 0, {});", cr(0), r(insn.operands[0]), xer());
         break;
 
@@ -3072,7 +3475,6 @@ bool Recompiler::Recompile(
    
 
     case PPC_INST_FNMADD:
-        printSetFlushMode(false);
         println("\t{}.f64 = -std::fma({}.f64, {}.f64, {}.f64);", f(insn.operands[0]), f(insn.operands[1]), f(insn.operands[2]), f(insn.operands[3]));
         if (strchr(insn.opcode->name, '.'))
             println("\tctx.fpscr.setFlags({}.f64);", f(insn.operands[0]));
@@ -3094,7 +3496,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_LFDU:
-        printSetFlushMode(false);
         println("\t{} = {} + {}.u32;", ea(), int32_t(insn.operands[1]), r(insn.operands[2]));
         println("\t{}.u64 = PPC_LOAD_U64({});", r(insn.operands[0]), ea());
         println("\t{}.u32 = {};", r(insn.operands[2]), ea());
@@ -3102,7 +3503,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_LFDUX:
-        printSetFlushMode(false);
         println("\t{} = {}.u32 + {}.u32;", ea(), r(insn.operands[1]), r(insn.operands[2]));
         println("\t{}.u64 = PPC_LOAD_U64({});", r(insn.operands[0]), ea());
         println("\t{}.u32 = {};", r(insn.operands[1]), ea());
@@ -3110,7 +3510,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_LFSU:
-        printSetFlushMode(false);
         println("\t{} = {} + {}.u32;", ea(), int32_t(insn.operands[1]), r(insn.operands[2]));
         println("\t{}.u32 = PPC_LOAD_U32({});", temp(), ea());
         println("\t{}.u32 = {};", r(insn.operands[2]), ea());
@@ -3119,7 +3518,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_LFSUX:
-        printSetFlushMode(false);
         println("\t{} = {}.u32 + {}.u32;", ea(), r(insn.operands[1]), r(insn.operands[2]));
         println("\t{}.u32 = PPC_LOAD_U32({});", temp(), ea());
         println("\t{}.u32 = {};", r(insn.operands[1]), ea());
@@ -3185,7 +3583,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_STFDU:
-        printSetFlushMode(false);
         println("\t{} = {} + {}.u32;", ea(), int32_t(insn.operands[1]), r(insn.operands[2]));
         println("\t{}{}, {}.u64);", mmioStore() ? "PPC_MM_STORE_U64(" : "PPC_STORE_U64(", ea(), r(insn.operands[0]));
         println("\t{}.u32 = {};", r(insn.operands[2]), ea());
@@ -3193,7 +3590,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_STFSU:
-        printSetFlushMode(false);
         println("\t{}.f32 = float({}.f64);", temp(), f(insn.operands[0]));
         println("\t{} = {} + {}.u32;", ea(), int32_t(insn.operands[1]), r(insn.operands[2]));
         println("\t{}{}, {}.u32);", mmioStore() ? "PPC_MM_STORE_U32(" : "PPC_STORE_U32(", ea(), temp());
@@ -3210,7 +3606,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_STFSUX:
-        printSetFlushMode(false);
         println("\t{}.f32 = float({}.f64);", temp(), f(insn.operands[0]));
         println("\t{} = {}.u32 + {}.u32;", ea(), r(insn.operands[1]), r(insn.operands[2]));
         println("\t{}{}, {}.u32);", mmioStore() ? "PPC_MM_STORE_U32(" : "PPC_STORE_U32(", ea(), temp());
@@ -3283,7 +3678,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_MTCRF:
-        printSetFlushMode(true);
         println("\tuint32_t mask = {};", insn.operands[0]);
         println("\tuint32_t value = {}.u32;", r(insn.operands[1]));
         println("\tfor (int i = 0; i < 8; ++i) {");
@@ -3297,7 +3691,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_BGTLA:
-        printSetFlushMode(true);
         // CR[BI]'s GT bit is at bit 1 in the 4-bit field: mask is 0b0100 = 0x4
         println("\tif ((state.cr & (0x4 << (4 * (7 - {})))) != 0) {{", insn.operands[0]);
         println("\t\tctx.lr = 0x{:X};  // Link to next instruction", base + 4);
@@ -3321,7 +3714,7 @@ bool Recompiler::Recompile(
     case PPC_INST_VCMPEQUH:
         println("\tsimd::store_u16({}.u16, simd::cmpeq_i16(simd::load_u16({}.u16), simd::load_u16({}.u16)));",
             v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.setFromMask(simd::load_u16({}.u16), 0xFFFF);", cr(6), v(insn.operands[0]));
         break;
 
@@ -3329,7 +3722,7 @@ bool Recompiler::Recompile(
     case PPC_INST_VCMPGTSH:
         println("\tsimd::store_i16({}.s16, simd::cmpgt_i16(simd::load_i16({}.s16), simd::load_i16({}.s16)));",
             v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.setFromMask(simd::load_i16({}.s16), 0xFFFF);", cr(6), v(insn.operands[0]));
         break;
 
@@ -3337,20 +3730,18 @@ bool Recompiler::Recompile(
     case PPC_INST_VCMPGTSW:
         println("\tsimd::store_i32({}.s32, simd::cmpgt_i32(simd::load_i32({}.s32), simd::load_i32({}.s32)));",
             v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
-        if (strchr(insn.opcode->name, '.'))
+        if (recordForm)
             println("\t{}.setFromMask(simd::load_i32({}.s32), 0xFFFF);", cr(6), v(insn.operands[0]));
         break;
 
 
     case PPC_INST_VMINSW:
-        printSetFlushMode(true);
         println("\t{}.v128 = simd::min_i32({}.v128, {}.v128);",
             v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
         break;
 
 
     case PPC_INST_VAVGSW:
-        printSetFlushMode(true);
         println("\tsimd::vec128i sum = simd::add_i32({}.v128, {}.v128);", v(insn.operands[1]), v(insn.operands[2]));
         println("\tsum = simd::add_i32(sum, simd::set1_i32(1));");
         println("\t{}.v128 = simd::srai_i32(sum, 1);", v(insn.operands[0]));
@@ -3358,7 +3749,6 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_VSLO:
-        printSetFlushMode(true);
         println("\tsimd::vec128i shift_amt = simd::srli_i16({}.v128, 3);", v(insn.operands[2]));
         println("\tint shift = simd::extract_u8(shift_amt, 15) & 0x1F;");
         println("\tif (shift >= 16) {{");
@@ -3370,13 +3760,11 @@ bool Recompiler::Recompile(
 
 
     case PPC_INST_VSUBSBS:
-        printSetFlushMode(true);
         println("\t{}.v128 = simd::sub_saturate_i8({}.v128, {}.v128);",
             v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
         break;
 
     case PPC_INST_VSRAB: {
-        printSetFlushMode(true);
         println("simd::store_shuffled({}, simd::shift_right_arithmetic_i8(simd::to_vec128i({}), simd::and_u8(simd::to_vec128i({}), simd::set1_i8(0x7))));",
             v(insn.operands[0]), v(insn.operands[1]), v(insn.operands[2]));
         break;
@@ -3416,54 +3804,48 @@ bool Recompiler::Recompile(
         return false;
     }
 
+    // The call could change the flush mode, unless the callee is known to leave it alone.
+    if (instruction.HasFlag(RecompilerIRInstruction::c_call))
+        csrState = csrAnalysis != nullptr ? csrAnalysis->GetStateAfterCall(instruction, csrState, image, config) : CSRState::Unknown;
+
 #if 1
-                         if (strchr(insn.opcode->name, '.'))
-                         {
-                             int lastLine = out.find_last_of('\n', out.size() - 2);
-                             if (out.find("cr0", lastLine + 1) == std::string::npos && out.find("cr6", lastLine + 1) == std::string::npos)
-                                 fmt::println("{} at {:X} has RC bit enabled but no comparison was generated", insn.opcode->name, base);
-                         }
+                         if (instruction.HasFlag(RecompilerIRInstruction::c_recordForm) && (instruction.defs.cr & liveCrFields & ~printedCrFields) != 0)
+                             fmt::println("{} at {:X} has RC bit enabled but no comparison was generated", insn.opcode->name, base);
 #endif
 
-                         if (midAsmHook != config.midAsmHooks.end() && midAsmHook->second.afterInstruction)
+                         if (midAsmHook != nullptr && midAsmHook->afterInstruction)
                              printMidAsmHook();
 
                          return true;
 }
 
-bool Recompiler::Recompile(const Function& fn)
+bool RecompilerEmitter::Recompile(const Function& fn)
 {
-    auto base = fn.base;
-    auto end = base + fn.size;
-    auto* data = (uint32_t*)image.Find(base);
+    ir.Build(fn, image, instructions, config);
+    return RecompileIR(fn);
+}
 
-    static std::unordered_set<size_t> labels;
-    labels.clear();
+bool RecompilerEmitter::RecompileIR(const Function& fn)
+{
+    const size_t outBegin = out.size();
 
-    for (size_t addr = base; addr < end; addr += 4)
-    {
-        const uint32_t instruction = ByteSwap(*(uint32_t*)((char*)data + addr - base));
-        if (!PPC_BL(instruction))
-        {
-            const size_t op = PPC_OP(instruction);
-            if (op == PPC_OP_B)
-                labels.emplace(addr + PPC_BI(instruction));
-            else if (op == PPC_OP_BC)
-                labels.emplace(addr + PPC_BD(instruction));
-        }
+    promotion.Analyse(ir, config.promoteRegisters && !promotionDisabled ? GetPromotionCandidates() : RecompilerRegisterSet());
 
-        auto switchTable = config.switchTables.find(addr);
-        if (switchTable != config.switchTables.end())
-        {
-            for (auto label : switchTable->second.labels)
-                labels.emplace(label);
-        }
+    if (config.eliminateDeadFlags)
+        flagLiveness.Analyse(ir);
 
-        auto midAsmHook = config.midAsmHooks.find(addr);
-        if (midAsmHook != config.midAsmHooks.end())
+    if (config.devirtualizeCalls)
+        constants.Analyse(ir, image);
+
+    const size_t csrFunction = csrAnalysis != nullptr ? csrAnalysis->FindFunction(fn.base) : -1;
+
+    for (const auto& instruction : ir.instructions)
+    {
+        const auto* midAsmHook = instruction.midAsmHook;
+        if (midAsmHook != nullptr)
         {
-            if (midAsmHook->second.returnOnFalse || midAsmHook->second.returnOnTrue ||
-                midAsmHook->second.jumpAddressOnFalse != NULL || midAsmHook->second.jumpAddressOnTrue != NULL)
+            if (midAsmHook->returnOnFalse || midAsmHook->returnOnTrue ||
+                midAsmHook->jumpAddressOnFalse != NULL || midAsmHook->jumpAddressOnTrue != NULL)
             {
                 print("extern bool ");
             }
@@ -3472,8 +3854,8 @@ bool Recompiler::Recompile(const Function& fn)
                 print("extern void ");
             }
 
-            print("{}(", midAsmHook->second.name);
-            for (auto& reg : midAsmHook->second.registers)
+            print("{}(", midAsmHook->name);
+            for (auto& reg : midAsmHook->registers)
             {
                 if (out.back() != '(')
                     out += ", ";
@@ -3509,19 +3891,12 @@ bool Recompiler::Recompile(const Function& fn)
             }
 
             println(");\n");
-
-            if (midAsmHook->second.jumpAddress != NULL)
-                labels.emplace(midAsmHook->second.jumpAddress);
-            if (midAsmHook->second.jumpAddressOnTrue != NULL)
-                labels.emplace(midAsmHook->second.jumpAddressOnTrue);
-            if (midAsmHook->second.jumpAddressOnFalse != NULL)
-                labels.emplace(midAsmHook->second.jumpAddressOnFalse);
         }
     }
 
     auto symbol = image.symbols.find(fn.base);
     std::string name;
-    if (symbol != image.symbols.end())
+    if (symbol != nullptr)
     {
         name = symbol->name;
     }
@@ -3537,31 +3912,36 @@ bool Recompiler::Recompile(const Function& fn)
     println("PPC_FUNC_IMPL(__imp__{}) {{", name);
     println("\tPPC_FUNC_PROLOGUE();");
 
-    auto switchTable = config.switchTables.end();
     bool allRecompiled = true;
     CSRState csrState = CSRState::Unknown;
 
     // TODO: the printing scheme here is scuffed
     RecompilerLocalVariables localVariables;
-    static std::string tempString;
     tempString.clear();
     std::swap(out, tempString);
 
-    ppc_insn insn;
-    while (base < end)
+    PrintRegisterCopies(promotion.entryLoads, false, localVariables);
+
+    // Set when an instruction refers to a promoted register that its IR doesn't list.
+    bool promotionMismatch = false;
+
+    for (size_t i = 0; i < ir.instructions.size(); i++)
     {
-        if (labels.find(base) != labels.end())
+        const auto& instruction = ir.instructions[i];
+        const auto base = instruction.address;
+        const auto* data = instruction.data;
+        const auto& insn = instruction.insn;
+
+        if (instruction.label)
         {
             println("loc_{:X}:", base);
 
-            // Anyone could jump to this label so we wouldn't know what the CSR state would be.
-            csrState = CSRState::Unknown;
+            // Anyone could jump to this label so we wouldn't know what the CSR state would be,
+            // unless the analysis found that all of them agree.
+            csrState = csrFunction != -1 ? csrAnalysis->GetBlockState(csrFunction, ir.blockIndices[i]) : CSRState::Unknown;
         }
 
-        if (switchTable == config.switchTables.end())
-            switchTable = config.switchTables.find(base);
-
-        ppc::Disassemble(data, 4, base, insn);
+        PrintRegisterCopies(promotion.stores[i], true, localVariables);
 
         if (insn.opcode == nullptr)
         {
@@ -3573,30 +3953,61 @@ bool Recompiler::Recompile(const Function& fn)
         }
         else
         {
-            if (insn.opcode->id == PPC_INST_BCTR && (*(data - 1) == 0x07008038 || *(data - 1) == 0x00000060) && switchTable == config.switchTables.end())
+            if (insn.opcode->id == PPC_INST_BCTR && (*(data - 1) == 0x07008038 || *(data - 1) == 0x00000060) && instruction.switchTable == nullptr)
                 fmt::println("Found a switch jump table at {:X} with no switch table entry present", base);
 
-            if (!Recompile(fn, base, insn, data, switchTable, localVariables, csrState))
+            promotedAccesses = {};
+
+            if (!Recompile(fn, instruction, localVariables, csrState))
             {
                 fmt::println("Unrecognized instruction at 0x{:X}: {}", base, insn.opcode->name);
                 allRecompiled = false;
             }
+
+            RecompilerRegisterSet unlisted = promotedAccesses;
+            unlisted -= instruction.operandUses;
+            if (!instruction.HasFlag(RecompilerIRInstruction::c_call))
+                unlisted -= instruction.defs;
+
+            if (!unlisted.Empty())
+                promotionMismatch = true;
         }
 
-        base += 4;
-        ++data;
+        PrintRegisterCopies(promotion.loads[i], false, localVariables);
+    }
+
+    if (promotionMismatch)
+    {
+        fmt::println("Register promotion disabled for function at {:X}, its IR is missing some register accesses", fn.base);
+
+        std::swap(out, tempString);
+        out.resize(outBegin);
+
+        promotionDisabled = true;
+        const bool result = Recompile(fn);
+        promotionDisabled = false;
+
+        return result;
     }
 
+    PrintRegisterCopies(promotion.endStores, true, localVariables);
+
+    devirtualizedCallCount += CountDevirtualizedCalls();
+
 #if 0
+    const auto& insn = ir.instructions.back().insn;
     if (insn.opcode == nullptr || (insn.opcode->id != PPC_INST_B && insn.opcode->id != PPC_INST_BCTR && insn.opcode->id != PPC_INST_BLR))
-        fmt::println("Function at {:X} ends prematurely with instruction {} at {:X}", fn.base, insn.opcode != nullptr ? insn.opcode->name : "INVALID", base - 4);
+        fmt::println("Function at {:X} ends prematurely with instruction {} at {:X}", fn.base, insn.opcode != nullptr ? insn.opcode->name : "INVALID", ir.instructions.back().address);
 #endif
 
     println("}}\n");
 
 #ifndef XENON_RECOMP_USE_ALIAS
     println("PPC_WEAK_FUNC({}) {{", name);
-    println("\t__imp__{}(ctx, base);", name);
+    if (config.guaranteedTailCalls)
+        println("\tPPC_TAIL_CALL_FUNC(__imp__{});", name);
+    else
+        println("\t__imp__{}(ctx, base);", name);
     println("}}\n");
 #endif
 
@@ -3649,10 +4060,401 @@ bool Recompiler::Recompile(const Function& fn)
     return allRecompiled;
 }
 
+RecompilerRegisterSet RecompilerEmitter::GetPromotionCandidates() const
+{
+    RecompilerRegisterSet candidates;
+
+    for (const auto& instruction : ir.instructions)
+    {
+        // setjmp copies the whole context, and longjmp leaves without storing anything.
+        if (instruction.HasFlag(RecompilerIRInstruction::c_call | RecompilerIRInstruction::c_exit) && instruction.target != 0 &&
+            (instruction.target == config.setJmpAddress || instruction.target == config.longJmpAddress))
+        {
+            return candidates;
+        }
+    }
+
+    candidates = RecompilerRegisterSet::All();
+    candidates.special = RecompilerRegisterSet::c_ctr | RecompilerRegisterSet::c_xer;
+
+    // Leave the registers that are locals already to the config.
+    if (config.nonArgumentRegistersAsLocalVariables)
+    {
+        candidates.r &= ~((1u << 0) | (1u << 2) | (1u << 11) | (1u << 12));
+        candidates.f &= ~1u;
+        candidates.v[0] &= 0xFFFFFFFFull;
+    }
+
+    if (config.nonVolatileRegistersAsLocalVariables)
+    {
+        candidates.r &= (1u << 14) - 1;
+        candidates.f &= (1u << 14) - 1;
+        candidates.v[0] &= ~0xFFFFC000ull;
+        candidates.v[1] = 0;
+    }
+
+    if (config.crRegistersAsLocalVariables)
+        candidates.cr = 0;
+    if (config.ctrAsLocalVariable)
+        candidates.special &= ~RecompilerRegisterSet::c_ctr;
+    if (config.xerAsLocalVariable)
+        candidates.special &= ~RecompilerRegisterSet::c_xer;
+
+    return candidates;
+}
+
+const Symbol* RecompilerEmitter::FindDevirtualizedTarget(const RecompilerIRInstruction& instruction) const
+{
+    if (!config.devirtualizeCalls || instruction.switchTable != nullptr)
+        return nullptr;
+
+    const uint32_t target = constants.ctrValues[&instruction - ir.instructions.data()];
+    auto targetSymbol = target != 0 ? image.symbols.find(target) : nullptr;
+    if (targetSymbol == nullptr || targetSymbol->address != target || targetSymbol->type != Symbol_Function)
+        return nullptr;
+
+    return targetSymbol;
+}
+
+size_t RecompilerEmitter::CountDevirtualizedCalls() const
+{
+    size_t count = 0;
+    for (const auto& instruction : ir.instructions)
+    {
+        if (FindDevirtualizedTarget(instruction) != nullptr)
+            count++;
+    }
+
+    return count;
+}
+
+void RecompilerEmitter::PrintRegisterCopies(const RecompilerRegisterSet& registers, bool store, RecompilerLocalVariables& localVariables)
+{
+    if (registers.Empty())
+        return;
+
+    auto printCopy = [&](std::string_view context, std::string_view local)
+        {
+            if (store)
+                println("\t{} = {};", context, local);
+            else
+                println("\t{} = {};", local, context);
+        };
+
+    if (registers.special & RecompilerRegisterSet::c_ctr)
+    {
+        localVariables.ctr = true;
+        printCopy("ctx.ctr", "ctr");
+    }
+
+    if (registers.special & RecompilerRegisterSet::c_xer)
+    {
+        localVariables.xer = true;
+        printCopy("ctx.xer", "xer");
+    }
+
+    for (size_t i = 0; i < 8; i++)
+    {
+        if (registers.HasCr(i))
+        {
+            localVariables.cr[i] = true;
+            printCopy(gCrNames.context[i], gCrNames.local[i]);
+        }
+    }
+
+    for (size_t i = 0; i < 32; i++)
+    {
+        if (registers.HasR(i))
+        {
+            localVariables.r[i] = true;
+            printCopy(gGprNames.context[i], gGprNames.local[i]);
+        }
+    }
+
+    for (size_t i = 0; i < 32; i++)
+    {
+        if (registers.HasF(i))
+        {
+            localVariables.f[i] = true;
+            printCopy(gFprNames.context[i], gFprNames.local[i]);
+        }
+    }
+
+    for (size_t i = 0; i < 128; i++)
+    {
+        if (registers.HasV(i))
+        {
+            localVariables.v[i] = true;
+            printCopy(gVprNames.context[i], gVprNames.local[i]);
+        }
+    }
+}
+
+XXH128_hash_t RecompilerEmitter::ComputeHash(const Function& fn)
+{
+    hashBuffer.clear();
+
+    auto append = [&](const auto& value)
+        {
+            hashBuffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+
+    auto appendString = [&](const std::string_view& value)
+        {
+            append(value.size());
+            hashBuffer += value;
+        };
+
+    auto appendSymbol = [&](size_t address)
+        {
+            auto symbol = image.symbols.find(address);
+            if (symbol != nullptr && symbol->address == address)
+            {
+                append(symbol->type);
+                appendString(symbol->name);
+            }
+            else
+            {
+                append(Symbol_None);
+            }
+        };
+
+    // The code generator itself is an input too.
+    append(c_generatorVersion);
+#ifdef XENON_RECOMP_USE_ALIAS
+    append(true);
+#else
+    append(false);
+#endif
+    append(config.skipLr);
+    append(config.ctrAsLocalVariable);
+    append(config.xerAsLocalVariable);
+    append(config.reservedRegisterAsLocalVariable);
+    append(config.skipMsr);
+    append(config.crRegistersAsLocalVariables);
+    append(config.nonArgumentRegistersAsLocalVariables);
+    append(config.nonVolatileRegistersAsLocalVariables);
+    append(config.promoteRegisters);
+    append(config.eliminateDeadFlags);
+    append(config.propagateCsrState);
+    append(config.devirtualizeCalls);
+    append(config.guaranteedTailCalls);
+    append(config.longJmpAddress);
+    append(config.setJmpAddress);
+
+    append(fn.base);
+    append(fn.size);
+    appendSymbol(fn.base);
+
+    // The instruction after the function is included as well, MMIO stores peek at it.
+    const auto section = std::prev(image.sections.upper_bound(fn.base));
+    const size_t size = std::min<size_t>(fn.size + 4, section->base + section->size - fn.base);
+    hashBuffer.append(reinterpret_cast<const char*>(image.Find(fn.base)), size);
+
+    // Devirtualized calls depend on read-only data outside the function, and on the symbol found there.
+    if (config.devirtualizeCalls)
+    {
+        ir.Build(fn, image, instructions, config);
+        constants.Analyse(ir, image);
+
+        for (auto target : constants.ctrValues)
+        {
+            if (target != 0)
+            {
+                append(target);
+                appendSymbol(target);
+            }
+        }
+    }
+
+    auto* data = reinterpret_cast<const uint32_t*>(image.Find(fn.base));
+    for (size_t addr = fn.base; addr < fn.base + fn.size; addr += 4)
+    {
+        const uint32_t instruction = ByteSwap(*data++);
+        const size_t op = PPC_OP(instruction);
+
+        // Branches leaving the function are printed as calls to the target symbol.
+        if (op == PPC_OP_B || op == PPC_OP_BC)
+        {
+            size_t target = addr + (op == PPC_OP_B ? PPC_BI(instruction) : PPC_BD(instruction));
+            if (target < fn.base || target >= fn.base + fn.size)
+                appendSymbol(target);
+
+            // So is the flush mode the callee returns with.
+            if (csrAnalysis != nullptr)
+                append(csrAnalysis->FindSummary(target));
+        }
+
+        auto invalidInstr = config.invalidInstructions.find(instruction);
+        if (invalidInstr != config.invalidInstructions.end())
+        {
+            append(addr);
+            append(invalidInstr->second);
+        }
+
+        auto switchTable = config.switchTables.find(addr);
+        if (switchTable != config.switchTables.end())
+        {
+            append(addr);
+            append(switchTable->second.r);
+            append(switchTable->second.labels.size());
+            for (auto label : switchTable->second.labels)
+                append(label);
+        }
+
+        auto midAsmHook = config.midAsmHooks.find(addr);
+        if (midAsmHook != config.midAsmHooks.end())
+        {
+            append(addr);
+            appendString(midAsmHook->second.name);
+            append(midAsmHook->second.registers.size());
+            for (auto& reg : midAsmHook->second.registers)
+                appendString(reg);
+
+            append(midAsmHook->second.ret);
+            append(midAsmHook->second.returnOnTrue);
+            append(midAsmHook->second.returnOnFalse);
+            append(midAsmHook->second.jumpAddress);
+            append(midAsmHook->second.jumpAddressOnTrue);
+            append(midAsmHook->second.jumpAddressOnFalse);
+            append(midAsmHook->second.afterInstruction);
+        }
+    }
+
+    return XXH3_128bits(hashBuffer.data(), hashBuffer.size());
+}
+
+size_t Recompiler::EstimateCost(const Function& fn) const
+{
+    // Weights are relative to a plain integer instruction. Vector instructions expand to
+    // long intrinsic sequences and labels split the function into more basic blocks.
+    constexpr size_t c_instructionCost = 1;
+    constexpr size_t c_floatCost = 2;
+    constexpr size_t c_vectorCost = 4;
+    constexpr size_t c_labelCost = 2;
+
+    size_t cost = 0;
+    auto* data = reinterpret_cast<const uint32_t*>(image.Find(fn.base));
+
+    for (size_t addr = fn.base; addr < fn.base + fn.size; addr += 4)
+    {
+        const uint32_t instruction = ByteSwap(*data++);
+        switch (PPC_OP(instruction))
+        {
+        case 4: // VMX
+        case 5: // VMX128
+        case 6:
+            cost += c_vectorCost;
+            break;
+
+        case 59: // FPU
+        case 63:
+            cost += c_floatCost;
+            break;
+
+        case PPC_OP_B:
+        case PPC_OP_BC:
+            cost += PPC_BL(instruction) ? c_instructionCost : c_labelCost;
+            break;
+
+        default:
+            cost += c_instructionCost;
+            break;
+        }
+
+        auto switchTable = config.switchTables.find(addr);
+        if (switchTable != config.switchTables.end())
+            cost += switchTable->second.labels.size() * c_labelCost;
+    }
+
+    return cost;
+}
+
+std::vector<RecompilerShard> Recompiler::CreateShards() const
+{
+    std::vector<RecompilerShard> shards;
+
+    if (config.shardMode == RecompilerShardMode::Address)
+    {
+        // Boundaries only depend on the address of the function starting the file,
+        // so the same functions end up in the same files across analysis changes.
+        auto isBoundary = [](uint32_t address)
+            {
+                return (XXH3_64bits(&address, sizeof(address)) % c_functionsPerFile) == 0;
+            };
+
+        size_t begin = 0;
+        for (size_t i = 1; i <= functions.size(); i++)
+        {
+            size_t count = i - begin;
+            if (i == functions.size() || count >= c_maxFunctionsPerFile || (count >= c_minFunctionsPerFile && isBoundary(functions[i].base)))
+            {
+                shards.push_back({ begin, i, fmt::format("ppc_recomp.{:X}.cpp", functions[begin].base) });
+                begin = i;
+            }
+        }
+    }
+    else if (config.shardMode == RecompilerShardMode::Cost && !functions.empty())
+    {
+        size_t shardCount = config.shardCount;
+        if (shardCount == 0)
+            shardCount = (functions.size() + c_functionsPerFile - 1) / c_functionsPerFile;
+
+        shardCount = std::min(shardCount, functions.size());
+
+        std::vector<size_t> costs(functions.size());
+        size_t totalCost = 0;
+
+        for (size_t i = 0; i < functions.size(); i++)
+        {
+            costs[i] = EstimateCost(functions[i]);
+            totalCost += costs[i];
+        }
+
+        // Close the current file once the running cost passes its share of the total,
+        // leaving at least one function for each of the remaining files.
+        size_t begin = 0;
+        size_t cost = 0;
+
+        for (size_t i = 0; i < functions.size(); i++)
+        {
+            cost += costs[i];
+
+            size_t remainingShards = shardCount - shards.size() - 1;
+            bool isLast = (i + 1) == functions.size();
+
+            if (isLast || (remainingShards != 0 &&
+                (cost * shardCount >= totalCost * (shards.size() + 1) || (functions.size() - i - 1) == remainingShards)))
+            {
+                shards.push_back({ begin, i + 1, fmt::format("ppc_recomp.{}.cpp", cppFileIndex + shards.size()) });
+                begin = i + 1;
+            }
+        }
+    }
+    else
+    {
+        for (size_t begin = 0; begin < functions.size(); begin += c_functionsPerFile)
+        {
+            size_t end = std::min(begin + c_functionsPerFile, functions.size());
+            shards.push_back({ begin, end, fmt::format("ppc_recomp.{}.cpp", cppFileIndex + shards.size()) });
+        }
+    }
+
+    return shards;
+}
+
 void Recompiler::Recompile(const std::filesystem::path& headerFilePath)
 {
+    const auto recompileBegin = ProcessStats::Capture();
+    writeSeconds = 0.0;
+    writeCpuSeconds = 0.0;
+
     out.reserve(10 * 1024 * 1024);
 
+    const std::string manifestFilePath = GetOutFilePath(RecompilerManifest::c_fileName);
+    manifest.Load(manifestFilePath);
+    newManifest.entries.clear();
+
     {
         println("#pragma once");
 
@@ -3751,57 +4553,235 @@ void Recompiler::Recompile(const std::filesystem::path& headerFilePath)
         SaveCurrentOutData("ppc_func_mapping.cpp");
     }
 
-    for (size_t i = 0; i < functions.size(); i++)
+    size_t threadCount = GetThreadCount();
+
+    // Every file is generated independently by a worker with its own emitter, so the
+    // output is identical no matter how many threads are used.
+    const auto shards = CreateShards();
+    threadCount = std::min(threadCount, shards.size());
+
+    std::string cacheFilePath;
+    RecompilerCache cache;
+
+    if (!config.cacheFilePath.empty())
     {
-        if ((i % 256) == 0)
+        cacheFilePath = config.directoryPath + config.cacheFilePath;
+        if (cache.Load(cacheFilePath))
+            fmt::println("Loaded {} cached functions", cache.entries.size());
+    }
+
+    std::atomic<size_t> nextFileIndex = 0;
+    std::atomic<size_t> finishedFunctionCount = 0;
+    std::atomic<size_t> cachedFunctionCount = 0;
+    std::atomic<size_t> devirtualizedCallCount = 0;
+
+    const double headerWriteSeconds = writeSeconds;
+
+    // Finished files are handed to a background thread so the workers can move on to the next
+    // shard while the previous one is written.
+    RecompilerWriter writer([this](const std::string_view& name, const std::string_view& data) { SaveOutData(name, data); });
+
+    // Workers finish functions in any order, so only progress past the last printed one is shown.
+    std::mutex progressMutex;
+    size_t printedFunctionCount = 0;
+
+    auto printProgress = [&]()
         {
-            SaveCurrentOutData();
-            println("#include \"ppc_recomp_shared.h\"\n");
-        }
+            const size_t count = ++finishedFunctionCount;
+            if ((count % 2048) != 1 && count != functions.size())
+                return;
 
-        if ((i % 2048) == 0 || (i == (functions.size() - 1)))
-            fmt::println("Recompiling functions... {}%", static_cast<float>(i + 1) / functions.size() * 100.0f);
+            std::lock_guard lock(progressMutex);
+            if (count > printedFunctionCount)
+            {
+                printedFunctionCount = count;
+                fmt::println("Recompiling functions... {}%", static_cast<float>(count) / functions.size() * 100.0f);
+            }
+        };
+
+    if (config.propagateCsrState)
+        csrAnalysis.Analyse(functions, image, instructions, config, threadCount);
+
+    auto recompileFiles = [&]()
+        {
+            RecompilerEmitter emitter(image, instructions, config);
+            if (config.propagateCsrState)
+                emitter.csrAnalysis = &csrAnalysis;
+
+            size_t fileIndex;
+            while ((fileIndex = nextFileIndex++) < shards.size())
+            {
+                auto& shard = shards[fileIndex];
+                emitter.println("#include \"ppc_recomp_shared.h\"\n");
 
-        Recompile(functions[i]);
+                for (size_t i = shard.begin; i < shard.end; i++)
+                {
+                    if (cacheFilePath.empty())
+                    {
+                        emitter.Recompile(functions[i]);
+                        printProgress();
+                        continue;
+                    }
+
+                    const XXH128_hash_t hash = emitter.ComputeHash(functions[i]);
+                    const std::string* cachedText = cache.Find(hash);
+                    if (cachedText != nullptr)
+                    {
+                        emitter.out += *cachedText;
+                        emitter.devirtualizedCallCount += emitter.CountDevirtualizedCalls();
+                        ++cachedFunctionCount;
+                    }
+                    else
+                    {
+                        // Functions with errors are left out so their diagnostics show up again on the next run.
+                        size_t offset = emitter.out.size();
+                        if (emitter.Recompile(functions[i]))
+                            cache.Insert(hash, std::string_view(emitter.out).substr(offset));
+                    }
+
+                    printProgress();
+                }
+
+                writer.Push(shard.name, emitter.out);
+            }
+
+            devirtualizedCallCount += emitter.devirtualizedCallCount;
+        };
+
+    if (threadCount > 1)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount);
+
+        for (size_t i = 0; i < threadCount; i++)
+            threads.emplace_back(recompileFiles);
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+    else
+    {
+        recompileFiles();
+    }
+
+    // Writes overlap code generation, so only the time spent waiting for the queue to drain
+    // counts towards the write phase.
+    const auto finishBegin = ProcessStats::Capture();
+    const double finishCpuBegin = GetThreadCpuSeconds();
+    writer.Finish();
+
+    cppFileIndex += shards.size();
+
+    if (config.devirtualizeCalls)
+        fmt::println("Devirtualized {} indirect calls", devirtualizedCallCount.load());
+
+    if (!cacheFilePath.empty())
+    {
+        fmt::println("Reused {} of {} functions from the cache", cachedFunctionCount.load(), functions.size());
+
+        if (!cache.Save(cacheFilePath))
+            fmt::println("ERROR: Unable to save the cache file: {}", cacheFilePath);
     }
 
-    SaveCurrentOutData();
+    RemoveStaleOutFiles();
+
+    if (!newManifest.Save(manifestFilePath))
+        fmt::println("ERROR: Unable to save the manifest file: {}", manifestFilePath);
+
+    manifest = std::move(newManifest);
+    newManifest.entries.clear();
+
+    const auto recompileEnd = ProcessStats::Capture();
+    auto write = RecompilerPhaseTiming::Measure("write", finishBegin, recompileEnd);
+    write.seconds += headerWriteSeconds;
+    write.cpuSeconds = GetThreadCpuSeconds() - finishCpuBegin + writeCpuSeconds;
+
+    auto codegen = RecompilerPhaseTiming::Measure("codegen", recompileBegin, recompileEnd);
+    codegen.seconds -= write.seconds;
+    codegen.cpuSeconds -= write.cpuSeconds;
+
+    timings.push_back(codegen);
+    timings.push_back(write);
+}
+
+bool Recompiler::Recompile(const Function& fn)
+{
+    RecompilerEmitter emitter(image, instructions, config);
+    std::swap(emitter.out, out);
+    bool result = emitter.Recompile(fn);
+    std::swap(emitter.out, out);
+    return result;
 }
 
 void Recompiler::SaveCurrentOutData(const std::string_view& name)
 {
     if (!out.empty())
     {
-        std::string cppName;
-
         if (name.empty())
         {
-            cppName = fmt::format("ppc_recomp.{}.cpp", cppFileIndex);
+            SaveOutData(fmt::format("ppc_recomp.{}.cpp", cppFileIndex), out);
             ++cppFileIndex;
         }
+        else
+        {
+            SaveOutData(name, out);
+        }
+
+        out.clear();
+    }
+}
+
+void Recompiler::SaveOutData(const std::string_view& name, const std::string_view& data)
+{
+    if (!data.empty())
+    {
+        const auto wallBegin = std::chrono::steady_clock::now();
+        const double cpuBegin = GetThreadCpuSeconds();
 
         bool shouldWrite = true;
 
+        RecompilerManifest::Entry entry;
+        entry.size = data.size();
+        entry.hash = XXH3_128bits(data.data(), data.size());
+
+        bool inManifest = false;
+        {
+            std::lock_guard lock(manifestMutex);
+
+            auto findResult = manifest.entries.find(name);
+            if (findResult != manifest.entries.end())
+            {
+                inManifest = true;
+                shouldWrite = findResult->second.size != entry.size || !XXH128_isEqual(findResult->second.hash, entry.hash);
+            }
+
+            newManifest.entries.insert_or_assign(std::string(name), entry);
+        }
+
         // Check if an identical file already exists first to not trigger recompilation
-        std::string directoryPath = config.directoryPath;
-        if (!directoryPath.empty())
-            directoryPath += "/";
+        std::string filePath = GetOutFilePath(name);
+        FILE* f = nullptr;
 
-        std::string filePath = fmt::format("{}{}/{}", directoryPath, config.outDirectoryPath, name.empty() ? cppName : name);
-        FILE* f = fopen(filePath.c_str(), "rb");
-        if (f)
+        if (inManifest)
         {
-            static std::vector<uint8_t> temp;
+            // Trust the manifest as long as the file was not deleted or modified in size since.
+            std::error_code ec;
+            if (!shouldWrite && std::filesystem::file_size(filePath, ec) != entry.size)
+                shouldWrite = true;
+        }
+        else if ((f = fopen(filePath.c_str(), "rb")) != nullptr)
+        {
+            std::vector<uint8_t> temp;
 
             fseek(f, 0, SEEK_END);
             long fileSize = ftell(f);
-            if (fileSize == out.size())
+            if (fileSize == data.size())
             {
                 fseek(f, 0, SEEK_SET);
                 temp.resize(fileSize);
                 fread(temp.data(), 1, fileSize, f);
 
-                shouldWrite = !XXH128_isEqual(XXH3_128bits(temp.data(), temp.size()), XXH3_128bits(out.data(), out.size()));
+                shouldWrite = !XXH128_isEqual(XXH3_128bits(temp.data(), temp.size()), entry.hash);
             }
             fclose(f);
         }
@@ -3809,10 +4789,44 @@ void Recompiler::SaveCurrentOutData(const std::string_view& name)
         if (shouldWrite)
         {
             f = fopen(filePath.c_str(), "wb");
-            fwrite(out.data(), 1, out.size(), f);
+            fwrite(data.data(), 1, data.size(), f);
             fclose(f);
         }
 
-        out.clear();
+        std::lock_guard lock(manifestMutex);
+        writeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - wallBegin).count();
+        writeCpuSeconds += GetThreadCpuSeconds() - cpuBegin;
+    }
+}
+
+std::string Recompiler::GetOutFilePath(const std::string_view& name) const
+{
+    std::string directoryPath = config.directoryPath;
+    if (!directoryPath.empty())
+        directoryPath += "/";
+
+    return fmt::format("{}{}/{}", directoryPath, config.outDirectoryPath, name);
+}
+
+void Recompiler::RemoveStaleOutFiles() const
+{
+    auto isStale = [&](const std::string& name)
+        {
+            return newManifest.entries.find(name) == newManifest.entries.end();
+        };
+
+    std::error_code ec;
+    for (auto& [name, entry] : manifest.entries)
+    {
+        if (isStale(name) && std::filesystem::remove(GetOutFilePath(name), ec))
+            fmt::println("Removed stale output file {}", name);
+    }
+
+    // Shards written before the manifest existed are not listed in it.
+    for (auto& file : std::filesystem::directory_iterator(GetOutFilePath(""), ec))
+    {
+        std::string name = file.path().filename().string();
+        if (name.rfind("ppc_recomp.", 0) == 0 && file.path().extension() == ".cpp" && isStale(name) && std::filesystem::remove(file.path(), ec))
+            fmt::println("Removed stale output file {}", name);
     }
 }
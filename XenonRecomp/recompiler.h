@@ -2,6 +2,17 @@
 
 #include "pch.h"
 #include "recompiler_config.h"
+#include "recompiler_cache.h"
+#include "recompiler_constants.h"
+#include "recompiler_manifest.h"
+#include "recompiler_csr.h"
+#include "recompiler_flags.h"
+#include "recompiler_ir.h"
+#include "recompiler_promotion.h"
+#include "recompiler_writer.h"
+#include <analysis_database.h>
+#include <instruction_store.h>
+#include <process_stats.h>
 
 struct RecompilerLocalVariables
 {
@@ -18,22 +29,140 @@ struct RecompilerLocalVariables
     bool ea{};
 };
 
-enum class CSRState
+// A range of functions printed into the same output file.
+struct RecompilerShard
 {
-    Unknown,
-    FPU,
-    VMX
+    size_t begin;
+    size_t end;
+    std::string name;
 };
 
-struct Recompiler
+// Per-thread code generation state. Functions are printed into the emitter's own
+// output buffer, while the image and config are shared read-only between threads.
+struct RecompilerEmitter
 {
     // Enforce In-order Execution of I/O constant for quick comparison
     static constexpr uint32_t c_eieio = 0xAC06007C;
+
+    // Part of every cache key. Bump it whenever a change anywhere in the code generation, analysis
+    // or IR makes the same input print differently, so stale cached functions are regenerated.
+    static constexpr uint32_t c_generatorVersion = 2;
+
+    const Image& image;
+    const InstructionStore& instructions;
+    const RecompilerConfig& config;
+    std::string out;
+    RecompilerIRFunction ir;
+    RecompilerRegisterPromotion promotion;
+    RecompilerFlagLiveness flagLiveness;
+    RecompilerConstantPropagation constants;
+
+    // Flush modes worked out over the whole image, if the config asks for it.
+    const RecompilerCSRAnalysis* csrAnalysis{};
+
+    // Promoted registers the instruction being printed refers to.
+    RecompilerRegisterSet promotedAccesses;
+
+    // Set while printing a function again after the IR missed a register access.
+    bool promotionDisabled{};
+
+    // Indirect calls printed as direct calls so far.
+    size_t devirtualizedCallCount{};
+
+    std::string tempString;
+    std::string hashBuffer;
+
+    RecompilerEmitter(const Image& image, const InstructionStore& instructions, const RecompilerConfig& config)
+        : image(image), instructions(instructions), config(config)
+    {
+    }
+
+    template<class... Args>
+    void print(fmt::format_string<Args...> fmt, Args&&... args)
+    {
+        fmt::vformat_to(std::back_inserter(out), fmt.get(), fmt::make_format_args(args...));
+    }
+
+    template<class... Args>
+    void println(fmt::format_string<Args...> fmt, Args&&... args)
+    {
+        fmt::vformat_to(std::back_inserter(out), fmt.get(), fmt::make_format_args(args...));
+        out += '\n';
+    }
+
+    // Prints a single instruction of the function.
+    bool Recompile(
+        const Function& fn,
+        const RecompilerIRInstruction& instruction,
+        RecompilerLocalVariables& localVariables,
+        CSRState& csrState);
+
+    // Builds the IR of the function and prints it as C++.
+    bool Recompile(const Function& fn);
+
+    // Prints the function from the IR already built for it. Falls back to printing it without
+    // promoted registers if the IR misses a register access.
+    bool RecompileIR(const Function& fn);
+
+    // Function the bctr or bctrl always lands in, if it's printed as a direct call.
+    const Symbol* FindDevirtualizedTarget(const RecompilerIRInstruction& instruction) const;
+
+    // Indirect calls of the function last analysed that are printed as direct calls. ComputeHash
+    // runs the same analysis, so functions taken from the cache can be counted as well.
+    size_t CountDevirtualizedCalls() const;
+
+    // Registers of the function that may be promoted to locals, see RecompilerRegisterPromotion.
+    RecompilerRegisterSet GetPromotionCandidates() const;
+
+    // Copies registers between the context and their locals.
+    void PrintRegisterCopies(const RecompilerRegisterSet& registers, bool store, RecompilerLocalVariables& localVariables);
+
+    // Hashes every input that the generated code of the function depends on.
+    XXH128_hash_t ComputeHash(const Function& fn);
+};
+
+struct RecompilerPhaseTiming
+{
+    const char* name;
+    double seconds;
+    double cpuSeconds;
+
+    // High-water mark of the process at the end of the phase.
+    size_t peakResidentBytes;
+
+    static RecompilerPhaseTiming Measure(const char* name, const ProcessStats& begin, const ProcessStats& end)
+    {
+        return { name, end.wallSeconds - begin.wallSeconds, end.cpuSeconds - begin.cpuSeconds, end.peakResidentBytes };
+    }
+};
+
+struct Recompiler
+{
+    // Number of functions printed into each ppc_recomp.N.cpp file. When sharding by
+    // address, it's the expected distance between boundaries instead.
+    static constexpr size_t c_functionsPerFile = 256;
+    static constexpr size_t c_minFunctionsPerFile = c_functionsPerFile / 4;
+    static constexpr size_t c_maxFunctionsPerFile = c_functionsPerFile * 4;
     Image image;
+    InstructionStore instructions;
     std::vector<Function> functions;
     std::string out;
     size_t cppFileIndex = 0;
     RecompilerConfig config;
+    RecompilerManifest manifest;
+    RecompilerManifest newManifest;
+    std::mutex manifestMutex;
+    RecompilerCSRAnalysis csrAnalysis;
+
+    // Time spent in each phase of the last Analyse call.
+    std::vector<RecompilerPhaseTiming> analysisTimings;
+
+    // Time spent in load, patch, parse, analyse, codegen and write, appended by LoadConfig, Analyse and Recompile.
+    std::vector<RecompilerPhaseTiming> timings;
+
+    // Time spent in SaveOutData during the last Recompile call, summed over threads.
+    double writeSeconds{};
+    double writeCpuSeconds{};
 
     bool LoadConfig(const std::string_view& configFilePath);
 
@@ -50,21 +179,33 @@ struct Recompiler
         out += '\n';
     }
 
+    // Thread count from the config, or one per hardware thread if unset.
+    size_t GetThreadCount() const;
+
     void Analyse();
 
-    // TODO: make a RecompileArgs struct instead this is getting messy
-    bool Recompile(
-        const Function& fn,
-        uint32_t base,
-        const ppc_insn& insn,
-        const uint32_t* data,
-        std::unordered_map<uint32_t, RecompilerSwitchTable>::iterator& switchTable,
-        RecompilerLocalVariables& localVariables,
-        CSRState& csrState);
+    // Fills in the helper addresses and switch tables missing from the config.
+    void ApplyAnalysisDatabase(const AnalysisDatabase& database);
+
+    // Hash of the config values that function discovery depends on.
+    XXH128_hash_t ComputeAnalysisHash() const;
 
     bool Recompile(const Function& fn);
 
+    // Rough estimate of how expensive the generated code of a function is to compile.
+    size_t EstimateCost(const Function& fn) const;
+
+    std::vector<RecompilerShard> CreateShards() const;
+
     void Recompile(const std::filesystem::path& headerFilePath);
 
     void SaveCurrentOutData(const std::string_view& name = std::string_view());
+
+    void SaveOutData(const std::string_view& name, const std::string_view& data);
+
+    std::string GetOutFilePath(const std::string_view& name) const;
+
+    // Deletes the files listed in the previous manifest or named like output shards
+    // that were not generated by this run.
+    void RemoveStaleOutFiles() const;
 };
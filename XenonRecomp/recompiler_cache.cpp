@@ -0,0 +1,115 @@
+#include "recompiler_cache.h"
+
+bool RecompilerCache::Load(const std::string_view& filePath)
+{
+    entries.clear();
+    newEntries.clear();
+
+    const auto file = LoadFile(filePath);
+    if (file.empty())
+        return false;
+
+    const uint8_t* data = file.data();
+    const uint8_t* dataEnd = data + file.size();
+
+    auto read = [&](auto& value)
+        {
+            if (size_t(dataEnd - data) < sizeof(value))
+                return false;
+
+            memcpy(&value, data, sizeof(value));
+            data += sizeof(value);
+            return true;
+        };
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t count = 0;
+
+    if (!read(magic) || !read(version) || !read(count) || magic != c_magic || version != c_version)
+        return false;
+
+    entries.reserve(count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        XXH128_hash_t hash;
+        uint32_t size = 0;
+
+        if (!read(hash.low64) || !read(hash.high64) || !read(size) || size_t(dataEnd - data) < size)
+        {
+            entries.clear();
+            return false;
+        }
+
+        auto& entry = entries[hash.low64];
+        entry.high = hash.high64;
+        entry.text.assign(reinterpret_cast<const char*>(data), size);
+        data += size;
+    }
+
+    return true;
+}
+
+bool RecompilerCache::Save(const std::string_view& filePath)
+{
+    std::string buffer;
+
+    auto write = [&](const auto& value)
+        {
+            buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+
+    auto writeEntry = [&](uint64_t low, uint64_t high, const std::string& text)
+        {
+            write(low);
+            write(high);
+            write(static_cast<uint32_t>(text.size()));
+            buffer += text;
+        };
+
+    uint32_t count = 0;
+    for (auto& [low, entry] : entries)
+    {
+        if (entry.used)
+            ++count;
+    }
+
+    count += static_cast<uint32_t>(newEntries.size());
+
+    write(c_magic);
+    write(c_version);
+    write(count);
+
+    for (auto& [low, entry] : entries)
+    {
+        if (entry.used)
+            writeEntry(low, entry.high, entry.text);
+    }
+
+    for (auto& [hash, text] : newEntries)
+        writeEntry(hash.low64, hash.high64, text);
+
+    std::ofstream stream(std::string(filePath), std::ios::binary);
+    if (!stream.good())
+        return false;
+
+    stream.write(buffer.data(), buffer.size());
+    return stream.good();
+}
+
+const std::string* RecompilerCache::Find(XXH128_hash_t hash)
+{
+    auto findResult = entries.find(hash.low64);
+    if (findResult == entries.end() || findResult->second.high != hash.high64)
+        return nullptr;
+
+    findResult->second.used = true;
+    return &findResult->second.text;
+}
+
+void RecompilerCache::Insert(XXH128_hash_t hash, const std::string_view& text)
+{
+    std::lock_guard lock(mutex);
+    newEntries.emplace_back(hash, text);
+}
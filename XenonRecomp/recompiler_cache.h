@@ -0,0 +1,29 @@
+#pragma once
+
+// Persistent storage for the code generated for each function, keyed by a hash of everything
+// that can affect it. Lets a re-run skip the functions whose inputs did not change.
+struct RecompilerCache
+{
+    static constexpr uint32_t c_magic = 0x48435258; // "XRCH"
+    static constexpr uint32_t c_version = 1;
+
+    struct Entry
+    {
+        uint64_t high = 0;
+        std::string text;
+        bool used = false;
+    };
+
+    std::unordered_map<uint64_t, Entry> entries;
+    std::vector<std::pair<XXH128_hash_t, std::string>> newEntries;
+    std::mutex mutex;
+
+    bool Load(const std::string_view& filePath);
+
+    // Only the entries that were looked up or inserted since loading are written back.
+    bool Save(const std::string_view& filePath);
+
+    // Find and Insert are safe to call from multiple threads after loading.
+    const std::string* Find(XXH128_hash_t hash);
+    void Insert(XXH128_hash_t hash, const std::string_view& text);
+};
@@ -1,8 +1,37 @@
 #include "recompiler_config.h"
+#include <memory_mapped_file.h>
+
+static XXH128_hash_t HashFile(const std::string& filePath)
+{
+    if (!std::filesystem::is_regular_file(filePath))
+        return {};
+
+    const MemoryMappedFile file(filePath);
+    if (!file.isOpen())
+        return {};
+
+    return XXH3_128bits(file.data(), file.size());
+}
 
 void RecompilerConfig::Load(const std::string_view& configFilePath)
 {
     directoryPath = configFilePath.substr(0, configFilePath.find_last_of("\\/") + 1);
+
+    const std::string configCacheFilePath = fmt::format("{}{}", configFilePath, c_cacheFileExtension);
+    const XXH128_hash_t configHash = HashFile(std::string(configFilePath));
+
+    if (!LoadCache(configCacheFilePath, configHash) && Parse(configFilePath) && cacheConfig)
+    {
+        // Not worth failing over, the TOML file is simply parsed again next time.
+        if (!SaveCache(configCacheFilePath, configHash))
+            fmt::println("Unable to save the config cache file: {}", configCacheFilePath);
+    }
+}
+
+bool RecompilerConfig::Parse(const std::string_view& configFilePath)
+{
+    bool result = true;
+
     toml::table toml = toml::parse_file(configFilePath)
 #if !TOML_EXCEPTIONS
         .table()
@@ -17,6 +46,9 @@ void RecompilerConfig::Load(const std::string_view& configFilePath)
         patchedFilePath = main["patched_file_path"].value_or<std::string>("");
         outDirectoryPath = main["out_directory_path"].value_or<std::string>("");
         switchTableFilePath = main["switch_table_file_path"].value_or<std::string>("");
+        cacheFilePath = main["cache_file_path"].value_or<std::string>("");
+        analysisDatabaseFilePath = main["analysis_database_file_path"].value_or<std::string>("");
+        cacheConfig = main["cache_config"].value_or(false);
 
         skipLr = main["skip_lr"].value_or(false);
         skipMsr = main["skip_msr"].value_or(false);
@@ -26,6 +58,25 @@ void RecompilerConfig::Load(const std::string_view& configFilePath)
         crRegistersAsLocalVariables = main["cr_as_local"].value_or(false);
         nonArgumentRegistersAsLocalVariables = main["non_argument_as_local"].value_or(false);
         nonVolatileRegistersAsLocalVariables = main["non_volatile_as_local"].value_or(false);
+        promoteRegisters = main["promote_registers"].value_or(false);
+        eliminateDeadFlags = main["eliminate_dead_flags"].value_or(false);
+        propagateCsrState = main["propagate_csr_state"].value_or(false);
+        devirtualizeCalls = main["devirtualize_calls"].value_or(false);
+        guaranteedTailCalls = main["guaranteed_tail_calls"].value_or(false);
+        threadCount = main["thread_count"].value_or(0u);
+
+        auto shardModeName = main["shard_mode"].value_or<std::string>("index");
+        if (shardModeName == "address")
+            shardMode = RecompilerShardMode::Address;
+        else if (shardModeName == "cost")
+            shardMode = RecompilerShardMode::Cost;
+        else if (shardModeName != "index")
+        {
+            fmt::println("ERROR: Unknown shard mode \"{}\", falling back to \"index\"", shardModeName);
+            result = false;
+        }
+
+        shardCount = main["shard_count"].value_or(0u);
 
         restGpr14Address = main["restgprlr_14_address"].value_or(0u);
         saveGpr14Address = main["savegprlr_14_address"].value_or(0u);
@@ -38,15 +89,6 @@ void RecompilerConfig::Load(const std::string_view& configFilePath)
         longJmpAddress = main["longjmp_address"].value_or(0u);
         setJmpAddress = main["setjmp_address"].value_or(0u);
 
-        if (restGpr14Address == 0) fmt::println("ERROR: __restgprlr_14 address is unspecified");
-        if (saveGpr14Address == 0) fmt::println("ERROR: __savegprlr_14 address is unspecified");
-        if (restFpr14Address == 0) fmt::println("ERROR: __restfpr_14 address is unspecified");
-        if (saveFpr14Address == 0) fmt::println("ERROR: __savefpr_14 address is unspecified");
-        if (restVmx14Address == 0) fmt::println("ERROR: __restvmx_14 address is unspecified");
-        if (saveVmx14Address == 0) fmt::println("ERROR: __savevmx_14 address is unspecified");
-        if (restVmx64Address == 0) fmt::println("ERROR: __restvmx_64 address is unspecified");
-        if (saveVmx64Address == 0) fmt::println("ERROR: __savevmx_64 address is unspecified");
-
         if (auto functionsArray = main["functions"].as_array())
         {
             for (auto& func : *functionsArray)
@@ -131,6 +173,7 @@ void RecompilerConfig::Load(const std::string_view& configFilePath)
                 (midAsmHook.returnOnFalse && midAsmHook.jumpAddressOnFalse != NULL))
             {
                 fmt::println("{}: can't return and jump at the same time", midAsmHook.name);
+                result = false;
             }
 
             if ((midAsmHook.ret || midAsmHook.jumpAddress != NULL) &&
@@ -138,6 +181,7 @@ void RecompilerConfig::Load(const std::string_view& configFilePath)
                     midAsmHook.jumpAddressOnFalse != NULL || midAsmHook.jumpAddressOnTrue != NULL))
             {
                 fmt::println("{}: can't mix direct and conditional return/jump", midAsmHook.name);
+                result = false;
             }
 
             midAsmHook.afterInstruction = table["after_instruction"].value_or(false);
@@ -145,4 +189,347 @@ void RecompilerConfig::Load(const std::string_view& configFilePath)
             midAsmHooks.emplace(*table["address"].value<uint32_t>(), std::move(midAsmHook));
         }
     }
+
+    return result;
+}
+
+
+bool RecompilerConfig::LoadCache(const std::string_view& configCacheFilePath, const XXH128_hash_t& configHash)
+{
+    const std::string path(configCacheFilePath);
+    if (!std::filesystem::is_regular_file(path))
+        return false;
+
+    const MemoryMappedFile file(path);
+    if (!file.isOpen())
+        return false;
+
+    const uint8_t* data = file.data();
+    const uint8_t* dataEnd = data + file.size();
+
+    auto read = [&](auto& value)
+        {
+            if (size_t(dataEnd - data) < sizeof(value))
+                return false;
+
+            memcpy(&value, data, sizeof(value));
+            data += sizeof(value);
+            return true;
+        };
+
+    auto readString = [&](std::string& value)
+        {
+            uint32_t size = 0;
+            if (!read(size) || size_t(dataEnd - data) < size)
+                return false;
+
+            value.assign(reinterpret_cast<const char*>(data), size);
+            data += size;
+            return true;
+        };
+
+    auto readHash = [&](XXH128_hash_t& value)
+        {
+            return read(value.low64) && read(value.high64);
+        };
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    XXH128_hash_t cachedConfigHash{};
+    XXH128_hash_t cachedSwitchTableHash{};
+
+    if (!read(magic) || !read(version) || magic != c_cacheMagic || version != c_cacheVersion ||
+        !readHash(cachedConfigHash) || !readHash(cachedSwitchTableHash) || !XXH128_isEqual(cachedConfigHash, configHash))
+    {
+        return false;
+    }
+
+    RecompilerConfig config;
+    config.directoryPath = directoryPath;
+
+    uint32_t flags = 0;
+    uint32_t shardModeValue = 0;
+
+    if (!readString(config.filePath) ||
+        !readString(config.patchFilePath) ||
+        !readString(config.patchedFilePath) ||
+        !readString(config.outDirectoryPath) ||
+        !readString(config.switchTableFilePath) ||
+        !readString(config.cacheFilePath) ||
+        !readString(config.analysisDatabaseFilePath) ||
+        !read(flags) ||
+        !read(config.threadCount) ||
+        !read(shardModeValue) ||
+        !read(config.shardCount) ||
+        !read(config.restGpr14Address) ||
+        !read(config.saveGpr14Address) ||
+        !read(config.restFpr14Address) ||
+        !read(config.saveFpr14Address) ||
+        !read(config.restVmx14Address) ||
+        !read(config.saveVmx14Address) ||
+        !read(config.restVmx64Address) ||
+        !read(config.saveVmx64Address) ||
+        !read(config.longJmpAddress) ||
+        !read(config.setJmpAddress))
+    {
+        return false;
+    }
+
+    // The switch table file is only known once the config is read, so it's checked last.
+    if (!config.switchTableFilePath.empty() &&
+        !XXH128_isEqual(HashFile(directoryPath + config.switchTableFilePath), cachedSwitchTableHash))
+    {
+        return false;
+    }
+
+    config.skipLr = (flags & (1 << 0)) != 0;
+    config.ctrAsLocalVariable = (flags & (1 << 1)) != 0;
+    config.xerAsLocalVariable = (flags & (1 << 2)) != 0;
+    config.reservedRegisterAsLocalVariable = (flags & (1 << 3)) != 0;
+    config.skipMsr = (flags & (1 << 4)) != 0;
+    config.crRegistersAsLocalVariables = (flags & (1 << 5)) != 0;
+    config.nonArgumentRegistersAsLocalVariables = (flags & (1 << 6)) != 0;
+    config.nonVolatileRegistersAsLocalVariables = (flags & (1 << 7)) != 0;
+    config.promoteRegisters = (flags & (1 << 8)) != 0;
+    config.eliminateDeadFlags = (flags & (1 << 9)) != 0;
+    config.propagateCsrState = (flags & (1 << 10)) != 0;
+    config.devirtualizeCalls = (flags & (1 << 11)) != 0;
+    config.guaranteedTailCalls = (flags & (1 << 12)) != 0;
+    config.cacheConfig = (flags & (1 << 13)) != 0;
+    config.shardMode = static_cast<RecompilerShardMode>(shardModeValue);
+
+    uint32_t count = 0;
+
+    if (!read(count))
+        return false;
+
+    config.functions.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t address = 0;
+        uint32_t size = 0;
+        if (!read(address) || !read(size))
+            return false;
+
+        config.functions.emplace(address, size);
+    }
+
+    if (!read(count))
+        return false;
+
+    config.invalidInstructions.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t instruction = 0;
+        uint32_t size = 0;
+        if (!read(instruction) || !read(size))
+            return false;
+
+        config.invalidInstructions.emplace(instruction, size);
+    }
+
+    if (!read(count))
+        return false;
+
+    config.functionAliases.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t address = 0;
+        std::string name;
+        if (!read(address) || !readString(name))
+            return false;
+
+        config.functionAliases.emplace(address, std::move(name));
+    }
+
+    if (!read(count))
+        return false;
+
+    config.midAsmHooks.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t address = 0;
+        uint32_t registerCount = 0;
+        uint8_t hookFlags = 0;
+        RecompilerMidAsmHook midAsmHook;
+
+        if (!read(address) || !readString(midAsmHook.name) || !read(registerCount))
+            return false;
+
+        midAsmHook.registers.resize(registerCount);
+        for (auto& reg : midAsmHook.registers)
+        {
+            if (!readString(reg))
+                return false;
+        }
+
+        if (!read(hookFlags) ||
+            !read(midAsmHook.jumpAddress) ||
+            !read(midAsmHook.jumpAddressOnTrue) ||
+            !read(midAsmHook.jumpAddressOnFalse))
+        {
+            return false;
+        }
+
+        midAsmHook.ret = (hookFlags & (1 << 0)) != 0;
+        midAsmHook.returnOnTrue = (hookFlags & (1 << 1)) != 0;
+        midAsmHook.returnOnFalse = (hookFlags & (1 << 2)) != 0;
+        midAsmHook.afterInstruction = (hookFlags & (1 << 3)) != 0;
+
+        config.midAsmHooks.emplace(address, std::move(midAsmHook));
+    }
+
+    if (!read(count))
+        return false;
+
+    config.switchTables.reserve(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t base = 0;
+        uint32_t labelCount = 0;
+        RecompilerSwitchTable switchTable;
+
+        if (!read(base) || !read(switchTable.r) || !read(labelCount) || size_t(dataEnd - data) / sizeof(uint32_t) < labelCount)
+            return false;
+
+        switchTable.labels.resize(labelCount);
+        memcpy(switchTable.labels.data(), data, labelCount * sizeof(uint32_t));
+        data += labelCount * sizeof(uint32_t);
+
+        config.switchTables.emplace(base, std::move(switchTable));
+    }
+
+    if (data != dataEnd)
+        return false;
+
+    *this = std::move(config);
+    return true;
+}
+
+bool RecompilerConfig::SaveCache(const std::string_view& configCacheFilePath, const XXH128_hash_t& configHash) const
+{
+    std::string buffer;
+
+    auto write = [&](const auto& value)
+        {
+            buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        };
+
+    auto writeString = [&](const std::string& value)
+        {
+            write(static_cast<uint32_t>(value.size()));
+            buffer += value;
+        };
+
+    auto writeHash = [&](const XXH128_hash_t& value)
+        {
+            write(value.low64);
+            write(value.high64);
+        };
+
+    XXH128_hash_t switchTableHash{};
+    if (!switchTableFilePath.empty())
+        switchTableHash = HashFile(directoryPath + switchTableFilePath);
+
+    write(c_cacheMagic);
+    write(c_cacheVersion);
+    writeHash(configHash);
+    writeHash(switchTableHash);
+
+    writeString(filePath);
+    writeString(patchFilePath);
+    writeString(patchedFilePath);
+    writeString(outDirectoryPath);
+    writeString(switchTableFilePath);
+    writeString(cacheFilePath);
+    writeString(analysisDatabaseFilePath);
+
+    uint32_t flags = 0;
+    flags |= skipLr ? (1 << 0) : 0;
+    flags |= ctrAsLocalVariable ? (1 << 1) : 0;
+    flags |= xerAsLocalVariable ? (1 << 2) : 0;
+    flags |= reservedRegisterAsLocalVariable ? (1 << 3) : 0;
+    flags |= skipMsr ? (1 << 4) : 0;
+    flags |= crRegistersAsLocalVariables ? (1 << 5) : 0;
+    flags |= nonArgumentRegistersAsLocalVariables ? (1 << 6) : 0;
+    flags |= nonVolatileRegistersAsLocalVariables ? (1 << 7) : 0;
+    flags |= promoteRegisters ? (1 << 8) : 0;
+    flags |= eliminateDeadFlags ? (1 << 9) : 0;
+    flags |= propagateCsrState ? (1 << 10) : 0;
+    flags |= devirtualizeCalls ? (1 << 11) : 0;
+    flags |= guaranteedTailCalls ? (1 << 12) : 0;
+    flags |= cacheConfig ? (1 << 13) : 0;
+    write(flags);
+
+    write(threadCount);
+    write(static_cast<uint32_t>(shardMode));
+    write(shardCount);
+    write(restGpr14Address);
+    write(saveGpr14Address);
+    write(restFpr14Address);
+    write(saveFpr14Address);
+    write(restVmx14Address);
+    write(saveVmx14Address);
+    write(restVmx64Address);
+    write(saveVmx64Address);
+    write(longJmpAddress);
+    write(setJmpAddress);
+
+    write(static_cast<uint32_t>(functions.size()));
+    for (auto& [address, size] : functions)
+    {
+        write(address);
+        write(size);
+    }
+
+    write(static_cast<uint32_t>(invalidInstructions.size()));
+    for (auto& [instruction, size] : invalidInstructions)
+    {
+        write(instruction);
+        write(size);
+    }
+
+    write(static_cast<uint32_t>(functionAliases.size()));
+    for (auto& [address, name] : functionAliases)
+    {
+        write(address);
+        writeString(name);
+    }
+
+    write(static_cast<uint32_t>(midAsmHooks.size()));
+    for (auto& [address, midAsmHook] : midAsmHooks)
+    {
+        write(address);
+        writeString(midAsmHook.name);
+        write(static_cast<uint32_t>(midAsmHook.registers.size()));
+        for (auto& reg : midAsmHook.registers)
+            writeString(reg);
+
+        uint8_t hookFlags = 0;
+        hookFlags |= midAsmHook.ret ? (1 << 0) : 0;
+        hookFlags |= midAsmHook.returnOnTrue ? (1 << 1) : 0;
+        hookFlags |= midAsmHook.returnOnFalse ? (1 << 2) : 0;
+        hookFlags |= midAsmHook.afterInstruction ? (1 << 3) : 0;
+        write(hookFlags);
+
+        write(midAsmHook.jumpAddress);
+        write(midAsmHook.jumpAddressOnTrue);
+        write(midAsmHook.jumpAddressOnFalse);
+    }
+
+    write(static_cast<uint32_t>(switchTables.size()));
+    for (auto& [base, switchTable] : switchTables)
+    {
+        write(base);
+        write(switchTable.r);
+        write(static_cast<uint32_t>(switchTable.labels.size()));
+        buffer.append(reinterpret_cast<const char*>(switchTable.labels.data()), switchTable.labels.size() * sizeof(uint32_t));
+    }
+
+    std::ofstream stream(std::string(configCacheFilePath), std::ios::binary);
+    if (!stream.good())
+        return false;
+
+    stream.write(buffer.data(), buffer.size());
+    return stream.good();
 }
@@ -22,15 +22,35 @@ struct RecompilerMidAsmHook
     bool afterInstruction = false;
 };
 
+enum class RecompilerShardMode
+{
+    // Start a new file every fixed amount of functions.
+    Index,
+    // Start a new file at functions whose address hashes to a boundary, so adding or
+    // removing a function only changes the file that contains it.
+    Address,
+    // Split functions into a fixed amount of files with a similar estimated compile cost.
+    Cost
+};
+
 struct RecompilerConfig
 {
+    // Binary copy of the loaded config stored next to the TOML file if it asks for one. Reused as
+    // long as the hashes of the TOML file and the switch table file it references still match.
+    static constexpr uint32_t c_cacheMagic = 0x43435258; // "XRCC"
+    static constexpr uint32_t c_cacheVersion = 8;
+    static constexpr std::string_view c_cacheFileExtension = ".bin";
+
     std::string directoryPath;
     std::string filePath;
     std::string patchFilePath;
     std::string patchedFilePath;
     std::string outDirectoryPath;
     std::string switchTableFilePath;
+    std::string cacheFilePath;
+    std::string analysisDatabaseFilePath;
     std::unordered_map<uint32_t, RecompilerSwitchTable> switchTables;
+    bool cacheConfig = false;
     bool skipLr = false;
     bool ctrAsLocalVariable = false;
     bool xerAsLocalVariable = false;
@@ -39,6 +59,14 @@ struct RecompilerConfig
     bool crRegistersAsLocalVariables = false;
     bool nonArgumentRegistersAsLocalVariables = false;
     bool nonVolatileRegistersAsLocalVariables = false;
+    bool promoteRegisters = false;
+    bool eliminateDeadFlags = false;
+    bool propagateCsrState = false;
+    bool devirtualizeCalls = false;
+    bool guaranteedTailCalls = false;
+    uint32_t threadCount = 0;
+    RecompilerShardMode shardMode = RecompilerShardMode::Index;
+    uint32_t shardCount = 0;
     uint32_t restGpr14Address = 0;
     uint32_t saveGpr14Address = 0;
     uint32_t restFpr14Address = 0;
@@ -55,4 +83,10 @@ struct RecompilerConfig
     std::unordered_map<uint32_t, std::string> functionAliases;
 
     void Load(const std::string_view& configFilePath);
+
+    // Returns false if the config had problems worth reporting again on the next run.
+    bool Parse(const std::string_view& configFilePath);
+
+    bool LoadCache(const std::string_view& configCacheFilePath, const XXH128_hash_t& configHash);
+    bool SaveCache(const std::string_view& configCacheFilePath, const XXH128_hash_t& configHash) const;
 };
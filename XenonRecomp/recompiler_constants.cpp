@@ -0,0 +1,209 @@
+#include "recompiler_constants.h"
+
+// Low 32 bits of r0-r31 and CTR, with a bit for each one that is known.
+struct RecompilerConstants
+{
+    static constexpr size_t c_ctr = 32;
+
+    uint64_t known{};
+    uint32_t values[33]{};
+
+    bool Has(size_t index) const
+    {
+        return (known & (1ull << index)) != 0;
+    }
+
+    void Set(size_t index, uint32_t value)
+    {
+        known |= 1ull << index;
+        values[index] = value;
+    }
+
+    // Keeps the values both sides agree on.
+    void Join(const RecompilerConstants& other)
+    {
+        known &= other.known;
+        for (size_t i = 0; i < std::size(values); i++)
+        {
+            if (Has(i) && values[i] != other.values[i])
+                known &= ~(1ull << i);
+        }
+    }
+
+    bool operator==(const RecompilerConstants& other) const
+    {
+        if (known != other.known)
+            return false;
+
+        for (size_t i = 0; i < std::size(values); i++)
+        {
+            if (Has(i) && values[i] != other.values[i])
+                return false;
+        }
+
+        return true;
+    }
+};
+
+// Reads a word that nothing can change at runtime.
+static bool LoadReadOnly(const Image& image, uint32_t address, uint32_t& value)
+{
+    auto section = image.sections.upper_bound(address);
+    if (section == image.sections.begin())
+        return false;
+
+    --section;
+    if ((section->flags & SectionFlags_ReadOnly) == 0 || section->size < sizeof(uint32_t) || address - section->base > section->size - sizeof(uint32_t))
+        return false;
+
+    value = ByteSwap(*reinterpret_cast<const uint32_t*>(section->data + (address - section->base)));
+    return true;
+}
+
+static void Execute(RecompilerConstants& state, const RecompilerIRInstruction& instruction, const Image& image)
+{
+    const auto& insn = instruction.insn;
+
+    // Base register of D-form instructions, where r0 reads as zero.
+    auto base = [&](size_t index, uint32_t& value)
+        {
+            value = 0;
+            if (index == 0)
+                return true;
+
+            value = state.values[index];
+            return state.Has(index);
+        };
+
+    size_t result = -1;
+    uint32_t value = 0;
+
+    if (insn.opcode != nullptr)
+    {
+        uint32_t operand;
+
+        switch (insn.opcode->id)
+        {
+        case PPC_INST_LI:
+            result = insn.operands[0];
+            value = insn.operands[1];
+            break;
+
+        case PPC_INST_LIS:
+            result = insn.operands[0];
+            value = insn.operands[1] << 16;
+            break;
+
+        case PPC_INST_ADDI:
+            if (base(insn.operands[1], operand))
+            {
+                result = insn.operands[0];
+                value = operand + insn.operands[2];
+            }
+            break;
+
+        case PPC_INST_ADDIS:
+            if (base(insn.operands[1], operand))
+            {
+                result = insn.operands[0];
+                value = operand + (insn.operands[2] << 16);
+            }
+            break;
+
+        case PPC_INST_ORI:
+            if (state.Has(insn.operands[1]))
+            {
+                result = insn.operands[0];
+                value = state.values[insn.operands[1]] | insn.operands[2];
+            }
+            break;
+
+        case PPC_INST_ORIS:
+            if (state.Has(insn.operands[1]))
+            {
+                result = insn.operands[0];
+                value = state.values[insn.operands[1]] | (insn.operands[2] << 16);
+            }
+            break;
+
+        case PPC_INST_MR:
+            if (state.Has(insn.operands[1]))
+            {
+                result = insn.operands[0];
+                value = state.values[insn.operands[1]];
+            }
+            break;
+
+        case PPC_INST_MTCTR:
+            if (state.Has(insn.operands[0]))
+            {
+                result = RecompilerConstants::c_ctr;
+                value = state.values[insn.operands[0]];
+            }
+            break;
+
+        case PPC_INST_LWZ:
+            if (base(insn.operands[2], operand) && LoadReadOnly(image, operand + insn.operands[1], value))
+                result = insn.operands[0];
+            break;
+        }
+    }
+
+    // Anything else the instruction writes is unknown from here on, including everything a call may change.
+    state.known &= ~uint64_t(instruction.defs.r);
+    if (instruction.defs.special & RecompilerRegisterSet::c_ctr)
+        state.known &= ~(1ull << RecompilerConstants::c_ctr);
+
+    // Hooks may change the registers they take despite the instruction.
+    if (result != -1 && !instruction.HasFlag(RecompilerIRInstruction::c_hook))
+        state.Set(result, value);
+}
+
+void RecompilerConstantPropagation::Analyse(const RecompilerIRFunction& function, const Image& image)
+{
+    const auto& instructions = function.instructions;
+    const auto& blocks = function.blocks;
+
+    ctrValues.assign(instructions.size(), 0);
+
+    std::vector<RecompilerConstants> blockStates(blocks.size());
+    std::vector<uint8_t> reached(blocks.size());
+
+    if (!blocks.empty())
+        reached[0] = true;
+
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            if (!reached[i])
+                continue;
+
+            RecompilerConstants state = blockStates[i];
+            for (size_t j = blocks[i].begin; j < blocks[i].end; j++)
+            {
+                const auto& instruction = instructions[j];
+                if (instruction.insn.opcode != nullptr && (instruction.insn.opcode->id == PPC_INST_BCTR || instruction.insn.opcode->id == PPC_INST_BCTRL))
+                    ctrValues[j] = state.Has(RecompilerConstants::c_ctr) ? state.values[RecompilerConstants::c_ctr] : 0;
+
+                Execute(state, instruction, image);
+            }
+
+            for (auto successor : blocks[i].successors)
+            {
+                RecompilerConstants joined = state;
+                if (reached[successor])
+                    joined.Join(blockStates[successor]);
+
+                if (!reached[successor] || !(joined == blockStates[successor]))
+                {
+                    reached[successor] = true;
+                    blockStates[successor] = joined;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
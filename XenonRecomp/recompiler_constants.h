@@ -0,0 +1,14 @@
+#pragma once
+
+#include "recompiler_ir.h"
+
+// Finds the GPRs and CTR that hold the same value on every path through a function, built
+// from immediates and loads from read-only sections. A bctr or bctrl whose CTR is known this
+// way always lands in the same function, so it can be printed as a direct call.
+struct RecompilerConstantPropagation
+{
+    // CTR before each bctr and bctrl when it's constant, 0 otherwise.
+    std::vector<uint32_t> ctrValues;
+
+    void Analyse(const RecompilerIRFunction& function, const Image& image);
+};
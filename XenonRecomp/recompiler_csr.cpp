@@ -0,0 +1,511 @@
+#include "recompiler_csr.h"
+#include "recompiler_flags.h"
+
+CSRState GetRequiredCSRState(int id)
+{
+    switch (id)
+    {
+    case PPC_INST_FABS:
+    case PPC_INST_FADD:
+    case PPC_INST_FADDS:
+    case PPC_INST_FCFID:
+    case PPC_INST_FCMPU:
+    case PPC_INST_FCTID:
+    case PPC_INST_FCTIDZ:
+    case PPC_INST_FCTIWZ:
+    case PPC_INST_FDIV:
+    case PPC_INST_FDIVS:
+    case PPC_INST_FMADD:
+    case PPC_INST_FMADDS:
+    case PPC_INST_FMR:
+    case PPC_INST_FMSUB:
+    case PPC_INST_FMSUBS:
+    case PPC_INST_FMUL:
+    case PPC_INST_FMULS:
+    case PPC_INST_FNABS:
+    case PPC_INST_FNEG:
+    case PPC_INST_FNMADDS:
+    case PPC_INST_FNMSUB:
+    case PPC_INST_FNMSUBS:
+    case PPC_INST_FRES:
+    case PPC_INST_FRSP:
+    case PPC_INST_FSEL:
+    case PPC_INST_FRSQRTE:
+    case PPC_INST_FSQRT:
+    case PPC_INST_FSQRTS:
+    case PPC_INST_FSUB:
+    case PPC_INST_FSUBS:
+    case PPC_INST_LFD:
+    case PPC_INST_LFDX:
+    case PPC_INST_LFS:
+    case PPC_INST_LFSX:
+    case PPC_INST_STFD:
+    case PPC_INST_STFDX:
+    case PPC_INST_STFIWX:
+    case PPC_INST_STFS:
+    case PPC_INST_STFSX:
+    case PPC_INST_FNMADD:
+    case PPC_INST_LFDU:
+    case PPC_INST_LFDUX:
+    case PPC_INST_LFSU:
+    case PPC_INST_LFSUX:
+    case PPC_INST_STFDU:
+    case PPC_INST_STFSU:
+    case PPC_INST_STFSUX:
+        return CSRState::FPU;
+
+    case PPC_INST_VADDFP128:
+    case PPC_INST_VADDFP:
+    case PPC_INST_VCFPSXWS128:
+    case PPC_INST_VCTSXS:
+    case PPC_INST_VCFPUXWS128:
+    case PPC_INST_VCTUXS:
+    case PPC_INST_VCSXWFP128:
+    case PPC_INST_VCFSX:
+    case PPC_INST_VCUXWFP128:
+    case PPC_INST_VCFUX:
+    case PPC_INST_VCMPBFP128:
+    case PPC_INST_VCMPBFP:
+    case PPC_INST_VCMPEQFP128:
+    case PPC_INST_VCMPEQFP:
+    case PPC_INST_VCMPGEFP128:
+    case PPC_INST_VCMPGEFP:
+    case PPC_INST_VCMPGTFP128:
+    case PPC_INST_VCMPGTFP:
+    case PPC_INST_VEXPTEFP128:
+    case PPC_INST_VEXPTEFP:
+    case PPC_INST_VLOGEFP128:
+    case PPC_INST_VLOGEFP:
+    case PPC_INST_VMADDFP128:
+    case PPC_INST_VMADDFP:
+    case PPC_INST_VMADDCFP128:
+    case PPC_INST_VMAXFP128:
+    case PPC_INST_VMAXFP:
+    case PPC_INST_VMINFP128:
+    case PPC_INST_VMINFP:
+    case PPC_INST_VMSUM3FP128:
+    case PPC_INST_VMSUM4FP128:
+    case PPC_INST_VMULFP128:
+    case PPC_INST_VNMSUBFP128:
+    case PPC_INST_VNMSUBFP:
+    case PPC_INST_VPKD3D128:
+    case PPC_INST_VREFP128:
+    case PPC_INST_VREFP:
+    case PPC_INST_VRFIM128:
+    case PPC_INST_VRFIM:
+    case PPC_INST_VRFIN128:
+    case PPC_INST_VRFIN:
+    case PPC_INST_VRFIZ128:
+    case PPC_INST_VRFIZ:
+    case PPC_INST_VRSQRTEFP128:
+    case PPC_INST_VRSQRTEFP:
+    case PPC_INST_VSUBFP128:
+    case PPC_INST_VSUBFP:
+    case PPC_INST_MTCRF:
+    case PPC_INST_BGTLA:
+    case PPC_INST_VMINSW:
+    case PPC_INST_VAVGSW:
+    case PPC_INST_VSLO:
+    case PPC_INST_VSUBSBS:
+    case PPC_INST_VSRAB:
+        return CSRState::VMX;
+
+    default:
+        return CSRState::Unknown;
+    }
+}
+
+// Callees of the events besides function indices.
+static constexpr uint32_t c_noCallee = ~0u; // nothing is called, or a plain return
+static constexpr uint32_t c_unknownCallee = ~1u;
+
+enum class RecompilerCSREventKind : uint8_t
+{
+    Set,
+    Call,
+    Exit
+};
+
+// Something in a block that changes the flush mode or hands it to someone else.
+struct RecompilerCSREvent
+{
+    RecompilerCSREventKind kind;
+    RecompilerCSRValue state; // for Set
+    uint32_t callee;          // for Call and Exit
+};
+
+// The parts of a function the analysis looks at, kept for all functions until the summaries settle.
+struct RecompilerCSRFunction
+{
+    std::vector<RecompilerCSREvent> events;
+    std::vector<uint32_t> successors;
+
+    // First event and successor of each block, with the ends appended.
+    std::vector<uint32_t> blockEvents;
+    std::vector<uint32_t> blockSuccessors;
+
+    size_t GetBlockCount() const
+    {
+        return blockEvents.size() - 1;
+    }
+};
+
+static RecompilerCSRValue Join(RecompilerCSRValue lhs, RecompilerCSRValue rhs)
+{
+    if (lhs == RecompilerCSRValue::Unreached || lhs == rhs)
+        return rhs;
+
+    if (rhs == RecompilerCSRValue::Unreached)
+        return lhs;
+
+    return RecompilerCSRValue::Unknown;
+}
+
+static RecompilerCSRValue Apply(const std::vector<RecompilerCSRValue>& summaries, uint32_t callee, RecompilerCSRValue state)
+{
+    if (callee == c_noCallee)
+        return state;
+
+    if (callee == c_unknownCallee)
+        return RecompilerCSRValue::Unknown;
+
+    const auto summary = summaries[callee];
+    return summary == RecompilerCSRValue::Entry ? state : summary;
+}
+
+// Function called or tail called by the printed code of the instruction, mirroring printFunctionCall.
+static uint32_t ResolveCallee(const RecompilerCSRAnalysis& analysis, const RecompilerIRInstruction& instruction, const Image& image, const RecompilerConfig& config)
+{
+    const bool call = instruction.HasFlag(RecompilerIRInstruction::c_call);
+
+    if (instruction.HasFlag(RecompilerIRInstruction::c_switch))
+        return c_unknownCallee;
+
+    // Returns through LR, everything else goes through PPC_CALL_INDIRECT_FUNC.
+    if (instruction.HasFlag(RecompilerIRInstruction::c_indirect))
+        return !call && PPC_XOP(instruction.insn.instruction) == 16 ? c_noCallee : c_unknownCallee;
+
+    if (call && instruction.insn.opcode->id != PPC_INST_BL)
+        return c_unknownCallee;
+
+    const uint32_t target = instruction.target;
+    if (target == config.longJmpAddress || target == config.setJmpAddress)
+        return c_unknownCallee;
+
+    auto symbol = image.symbols.find(target);
+    if (symbol == nullptr || symbol->address != target || symbol->type != Symbol_Function)
+        return c_noCallee;
+
+    if (config.nonVolatileRegistersAsLocalVariables && (symbol->name.find("__rest") == 0 || symbol->name.find("__save") == 0))
+        return c_noCallee;
+
+    const size_t index = analysis.FindFunction(target);
+    return index != -1 ? uint32_t(index) : c_unknownCallee;
+}
+
+// Lists the events in the order the emitter prints them.
+static void BuildFunction(
+    RecompilerCSRFunction& function,
+    const RecompilerCSRAnalysis& analysis,
+    const RecompilerIRFunction& ir,
+    const RecompilerFlagLiveness& flagLiveness,
+    const Image& image,
+    const RecompilerConfig& config)
+{
+    auto& events = function.events;
+
+    for (const auto& block : ir.blocks)
+    {
+        function.blockEvents.push_back(uint32_t(events.size()));
+        function.blockSuccessors.push_back(uint32_t(function.successors.size()));
+        function.successors.insert(function.successors.end(), block.successors.begin(), block.successors.end());
+
+        for (size_t i = block.begin; i < block.end; i++)
+        {
+            const auto& instruction = ir.instructions[i];
+            if (instruction.insn.opcode == nullptr)
+                continue;
+
+            const auto* midAsmHook = instruction.midAsmHook;
+            auto addMidAsmHook = [&]()
+                {
+                    if (std::find(midAsmHook->registers.begin(), midAsmHook->registers.end(), "fpscr") != midAsmHook->registers.end())
+                        events.push_back({ RecompilerCSREventKind::Set, RecompilerCSRValue::Unknown });
+
+                    if (midAsmHook->ret || midAsmHook->returnOnTrue || midAsmHook->returnOnFalse)
+                        events.push_back({ RecompilerCSREventKind::Exit, RecompilerCSRValue::Unknown, c_noCallee });
+                };
+
+            if (midAsmHook != nullptr && !midAsmHook->afterInstruction)
+                addMidAsmHook();
+
+            // Comparisons left out by the emitter don't switch the mode either.
+            const bool deadCompare = config.eliminateDeadFlags && !instruction.HasFlag(RecompilerIRInstruction::c_hook) &&
+                instruction.op == RecompilerIROp::Compare && (instruction.defs.cr & flagLiveness.crLiveOut[i]) == 0;
+
+            const CSRState state = GetRequiredCSRState(instruction.insn.opcode->id);
+            if (state != CSRState::Unknown && !deadCompare)
+                events.push_back({ RecompilerCSREventKind::Set, state == CSRState::FPU ? RecompilerCSRValue::FPU : RecompilerCSRValue::VMX });
+
+            if (instruction.HasFlag(RecompilerIRInstruction::c_call))
+                events.push_back({ RecompilerCSREventKind::Call, RecompilerCSRValue::Unknown, ResolveCallee(analysis, instruction, image, config) });
+            else if (instruction.op == RecompilerIROp::Branch && instruction.HasFlag(RecompilerIRInstruction::c_exit))
+                events.push_back({ RecompilerCSREventKind::Exit, RecompilerCSRValue::Unknown, ResolveCallee(analysis, instruction, image, config) });
+
+            if (midAsmHook != nullptr)
+            {
+                if (midAsmHook->afterInstruction)
+                    addMidAsmHook();
+
+                // The mode at the jump may be the one before the instruction.
+                if (midAsmHook->jumpAddress != NULL || midAsmHook->jumpAddressOnTrue != NULL || midAsmHook->jumpAddressOnFalse != NULL)
+                    events.push_back({ RecompilerCSREventKind::Set, RecompilerCSRValue::Unknown });
+            }
+        }
+
+        // Running off the end of the function returns.
+        if (block.exits && block.end == ir.instructions.size())
+        {
+            const auto& last = ir.instructions.back();
+            if (!last.HasFlag(RecompilerIRInstruction::c_branch | RecompilerIRInstruction::c_exit | RecompilerIRInstruction::c_switch) ||
+                last.HasFlag(RecompilerIRInstruction::c_conditional | RecompilerIRInstruction::c_hook))
+            {
+                events.push_back({ RecompilerCSREventKind::Exit, RecompilerCSRValue::Unknown, c_noCallee });
+            }
+        }
+    }
+
+    function.blockEvents.push_back(uint32_t(events.size()));
+    function.blockSuccessors.push_back(uint32_t(function.successors.size()));
+}
+
+// Finds the mode at the start of each block with the current summaries, and returns the mode at the exits.
+static RecompilerCSRValue Propagate(const RecompilerCSRFunction& function, const std::vector<RecompilerCSRValue>& summaries, RecompilerCSRValue* blockStates)
+{
+    const size_t blockCount = function.GetBlockCount();
+    if (blockCount == 0)
+        return RecompilerCSRValue::Entry;
+
+    std::fill(blockStates, blockStates + blockCount, RecompilerCSRValue::Unreached);
+    blockStates[0] = RecompilerCSRValue::Entry;
+
+    RecompilerCSRValue result = RecompilerCSRValue::Unreached;
+
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+
+        for (size_t i = 0; i < blockCount; i++)
+        {
+            RecompilerCSRValue state = blockStates[i];
+
+            for (size_t j = function.blockEvents[i]; j < function.blockEvents[i + 1] && state != RecompilerCSRValue::Unreached; j++)
+            {
+                const auto& event = function.events[j];
+                switch (event.kind)
+                {
+                case RecompilerCSREventKind::Set:
+                    state = event.state;
+                    break;
+
+                case RecompilerCSREventKind::Call:
+                    state = Apply(summaries, event.callee, state);
+                    break;
+
+                case RecompilerCSREventKind::Exit:
+                    result = Join(result, Apply(summaries, event.callee, state));
+                    break;
+                }
+            }
+
+            // Either the block isn't reached yet, or it calls a function that never returns.
+            if (state == RecompilerCSRValue::Unreached)
+                continue;
+
+            for (size_t j = function.blockSuccessors[i]; j < function.blockSuccessors[i + 1]; j++)
+            {
+                auto& successorState = blockStates[function.successors[j]];
+                const auto joined = Join(successorState, state);
+                if (joined != successorState)
+                {
+                    successorState = joined;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+void RecompilerCSRAnalysis::Analyse(const std::vector<Function>& functions, const Image& image, const InstructionStore& store, const RecompilerConfig& config, size_t threadCount)
+{
+    bases.resize(functions.size());
+    for (size_t i = 0; i < functions.size(); i++)
+        bases[i] = uint32_t(functions[i].base);
+
+    std::vector<RecompilerCSRFunction> csrFunctions(functions.size());
+    std::atomic<size_t> nextIndex = 0;
+
+    auto buildFunctions = [&]()
+        {
+            RecompilerIRFunction ir;
+            RecompilerFlagLiveness flagLiveness;
+
+            size_t i;
+            while ((i = nextIndex++) < functions.size())
+            {
+                ir.Build(functions[i], image, store, config);
+                if (config.eliminateDeadFlags)
+                    flagLiveness.Analyse(ir);
+
+                BuildFunction(csrFunctions[i], *this, ir, flagLiveness, image, config);
+            }
+        };
+
+    threadCount = std::min(threadCount, functions.size());
+    if (threadCount > 1)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount);
+
+        for (size_t i = 0; i < threadCount; i++)
+            threads.emplace_back(buildFunctions);
+
+        for (auto& thread : threads)
+            thread.join();
+    }
+    else
+    {
+        buildFunctions();
+    }
+
+    // Callers of each function, to visit them again when its summary changes.
+    std::vector<uint32_t> callerOffsets(functions.size() + 1);
+    for (auto& function : csrFunctions)
+    {
+        for (auto& event : function.events)
+        {
+            if (event.kind != RecompilerCSREventKind::Set && event.callee < functions.size())
+                callerOffsets[event.callee + 1]++;
+        }
+    }
+
+    for (size_t i = 0; i < functions.size(); i++)
+        callerOffsets[i + 1] += callerOffsets[i];
+
+    std::vector<uint32_t> callers(callerOffsets.back());
+    {
+        std::vector<uint32_t> callerCounts(functions.size());
+        for (size_t i = 0; i < csrFunctions.size(); i++)
+        {
+            for (auto& event : csrFunctions[i].events)
+            {
+                if (event.kind != RecompilerCSREventKind::Set && event.callee < functions.size())
+                    callers[callerOffsets[event.callee] + callerCounts[event.callee]++] = uint32_t(i);
+            }
+        }
+    }
+
+    // Summaries only ever go up from Unreached, so this settles after a few visits per function.
+    summaries.assign(functions.size(), RecompilerCSRValue::Unreached);
+
+    std::vector<uint32_t> worklist(functions.size());
+    std::vector<uint8_t> queued(functions.size(), true);
+    for (size_t i = 0; i < functions.size(); i++)
+        worklist[i] = uint32_t(functions.size() - i - 1);
+
+    std::vector<RecompilerCSRValue> scratch;
+
+    while (!worklist.empty())
+    {
+        const uint32_t index = worklist.back();
+        worklist.pop_back();
+        queued[index] = false;
+
+        scratch.resize(csrFunctions[index].GetBlockCount());
+        const auto summary = Propagate(csrFunctions[index], summaries, scratch.data());
+        if (summary != summaries[index])
+        {
+            summaries[index] = summary;
+
+            for (size_t i = callerOffsets[index]; i < callerOffsets[index + 1]; i++)
+            {
+                if (!queued[callers[i]])
+                {
+                    queued[callers[i]] = true;
+                    worklist.push_back(callers[i]);
+                }
+            }
+        }
+    }
+
+    blockOffsets.resize(functions.size());
+    size_t blockCount = 0;
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        blockOffsets[i] = uint32_t(blockCount);
+        blockCount += csrFunctions[i].GetBlockCount();
+    }
+
+    blockStates.resize(blockCount);
+    size_t knownCount = 0;
+
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        Propagate(csrFunctions[i], summaries, blockStates.data() + blockOffsets[i]);
+
+        if (summaries[i] != RecompilerCSRValue::Unknown)
+            ++knownCount;
+    }
+
+    fmt::println("{} of {} functions return with a known flush mode", knownCount, functions.size());
+}
+
+size_t RecompilerCSRAnalysis::FindFunction(size_t address) const
+{
+    auto it = std::lower_bound(bases.begin(), bases.end(), address);
+    if (it == bases.end() || *it != address)
+        return -1;
+
+    return it - bases.begin();
+}
+
+RecompilerCSRValue RecompilerCSRAnalysis::FindSummary(size_t address) const
+{
+    const size_t index = FindFunction(address);
+    return index != -1 ? summaries[index] : RecompilerCSRValue::Unknown;
+}
+
+static CSRState ToCSRState(RecompilerCSRValue value)
+{
+    switch (value)
+    {
+    case RecompilerCSRValue::FPU:
+        return CSRState::FPU;
+
+    case RecompilerCSRValue::VMX:
+        return CSRState::VMX;
+
+    default:
+        return CSRState::Unknown;
+    }
+}
+
+CSRState RecompilerCSRAnalysis::GetBlockState(size_t function, size_t block) const
+{
+    return ToCSRState(blockStates[blockOffsets[function] + block]);
+}
+
+CSRState RecompilerCSRAnalysis::GetStateAfterCall(const RecompilerIRInstruction& instruction, CSRState state, const Image& image, const RecompilerConfig& config) const
+{
+    const uint32_t callee = ResolveCallee(*this, instruction, image, config);
+    if (callee == c_noCallee)
+        return state;
+
+    if (callee == c_unknownCallee)
+        return CSRState::Unknown;
+
+    // Functions that never return are treated like unknown ones here, nothing relies on it.
+    return summaries[callee] == RecompilerCSRValue::Entry ? state : ToCSRState(summaries[callee]);
+}
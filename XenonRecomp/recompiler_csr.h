@@ -0,0 +1,54 @@
+#pragma once
+
+#include "recompiler_ir.h"
+
+// Flush mode of the host MXCSR. Scalar and vector instructions treat denormals differently,
+// so the generated code switches the mode before the instructions that depend on it.
+enum class CSRState
+{
+    Unknown,
+    FPU,
+    VMX
+};
+
+// Mode the printed code of the instruction switches to, Unknown if it doesn't need one.
+CSRState GetRequiredCSRState(int id);
+
+// Flush mode at some point of a function, as far as the analysis can tell.
+enum class RecompilerCSRValue : uint8_t
+{
+    Unreached,
+    Entry, // whatever the caller had
+    FPU,
+    VMX,
+    Unknown
+};
+
+// Works out the flush mode each function returns with, so that callers keep track of it
+// across calls, and the mode at the start of each block when all the ways into it agree.
+// Functions are entered with an unknown mode, since anything may call them indirectly.
+struct RecompilerCSRAnalysis
+{
+    // Function bases in ascending order, and the mode each one returns with.
+    std::vector<uint32_t> bases;
+    std::vector<RecompilerCSRValue> summaries;
+
+    // Mode at the start of each IR block, the blocks of every function one after another.
+    std::vector<uint32_t> blockOffsets;
+    std::vector<RecompilerCSRValue> blockStates;
+
+    // Function bases must be sorted.
+    void Analyse(const std::vector<Function>& functions, const Image& image, const InstructionStore& store, const RecompilerConfig& config, size_t threadCount);
+
+    // Index of the function starting at the address, -1 if there's none.
+    size_t FindFunction(size_t address) const;
+
+    // Mode the function at the address returns with, Unknown if it wasn't analysed.
+    RecompilerCSRValue FindSummary(size_t address) const;
+
+    // Mode at the start of a block, Unknown unless every way into it agrees on FPU or VMX.
+    CSRState GetBlockState(size_t function, size_t block) const;
+
+    // Mode after the code printed for a call instruction.
+    CSRState GetStateAfterCall(const RecompilerIRInstruction& instruction, CSRState state, const Image& image, const RecompilerConfig& config) const;
+};
@@ -0,0 +1,72 @@
+#include "recompiler_flags.h"
+
+// The IR tracks XER as a whole. Comparisons and record forms only copy the summary
+// overflow bit out of it, while everything else that reads XER can see the carry.
+static bool ReadsCarry(const RecompilerIRInstruction& instruction)
+{
+    if (!(instruction.uses.special & RecompilerRegisterSet::c_xer))
+        return false;
+
+    if (instruction.op == RecompilerIROp::Compare)
+        return false;
+
+    if (instruction.HasFlag(RecompilerIRInstruction::c_recordForm))
+        return (instruction.defs.special & RecompilerRegisterSet::c_xer) != 0; // adde. and friends
+
+    return true;
+}
+
+void RecompilerFlagLiveness::Analyse(const RecompilerIRFunction& function)
+{
+    const auto& instructions = function.instructions;
+    const auto& blocks = function.blocks;
+
+    crLiveOut.assign(instructions.size(), 0);
+    carryLiveOut.assign(instructions.size(), 0);
+
+    std::vector<uint8_t> crLiveIn(blocks.size());
+    std::vector<uint8_t> carryLiveIn(blocks.size());
+
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+
+        for (size_t i = blocks.size(); i-- > 0;)
+        {
+            const auto& block = blocks[i];
+
+            // Whoever runs after the function may read anything.
+            uint8_t cr = block.exits ? 0xFF : 0;
+            uint8_t carry = block.exits;
+
+            for (auto successor : block.successors)
+            {
+                cr |= crLiveIn[successor];
+                carry |= carryLiveIn[successor];
+            }
+
+            for (size_t j = block.end; j-- > block.begin;)
+            {
+                const auto& instruction = instructions[j];
+                crLiveOut[j] = cr;
+                carryLiveOut[j] = carry;
+
+                // CR writes either replace the whole field or read it as well, and every
+                // instruction that writes XER sets the carry.
+                cr = (cr & ~instruction.defs.cr) | instruction.uses.cr;
+
+                if (instruction.defs.special & RecompilerRegisterSet::c_xer)
+                    carry = 0;
+                if (ReadsCarry(instruction))
+                    carry = 1;
+            }
+
+            if (cr != crLiveIn[i] || carry != carryLiveIn[i])
+            {
+                crLiveIn[i] = cr;
+                carryLiveIn[i] = carry;
+                changed = true;
+            }
+        }
+    }
+}
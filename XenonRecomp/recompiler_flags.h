@@ -0,0 +1,17 @@
+#pragma once
+
+#include "recompiler_ir.h"
+
+// Finds the CR fields and the XER carry bit that are read after each instruction
+// before anything writes them again. Compares, record forms and carry updates whose
+// result is overwritten first don't need to be printed at all.
+struct RecompilerFlagLiveness
+{
+    // CR fields read later, one bit per field, after each instruction.
+    std::vector<uint8_t> crLiveOut;
+
+    // Whether XER[CA] is read later, after each instruction.
+    std::vector<uint8_t> carryLiveOut;
+
+    void Analyse(const RecompilerIRFunction& function);
+};
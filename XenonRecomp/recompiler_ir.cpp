@@ -0,0 +1,625 @@
+#include "recompiler_ir.h"
+
+RecompilerRegisterSet RecompilerRegisterSet::All()
+{
+    RecompilerRegisterSet set;
+    set.r = ~0u;
+    set.f = ~0u;
+    set.v[0] = ~0ull;
+    set.v[1] = ~0ull;
+    set.cr = 0xFF;
+    set.special = c_ctr | c_lr | c_xer | c_reserved | c_fpscr | c_msr;
+    return set;
+}
+
+RecompilerRegisterSet& RecompilerRegisterSet::operator|=(const RecompilerRegisterSet& other)
+{
+    r |= other.r;
+    f |= other.f;
+    v[0] |= other.v[0];
+    v[1] |= other.v[1];
+    cr |= other.cr;
+    special |= other.special;
+    return *this;
+}
+
+RecompilerRegisterSet& RecompilerRegisterSet::operator&=(const RecompilerRegisterSet& other)
+{
+    r &= other.r;
+    f &= other.f;
+    v[0] &= other.v[0];
+    v[1] &= other.v[1];
+    cr &= other.cr;
+    special &= other.special;
+    return *this;
+}
+
+RecompilerRegisterSet& RecompilerRegisterSet::operator-=(const RecompilerRegisterSet& other)
+{
+    r &= ~other.r;
+    f &= ~other.f;
+    v[0] &= ~other.v[0];
+    v[1] &= ~other.v[1];
+    cr &= ~other.cr;
+    special &= ~other.special;
+    return *this;
+}
+
+bool RecompilerRegisterSet::operator==(const RecompilerRegisterSet& other) const
+{
+    return r == other.r && f == other.f && v[0] == other.v[0] && v[1] == other.v[1] &&
+        cr == other.cr && special == other.special;
+}
+
+static bool StartsWith(std::string_view name, std::string_view prefix)
+{
+    return name.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Loads and stores that write the effective address back to RA, like lwzu and stwux.
+static bool IsUpdateForm(std::string_view name)
+{
+    if (name.back() == '.')
+        name.remove_suffix(1);
+    if (name.back() == 'x')
+        name.remove_suffix(1);
+
+    return name.size() > 2 && name.back() == 'u';
+}
+
+static void AddOperand(RecompilerRegisterSet& set, ppc_operand_kind kind, uint32_t value)
+{
+    switch (kind)
+    {
+    case PPC_OPERAND_KIND_GPR_0:
+        if (value != 0)
+            set.AddR(value);
+        break;
+
+    case PPC_OPERAND_KIND_GPR:
+        set.AddR(value);
+        break;
+
+    case PPC_OPERAND_KIND_FPR:
+        set.AddF(value);
+        break;
+
+    case PPC_OPERAND_KIND_VR:
+        set.AddV(value);
+        break;
+
+    case PPC_OPERAND_KIND_CR_FIELD:
+        set.AddCr(value);
+        break;
+
+    case PPC_OPERAND_KIND_CR_BIT:
+        set.AddCr(value / 4);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void AddHookRegister(RecompilerRegisterSet& set, const std::string& reg)
+{
+    switch (reg[0])
+    {
+    case 'c':
+        if (reg == "ctr")
+            set.special |= RecompilerRegisterSet::c_ctr;
+        else
+            set.AddCr(std::atoi(reg.c_str() + 2));
+        break;
+
+    case 'x':
+        set.special |= RecompilerRegisterSet::c_xer;
+        break;
+
+    case 'r':
+        if (reg == "reserved")
+            set.special |= RecompilerRegisterSet::c_reserved;
+        else
+            set.AddR(std::atoi(reg.c_str() + 1));
+        break;
+
+    case 'f':
+        if (reg == "fpscr")
+            set.special |= RecompilerRegisterSet::c_fpscr;
+        else
+            set.AddF(std::atoi(reg.c_str() + 1));
+        break;
+
+    case 'v':
+        set.AddV(std::atoi(reg.c_str() + 1));
+        break;
+    }
+}
+
+// b, bc, bclr and bcctr. Calls and anything that leaves the function can read and
+// write every register, as far as this function is concerned.
+static void ClassifyBranch(RecompilerIRInstruction& instruction, uint32_t fnBase, uint32_t fnEnd)
+{
+    const uint32_t word = instruction.insn.instruction;
+    const uint32_t op = PPC_OP(word);
+
+    instruction.op = RecompilerIROp::Branch;
+
+    if (op != PPC_OP_B)
+    {
+        const uint32_t bo = PPC_BO(word);
+
+        // Decrements and tests CTR.
+        if (!(bo & 0x4))
+        {
+            instruction.defs.special |= RecompilerRegisterSet::c_ctr;
+            instruction.uses.special |= RecompilerRegisterSet::c_ctr;
+        }
+
+        // Tests a CR bit.
+        if (!(bo & 0x10))
+            instruction.uses.AddCr(((word >> 16) & 0x1F) / 4);
+
+        if ((bo & 0x14) != 0x14)
+            instruction.flags |= RecompilerIRInstruction::c_conditional;
+    }
+
+    if (op == PPC_OP_B)
+    {
+        instruction.target = instruction.address + PPC_BI(word);
+    }
+    else if (op == PPC_OP_BC)
+    {
+        instruction.target = instruction.address + PPC_BD(word);
+    }
+    else
+    {
+        instruction.uses.special |= PPC_XOP(word) == 16 ? RecompilerRegisterSet::c_lr : RecompilerRegisterSet::c_ctr;
+        instruction.flags |= RecompilerIRInstruction::c_indirect;
+    }
+
+    instruction.operandUses = instruction.uses;
+
+    if (PPC_BL(word))
+    {
+        instruction.flags |= RecompilerIRInstruction::c_call;
+        instruction.uses |= RecompilerRegisterSet::All();
+        instruction.defs |= RecompilerRegisterSet::All();
+    }
+    else if (!instruction.HasFlag(RecompilerIRInstruction::c_indirect) && instruction.target >= fnBase && instruction.target < fnEnd)
+    {
+        instruction.flags |= RecompilerIRInstruction::c_branch;
+    }
+    else
+    {
+        instruction.flags |= RecompilerIRInstruction::c_exit;
+        instruction.uses |= RecompilerRegisterSet::All();
+    }
+}
+
+static void ClassifyInstruction(RecompilerIRInstruction& instruction, uint32_t fnBase, uint32_t fnEnd)
+{
+    const auto& insn = instruction.insn;
+    if (insn.opcode == nullptr)
+        return;
+
+    const uint32_t op = PPC_OP(insn.instruction);
+    const uint32_t xop = PPC_XOP(insn.instruction);
+    if (op == PPC_OP_B || op == PPC_OP_BC || (op == PPC_OP_CTR && (xop == 16 || xop == 528)))
+    {
+        ClassifyBranch(instruction, fnBase, fnEnd);
+        return;
+    }
+
+    const int id = insn.opcode->id;
+    const std::string_view name = insn.opcode->name;
+
+    // Otherwise the first operand is written and the rest are read.
+    bool readsAllOperands = false;
+
+    if (StartsWith(name, "st"))
+    {
+        instruction.op = RecompilerIROp::Store;
+        instruction.flags |= RecompilerIRInstruction::c_memoryWrite;
+        readsAllOperands = true;
+    }
+    else if (name[0] == 'l' && id != PPC_INST_LI && id != PPC_INST_LIS)
+    {
+        instruction.op = RecompilerIROp::Load;
+        instruction.flags |= RecompilerIRInstruction::c_memoryRead;
+    }
+    else if (StartsWith(name, "cmp") || StartsWith(name, "fcmp"))
+    {
+        instruction.op = RecompilerIROp::Compare;
+    }
+    else if (StartsWith(name, "cr") || id == PPC_INST_MCRF)
+    {
+        instruction.op = RecompilerIROp::ConditionRegister;
+    }
+    else if (StartsWith(name, "tw") || StartsWith(name, "td"))
+    {
+        instruction.op = RecompilerIROp::System;
+        instruction.flags |= RecompilerIRInstruction::c_trap;
+        readsAllOperands = true;
+    }
+    else if (StartsWith(name, "dcb") || StartsWith(name, "icb") || StartsWith(name, "mt"))
+    {
+        instruction.op = RecompilerIROp::System;
+        readsAllOperands = true;
+    }
+    else if (StartsWith(name, "mf"))
+    {
+        instruction.op = RecompilerIROp::System;
+    }
+    else if (name[0] == 'f')
+    {
+        instruction.op = RecompilerIROp::Float;
+    }
+    else if (name[0] == 'v')
+    {
+        instruction.op = RecompilerIROp::Vector;
+    }
+    else
+    {
+        instruction.op = RecompilerIROp::Integer;
+    }
+
+    for (size_t i = 0; i < InstructionStore::c_operandCount; i++)
+    {
+        const auto kind = ppc_get_operand_kind(insn.opcode, int(i));
+        if (i == 0 && !readsAllOperands)
+        {
+            AddOperand(instruction.defs, kind, insn.operands[i]);
+
+            // Writing a single bit keeps the rest of the field.
+            if (kind == PPC_OPERAND_KIND_CR_BIT)
+                AddOperand(instruction.uses, kind, insn.operands[i]);
+        }
+        else
+        {
+            AddOperand(instruction.uses, kind, insn.operands[i]);
+        }
+    }
+
+    if ((instruction.op == RecompilerIROp::Load || instruction.op == RecompilerIROp::Store) && IsUpdateForm(name))
+    {
+        for (size_t i = 1; i < InstructionStore::c_operandCount; i++)
+        {
+            const auto kind = ppc_get_operand_kind(insn.opcode, int(i));
+            if (kind == PPC_OPERAND_KIND_GPR || kind == PPC_OPERAND_KIND_GPR_0)
+            {
+                AddOperand(instruction.defs, kind, insn.operands[i]);
+                break;
+            }
+        }
+    }
+
+    if (instruction.op == RecompilerIROp::Compare && name[0] == 'c')
+        instruction.uses.special |= RecompilerRegisterSet::c_xer; // copies the summary overflow bit
+
+    if (name.back() == '.')
+    {
+        instruction.flags |= RecompilerIRInstruction::c_recordForm;
+
+        if (instruction.op == RecompilerIROp::Vector)
+        {
+            instruction.defs.AddCr(6);
+        }
+        else if (instruction.op == RecompilerIROp::Float)
+        {
+            instruction.defs.AddCr(1);
+        }
+        else
+        {
+            instruction.defs.AddCr(0);
+            instruction.uses.special |= RecompilerRegisterSet::c_xer;
+        }
+    }
+
+    switch (id)
+    {
+    // Only replace some of the bits of the destination.
+    case PPC_INST_RLWIMI:
+    case PPC_INST_RLDIMI:
+    case PPC_INST_VRLIMI128:
+    case PPC_INST_VPKD3D128:
+        AddOperand(instruction.uses, ppc_get_operand_kind(insn.opcode, 0), insn.operands[0]);
+        break;
+
+    case PPC_INST_ADDE:
+    case PPC_INST_ADDME:
+    case PPC_INST_ADDZE:
+    case PPC_INST_SUBFE:
+    case PPC_INST_SUBFME:
+    case PPC_INST_SUBFZE:
+        instruction.uses.special |= RecompilerRegisterSet::c_xer;
+        instruction.defs.special |= RecompilerRegisterSet::c_xer;
+        break;
+
+    case PPC_INST_ADDC:
+    case PPC_INST_ADDIC:
+    case PPC_INST_SUBFC:
+    case PPC_INST_SUBFIC:
+    case PPC_INST_SRAW:
+    case PPC_INST_SRAWI:
+    case PPC_INST_SRAD:
+    case PPC_INST_SRADI:
+        instruction.defs.special |= RecompilerRegisterSet::c_xer;
+        break;
+
+    case PPC_INST_MFCR:
+        instruction.uses.cr = 0xFF;
+        break;
+
+    case PPC_INST_MTCR:
+        instruction.defs.cr = 0xFF;
+        break;
+
+    case PPC_INST_MTCRF:
+    case PPC_INST_MTOCRF:
+        for (size_t i = 0; i < 8; i++)
+        {
+            if (insn.operands[0] & (1 << (7 - i)))
+            {
+                instruction.defs.AddCr(i);
+                instruction.uses.AddCr(i);
+            }
+        }
+        break;
+
+    case PPC_INST_MFOCRF:
+        instruction.uses.AddCr(6); // the emitter always reads cr6
+        break;
+
+    case PPC_INST_MFCTR:
+        instruction.uses.special |= RecompilerRegisterSet::c_ctr;
+        break;
+
+    case PPC_INST_MTCTR:
+        instruction.defs.special |= RecompilerRegisterSet::c_ctr;
+        break;
+
+    case PPC_INST_MFLR:
+        instruction.uses.special |= RecompilerRegisterSet::c_lr;
+        break;
+
+    case PPC_INST_MTLR:
+        instruction.defs.special |= RecompilerRegisterSet::c_lr;
+        break;
+
+    case PPC_INST_MFXER:
+        instruction.uses.special |= RecompilerRegisterSet::c_xer;
+        break;
+
+    case PPC_INST_MTXER:
+        instruction.defs.special |= RecompilerRegisterSet::c_xer;
+        break;
+
+    case PPC_INST_MFMSR:
+        instruction.uses.special |= RecompilerRegisterSet::c_msr;
+        break;
+
+    case PPC_INST_MTMSRD:
+        instruction.uses.special |= RecompilerRegisterSet::c_msr;
+        instruction.defs.special |= RecompilerRegisterSet::c_msr;
+        break;
+
+    case PPC_INST_MFFS:
+        instruction.uses.special |= RecompilerRegisterSet::c_fpscr;
+        break;
+
+    case PPC_INST_MTFSF:
+        instruction.defs.special |= RecompilerRegisterSet::c_fpscr;
+        break;
+
+    case PPC_INST_LWARX:
+    case PPC_INST_LDARX:
+        instruction.defs.special |= RecompilerRegisterSet::c_reserved;
+        break;
+
+    case PPC_INST_STWCX:
+    case PPC_INST_STDCX:
+        instruction.uses.special |= RecompilerRegisterSet::c_reserved;
+        break;
+
+    case PPC_INST_DCBZ:
+    case PPC_INST_DCBZL:
+        instruction.flags |= RecompilerIRInstruction::c_memoryWrite;
+        break;
+
+    case PPC_INST_SYNC:
+    case PPC_INST_LWSYNC:
+    case PPC_INST_EIEIO:
+    case PPC_INST_ISYNC:
+        instruction.op = RecompilerIROp::System;
+        instruction.flags |= RecompilerIRInstruction::c_barrier;
+        break;
+
+    case PPC_INST_NOP:
+    case PPC_INST_ATTN:
+    case PPC_INST_CCTPL:
+    case PPC_INST_CCTPM:
+    case PPC_INST_DB16CYC:
+        instruction.op = RecompilerIROp::System;
+        break;
+    }
+
+    instruction.operandUses = instruction.uses;
+}
+
+void RecompilerIRFunction::Build(const Function& fn, const Image& image, const InstructionStore& store, const RecompilerConfig& config)
+{
+    base = uint32_t(fn.base);
+    end = uint32_t(fn.base + fn.size);
+
+    const auto* data = (const uint32_t*)image.Find(base);
+    instructions.resize((fn.size + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+
+    for (size_t i = 0; i < instructions.size(); i++)
+    {
+        auto& instruction = instructions[i];
+        instruction.address = uint32_t(base + i * sizeof(uint32_t));
+        instruction.data = data + i;
+        instruction.op = RecompilerIROp::Invalid;
+        instruction.flags = 0;
+        instruction.target = 0;
+        instruction.label = false;
+        instruction.switchTable = nullptr;
+        instruction.midAsmHook = nullptr;
+        instruction.defs = {};
+        instruction.uses = {};
+        instruction.operandUses = {};
+
+        store.Disassemble(instruction.data, instruction.address, instruction.insn);
+        ClassifyInstruction(instruction, base, end);
+    }
+
+    auto addLabel = [&](size_t address)
+        {
+            const size_t index = FindIndex(address);
+            if (index != -1)
+                instructions[index].label = true;
+        };
+
+    // The switch table applies to the next bctr, like the emitter does.
+    const RecompilerSwitchTable* switchTable = nullptr;
+
+    for (auto& instruction : instructions)
+    {
+        // Raw words, so that branches that don't decode still get their labels.
+        const uint32_t word = instruction.insn.instruction;
+        if (!PPC_BL(word))
+        {
+            if (PPC_OP(word) == PPC_OP_B)
+                addLabel(instruction.address + PPC_BI(word));
+            else if (PPC_OP(word) == PPC_OP_BC)
+                addLabel(instruction.address + PPC_BD(word));
+        }
+
+        auto switchTableIt = config.switchTables.find(instruction.address);
+        if (switchTableIt != config.switchTables.end())
+        {
+            for (auto label : switchTableIt->second.labels)
+                addLabel(label);
+
+            if (switchTable == nullptr)
+                switchTable = &switchTableIt->second;
+        }
+
+        if (switchTable != nullptr && instruction.insn.opcode != nullptr && instruction.insn.opcode->id == PPC_INST_BCTR)
+        {
+            instruction.flags = (instruction.flags & ~RecompilerIRInstruction::c_exit) | RecompilerIRInstruction::c_switch;
+            instruction.switchTable = switchTable;
+            instruction.uses = {};
+            instruction.uses.AddR(switchTable->r);
+            instruction.operandUses = instruction.uses;
+
+            for (auto label : switchTable->labels)
+            {
+                if (FindIndex(label) == -1)
+                {
+                    instruction.flags |= RecompilerIRInstruction::c_exit;
+                    instruction.uses |= RecompilerRegisterSet::All();
+                }
+            }
+
+            switchTable = nullptr;
+        }
+
+        auto midAsmHook = config.midAsmHooks.find(instruction.address);
+        if (midAsmHook != config.midAsmHooks.end())
+        {
+            const auto& hook = midAsmHook->second;
+            instruction.midAsmHook = &hook;
+            instruction.flags |= RecompilerIRInstruction::c_hook | RecompilerIRInstruction::c_memoryRead | RecompilerIRInstruction::c_memoryWrite;
+
+            for (auto& reg : hook.registers)
+            {
+                AddHookRegister(instruction.uses, reg);
+                AddHookRegister(instruction.defs, reg);
+                AddHookRegister(instruction.operandUses, reg);
+            }
+
+            if (hook.ret || hook.returnOnTrue || hook.returnOnFalse)
+            {
+                instruction.flags |= RecompilerIRInstruction::c_exit;
+                instruction.uses |= RecompilerRegisterSet::All();
+            }
+
+            if (hook.jumpAddress != NULL)
+                addLabel(hook.jumpAddress);
+            if (hook.jumpAddressOnTrue != NULL)
+                addLabel(hook.jumpAddressOnTrue);
+            if (hook.jumpAddressOnFalse != NULL)
+                addLabel(hook.jumpAddressOnFalse);
+        }
+    }
+
+    BuildBlocks();
+}
+
+void RecompilerIRFunction::BuildBlocks()
+{
+    constexpr uint32_t c_endsBlock = RecompilerIRInstruction::c_branch | RecompilerIRInstruction::c_exit |
+        RecompilerIRInstruction::c_switch | RecompilerIRInstruction::c_hook;
+
+    blocks.clear();
+    blockIndices.resize(instructions.size());
+
+    for (size_t i = 0; i < instructions.size(); i++)
+    {
+        if (i == 0 || instructions[i].label || instructions[i - 1].HasFlag(c_endsBlock))
+            blocks.push_back({ uint32_t(i), uint32_t(i) });
+
+        blocks.back().end = uint32_t(i + 1);
+        blockIndices[i] = uint32_t(blocks.size() - 1);
+    }
+
+    for (auto& block : blocks)
+    {
+        const auto& last = instructions[block.end - 1];
+
+        auto addSuccessor = [&](size_t address)
+            {
+                const size_t index = FindIndex(address);
+                if (index != -1)
+                    block.successors.push_back(blockIndices[index]);
+            };
+
+        if (last.HasFlag(RecompilerIRInstruction::c_branch))
+            addSuccessor(last.target);
+
+        if (last.switchTable != nullptr)
+        {
+            for (auto label : last.switchTable->labels)
+                addSuccessor(label);
+        }
+
+        if (last.midAsmHook != nullptr)
+        {
+            if (last.midAsmHook->jumpAddress != NULL)
+                addSuccessor(last.midAsmHook->jumpAddress);
+            if (last.midAsmHook->jumpAddressOnTrue != NULL)
+                addSuccessor(last.midAsmHook->jumpAddressOnTrue);
+            if (last.midAsmHook->jumpAddressOnFalse != NULL)
+                addSuccessor(last.midAsmHook->jumpAddressOnFalse);
+        }
+
+        const bool fallsThrough = !last.HasFlag(RecompilerIRInstruction::c_branch | RecompilerIRInstruction::c_exit | RecompilerIRInstruction::c_switch) ||
+            last.HasFlag(RecompilerIRInstruction::c_conditional | RecompilerIRInstruction::c_hook);
+
+        if (fallsThrough)
+        {
+            if (block.end < instructions.size())
+                block.successors.push_back(blockIndices[block.end]);
+            else
+                block.exits = true; // runs off the end of the function
+        }
+
+        if (last.HasFlag(RecompilerIRInstruction::c_exit))
+            block.exits = true;
+
+        std::sort(block.successors.begin(), block.successors.end());
+        block.successors.erase(std::unique(block.successors.begin(), block.successors.end()), block.successors.end());
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "recompiler_config.h"
+#include <instruction_store.h>
+
+// Guest registers read or written by an instruction, one bit per register.
+struct RecompilerRegisterSet
+{
+    static constexpr uint8_t c_ctr = 1 << 0;
+    static constexpr uint8_t c_lr = 1 << 1;
+    static constexpr uint8_t c_xer = 1 << 2;
+    static constexpr uint8_t c_reserved = 1 << 3;
+    static constexpr uint8_t c_fpscr = 1 << 4;
+    static constexpr uint8_t c_msr = 1 << 5;
+
+    uint32_t r{};
+    uint32_t f{};
+    uint64_t v[2]{};
+    uint8_t cr{};
+    uint8_t special{};
+
+    static RecompilerRegisterSet All();
+
+    void AddR(size_t index) { r |= 1u << index; }
+    void AddF(size_t index) { f |= 1u << index; }
+    void AddV(size_t index) { v[index / 64] |= 1ull << (index % 64); }
+    void AddCr(size_t index) { cr |= 1u << index; }
+
+    bool HasR(size_t index) const { return (r & (1u << index)) != 0; }
+    bool HasF(size_t index) const { return (f & (1u << index)) != 0; }
+    bool HasV(size_t index) const { return (v[index / 64] & (1ull << (index % 64))) != 0; }
+    bool HasCr(size_t index) const { return (cr & (1u << index)) != 0; }
+
+    bool Empty() const
+    {
+        return r == 0 && f == 0 && v[0] == 0 && v[1] == 0 && cr == 0 && special == 0;
+    }
+
+    RecompilerRegisterSet& operator|=(const RecompilerRegisterSet& other);
+    RecompilerRegisterSet& operator&=(const RecompilerRegisterSet& other);
+
+    // Removes the registers of the other set.
+    RecompilerRegisterSet& operator-=(const RecompilerRegisterSet& other);
+
+    bool operator==(const RecompilerRegisterSet& other) const;
+    bool operator!=(const RecompilerRegisterSet& other) const { return !(*this == other); }
+};
+
+enum class RecompilerIROp : uint8_t
+{
+    Invalid,
+    Integer,
+    Float,
+    Vector,
+    Compare,
+    ConditionRegister,
+    Load,
+    Store,
+    Branch,
+    System
+};
+
+// A decoded instruction with the guest state it touches and how it affects control flow.
+struct RecompilerIRInstruction
+{
+    static constexpr uint32_t c_recordForm = 1 << 0;  // updates a CR field with the result
+    static constexpr uint32_t c_memoryRead = 1 << 1;
+    static constexpr uint32_t c_memoryWrite = 1 << 2;
+    static constexpr uint32_t c_branch = 1 << 3;      // jumps within the function
+    static constexpr uint32_t c_conditional = 1 << 4; // may also fall through
+    static constexpr uint32_t c_call = 1 << 5;
+    static constexpr uint32_t c_exit = 1 << 6;        // returns or tail calls
+    static constexpr uint32_t c_indirect = 1 << 7;
+    static constexpr uint32_t c_switch = 1 << 8;      // indirect jump through a switch table
+    static constexpr uint32_t c_barrier = 1 << 9;
+    static constexpr uint32_t c_trap = 1 << 10;
+    static constexpr uint32_t c_hook = 1 << 11;       // has a mid-asm hook
+
+    uint32_t address{};
+    const uint32_t* data{};
+    ppc_insn insn{};
+    RecompilerIROp op{};
+    uint32_t flags{};
+
+    // Destination of direct branches and calls.
+    uint32_t target{};
+
+    // Something else jumps here, so the instruction starts a block and needs a label.
+    bool label{};
+
+    // Table of the bctr that ends a switch, and the hook to call around the instruction.
+    const RecompilerSwitchTable* switchTable{};
+    const RecompilerMidAsmHook* midAsmHook{};
+
+    RecompilerRegisterSet defs;
+    RecompilerRegisterSet uses;
+
+    // Registers the printed instruction reads itself, without the whole guest state
+    // that calls and exits hand over to other functions.
+    RecompilerRegisterSet operandUses;
+
+    bool HasFlag(uint32_t flag) const
+    {
+        return (flags & flag) != 0;
+    }
+};
+
+// Instructions [begin, end) of a function that always execute together.
+struct RecompilerIRBlock
+{
+    uint32_t begin{};
+    uint32_t end{};
+    std::vector<uint32_t> successors;
+
+    // Control can leave the function from the end of the block.
+    bool exits{};
+};
+
+// Typed view of a function between decoding and C++ emission. Analysis passes work on the
+// register sets and the CFG here, while the emitter prints the instructions in order.
+struct RecompilerIRFunction
+{
+    uint32_t base{};
+    uint32_t end{};
+    std::vector<RecompilerIRInstruction> instructions;
+    std::vector<RecompilerIRBlock> blocks;
+
+    // Block of each instruction.
+    std::vector<uint32_t> blockIndices;
+
+    void Build(const Function& fn, const Image& image, const InstructionStore& store, const RecompilerConfig& config);
+
+    // Index of the instruction at the address, -1 if it's outside the function.
+    size_t FindIndex(size_t address) const
+    {
+        if (address < base || address >= end || (address & 3) != 0)
+            return -1;
+
+        return (address - base) / sizeof(uint32_t);
+    }
+
+private:
+    void BuildBlocks();
+};
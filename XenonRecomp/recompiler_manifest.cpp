@@ -0,0 +1,46 @@
+#include "recompiler_manifest.h"
+
+bool RecompilerManifest::Load(const std::string_view& filePath)
+{
+    entries.clear();
+
+    std::ifstream stream{ std::string(filePath) };
+    if (!stream.good())
+        return false;
+
+    std::string hash;
+    size_t size;
+    std::string name;
+
+    while (stream >> hash >> size >> name)
+    {
+        Entry entry;
+        entry.size = size;
+
+        if (hash.size() != 32 ||
+            std::from_chars(hash.data(), hash.data() + 16, entry.hash.high64, 16).ec != std::errc{} ||
+            std::from_chars(hash.data() + 16, hash.data() + 32, entry.hash.low64, 16).ec != std::errc{})
+        {
+            entries.clear();
+            return false;
+        }
+
+        entries.emplace(std::move(name), entry);
+    }
+
+    return true;
+}
+
+bool RecompilerManifest::Save(const std::string_view& filePath) const
+{
+    std::string out;
+    for (auto& [name, entry] : entries)
+        fmt::format_to(std::back_inserter(out), "{:016x}{:016x} {} {}\n", entry.hash.high64, entry.hash.low64, entry.size, name);
+
+    std::ofstream stream{ std::string(filePath), std::ios::binary };
+    if (!stream.good())
+        return false;
+
+    stream.write(out.data(), out.size());
+    return stream.good();
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Size and hash of every file generated into the output directory. Lets unchanged
+// files be skipped without reading them back, and stale files be found afterwards.
+struct RecompilerManifest
+{
+    static constexpr std::string_view c_fileName = "ppc_manifest.txt";
+
+    struct Entry
+    {
+        size_t size = 0;
+        XXH128_hash_t hash{};
+    };
+
+    std::map<std::string, Entry, std::less<>> entries;
+
+    bool Load(const std::string_view& filePath);
+    bool Save(const std::string_view& filePath) const;
+};
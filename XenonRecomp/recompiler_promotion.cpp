@@ -0,0 +1,225 @@
+#include "recompiler_promotion.h"
+
+// Registers are numbered r0-r31, f0-f31, v0-v127, cr0-cr7, ctr and xer for the cost model.
+static constexpr size_t c_fSlot = 32;
+static constexpr size_t c_vSlot = c_fSlot + 32;
+static constexpr size_t c_crSlot = c_vSlot + 128;
+static constexpr size_t c_ctrSlot = c_crSlot + 8;
+static constexpr size_t c_xerSlot = c_ctrSlot + 1;
+static constexpr size_t c_slotCount = c_xerSlot + 1;
+
+template<typename TFunction>
+static void ForEachBit(uint64_t bits, size_t slot, TFunction&& function)
+{
+    for (; bits != 0; bits >>= 1, slot++)
+    {
+        if (bits & 1)
+            function(slot);
+    }
+}
+
+template<typename TFunction>
+static void ForEachRegister(const RecompilerRegisterSet& set, TFunction&& function)
+{
+    ForEachBit(set.r, 0, function);
+    ForEachBit(set.f, c_fSlot, function);
+    ForEachBit(set.v[0], c_vSlot, function);
+    ForEachBit(set.v[1], c_vSlot + 64, function);
+    ForEachBit(set.cr, c_crSlot, function);
+
+    if (set.special & RecompilerRegisterSet::c_ctr)
+        function(c_ctrSlot);
+    if (set.special & RecompilerRegisterSet::c_xer)
+        function(c_xerSlot);
+}
+
+static void AddRegister(RecompilerRegisterSet& set, size_t slot)
+{
+    if (slot < c_fSlot)
+        set.AddR(slot);
+    else if (slot < c_vSlot)
+        set.AddF(slot - c_fSlot);
+    else if (slot < c_crSlot)
+        set.AddV(slot - c_vSlot);
+    else if (slot < c_ctrSlot)
+        set.AddCr(slot - c_crSlot);
+    else if (slot == c_ctrSlot)
+        set.special |= RecompilerRegisterSet::c_ctr;
+    else
+        set.special |= RecompilerRegisterSet::c_xer;
+}
+
+void RecompilerRegisterPromotion::Analyse(const RecompilerIRFunction& function, RecompilerRegisterSet candidates)
+{
+    const auto& instructions = function.instructions;
+    const auto& blocks = function.blocks;
+
+    promoted = {};
+    entryLoads = {};
+    endStores = {};
+    stores.assign(instructions.size(), {});
+    loads.assign(instructions.size(), {});
+
+    constexpr uint32_t c_sync = RecompilerIRInstruction::c_call | RecompilerIRInstruction::c_exit;
+
+    candidates.special &= RecompilerRegisterSet::c_ctr | RecompilerRegisterSet::c_xer;
+
+    for (const auto& instruction : instructions)
+    {
+        // Hooks take the registers by reference, they would miss the copies printed around the instruction.
+        if (instruction.HasFlag(RecompilerIRInstruction::c_hook) && instruction.HasFlag(c_sync))
+            return;
+
+        // Anything written by a return is written after the registers are stored, like CTR of bdnzlr.
+        if (instruction.HasFlag(RecompilerIRInstruction::c_exit) && !instruction.HasFlag(RecompilerIRInstruction::c_call))
+            candidates -= instruction.defs;
+
+        // Same for calls that decrement CTR.
+        const uint32_t word = instruction.insn.instruction;
+        if (instruction.HasFlag(RecompilerIRInstruction::c_call) && PPC_OP(word) != PPC_OP_B && !(PPC_BO(word) & 0x4))
+            candidates.special &= ~RecompilerRegisterSet::c_ctr;
+    }
+
+    if (instructions.empty() || candidates.Empty())
+        return;
+
+    std::vector<std::vector<uint32_t>> predecessors(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        for (auto successor : blocks[i].successors)
+            predecessors[successor].push_back(uint32_t(i));
+    }
+
+    // Registers that may differ from the context, which is everything written since the last call or exit.
+    // The stores of the final iteration are the ones that stay.
+    std::vector<RecompilerRegisterSet> dirtyOut(blocks.size());
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            RecompilerRegisterSet dirty;
+            for (auto predecessor : predecessors[i])
+                dirty |= dirtyOut[predecessor];
+
+            for (size_t j = blocks[i].begin; j < blocks[i].end; j++)
+            {
+                const auto& instruction = instructions[j];
+                if (instruction.HasFlag(c_sync))
+                {
+                    stores[j] = dirty;
+                    dirty = {};
+                }
+                else
+                {
+                    dirty |= instruction.defs;
+                    dirty &= candidates;
+                }
+            }
+
+            if (dirty != dirtyOut[i])
+            {
+                dirtyOut[i] = dirty;
+                changed = true;
+            }
+        }
+    }
+
+    const auto& last = instructions.back();
+    if (!last.HasFlag(RecompilerIRInstruction::c_branch | RecompilerIRInstruction::c_exit | RecompilerIRInstruction::c_switch) ||
+        last.HasFlag(RecompilerIRInstruction::c_conditional | RecompilerIRInstruction::c_hook))
+    {
+        endStores = dirtyOut.back();
+    }
+
+    // Registers whose local holds a value that is needed later. Writes count as reads, since
+    // plenty of instructions only replace part of the register. Stores read the local too.
+    std::vector<RecompilerRegisterSet> liveIn(blocks.size());
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+
+        for (size_t i = blocks.size(); i-- > 0;)
+        {
+            RecompilerRegisterSet live;
+            if (i == blocks.size() - 1)
+                live = endStores;
+
+            for (auto successor : blocks[i].successors)
+                live |= liveIn[successor];
+
+            for (size_t j = blocks[i].end; j-- > blocks[i].begin;)
+            {
+                const auto& instruction = instructions[j];
+                if (instruction.HasFlag(RecompilerIRInstruction::c_call))
+                {
+                    loads[j] = live;
+                    live = instruction.operandUses;
+                    live |= stores[j];
+                }
+                else if (instruction.HasFlag(RecompilerIRInstruction::c_exit))
+                {
+                    live |= instruction.operandUses;
+                    live |= stores[j];
+                }
+                else
+                {
+                    live |= instruction.uses;
+                    live |= instruction.defs;
+                }
+
+                live &= candidates;
+            }
+
+            if (live != liveIn[i])
+            {
+                liveIn[i] = live;
+                changed = true;
+            }
+        }
+    }
+
+    entryLoads = liveIn[0];
+
+    // Promote the registers that are accessed more often than they are copied.
+    std::vector<uint32_t> accesses(c_slotCount);
+    std::vector<uint32_t> copies(c_slotCount);
+
+    auto count = [](std::vector<uint32_t>& counts, const RecompilerRegisterSet& set)
+        {
+            ForEachRegister(set, [&](size_t slot) { counts[slot]++; });
+        };
+
+    count(copies, entryLoads);
+    count(copies, endStores);
+
+    for (size_t i = 0; i < instructions.size(); i++)
+    {
+        const auto& instruction = instructions[i];
+
+        RecompilerRegisterSet accessed = instruction.operandUses;
+        if (!instruction.HasFlag(c_sync))
+            accessed |= instruction.defs;
+
+        accessed &= candidates;
+        count(accesses, accessed);
+        count(copies, stores[i]);
+        count(copies, loads[i]);
+    }
+
+    for (size_t slot = 0; slot < c_slotCount; slot++)
+    {
+        if (accesses[slot] > copies[slot])
+            AddRegister(promoted, slot);
+    }
+
+    entryLoads &= promoted;
+    endStores &= promoted;
+
+    for (size_t i = 0; i < instructions.size(); i++)
+    {
+        stores[i] &= promoted;
+        loads[i] &= promoted;
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "recompiler_ir.h"
+
+// Decides which guest registers of a function are kept in host locals instead of the
+// context. Calls and exits are the only places where other code can observe the context,
+// so promoted registers are loaded on entry, written back before those points when they
+// may have changed, and loaded again after calls when they're still needed.
+struct RecompilerRegisterPromotion
+{
+    // Registers printed as locals of the function.
+    RecompilerRegisterSet promoted;
+
+    // Loaded from the context at the start of the function.
+    RecompilerRegisterSet entryLoads;
+
+    // Written back before each instruction, and loaded again after each call.
+    std::vector<RecompilerRegisterSet> stores;
+    std::vector<RecompilerRegisterSet> loads;
+
+    // Written back when the last instruction falls off the end of the function.
+    RecompilerRegisterSet endStores;
+
+    // Only r, f, v, cr, ctr and xer of the candidates are considered.
+    void Analyse(const RecompilerIRFunction& function, RecompilerRegisterSet candidates);
+};
@@ -0,0 +1,80 @@
+#include "recompiler_writer.h"
+
+RecompilerWriter::RecompilerWriter(WriteFunction write)
+    : write(std::move(write))
+{
+    thread = std::thread(&RecompilerWriter::Run, this);
+}
+
+RecompilerWriter::~RecompilerWriter()
+{
+    Finish();
+}
+
+void RecompilerWriter::Push(std::string name, std::string& data)
+{
+    if (data.empty())
+        return;
+
+    std::unique_lock lock(mutex);
+
+    // A single file larger than the limit is still let through once the queue is empty.
+    entryWritten.wait(lock, [&]() { return pendingBytes == 0 || pendingBytes + data.size() <= c_maxPendingBytes; });
+
+    pendingBytes += data.size();
+
+    std::string buffer;
+    if (!spareBuffers.empty())
+    {
+        buffer = std::move(spareBuffers.back());
+        spareBuffers.pop_back();
+    }
+
+    std::swap(buffer, data);
+    entries.push_back({ std::move(name), std::move(buffer) });
+    entryAdded.notify_one();
+}
+
+void RecompilerWriter::Finish()
+{
+    {
+        std::lock_guard lock(mutex);
+        if (finished)
+            return;
+
+        finished = true;
+    }
+
+    entryAdded.notify_one();
+    thread.join();
+}
+
+void RecompilerWriter::Run()
+{
+    std::unique_lock lock(mutex);
+
+    while (true)
+    {
+        entryAdded.wait(lock, [&]() { return finished || !entries.empty(); });
+
+        if (entries.empty())
+            break;
+
+        Entry entry = std::move(entries.front());
+        entries.pop_front();
+
+        lock.unlock();
+        write(entry.name, entry.data);
+        lock.lock();
+
+        pendingBytes -= entry.data.size();
+
+        if (spareBuffers.size() < c_maxSpareBuffers)
+        {
+            entry.data.clear();
+            spareBuffers.push_back(std::move(entry.data));
+        }
+
+        entryWritten.notify_all();
+    }
+}
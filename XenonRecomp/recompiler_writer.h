@@ -0,0 +1,39 @@
+#pragma once
+
+// Writes generated files on a background thread so code generation can carry on while
+// the previous files reach the disk. Producers block once the queued data exceeds
+// c_maxPendingBytes, which keeps memory bounded no matter how large the image is.
+struct RecompilerWriter
+{
+    static constexpr size_t c_maxPendingBytes = 64 * 1024 * 1024;
+    static constexpr size_t c_maxSpareBuffers = 8;
+
+    using WriteFunction = std::function<void(const std::string_view& name, const std::string_view& data)>;
+
+    struct Entry
+    {
+        std::string name;
+        std::string data;
+    };
+
+    WriteFunction write;
+    std::deque<Entry> entries;
+    std::vector<std::string> spareBuffers;
+    size_t pendingBytes = 0;
+    bool finished = false;
+    std::mutex mutex;
+    std::condition_variable entryAdded;
+    std::condition_variable entryWritten;
+    std::thread thread;
+
+    RecompilerWriter(WriteFunction write);
+    ~RecompilerWriter();
+
+    // Queues the data for writing and leaves an empty buffer with reserved capacity in its place.
+    void Push(std::string name, std::string& data);
+
+    // Waits until every queued file is written.
+    void Finish();
+
+    void Run();
+};
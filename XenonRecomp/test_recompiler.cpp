@@ -2,6 +2,8 @@
 
 void TestRecompiler::Analyse(const std::string_view& testName)
 {
+    instructions.Build(image);
+
     for (const auto& section : image.sections)
     {
         if (!(section.flags & SectionFlags_Code))
@@ -21,7 +23,7 @@ void TestRecompiler::Analyse(const std::string_view& testName)
                 continue;
             }
 
-            auto& fn = functions.emplace_back(Function::Analyze(data, dataEnd - data, base));
+            auto& fn = functions.emplace_back(Function::Analyze(data, dataEnd - data, base, &instructions));
             image.symbols.emplace(fmt::format("{}_{:X}", testName, fn.base), fn.base, fn.size, Symbol_Function);
             
             base += fn.size;
@@ -40,11 +42,9 @@ void TestRecompiler::RecompileTests(const char* srcDirectoryPath, const char* ds
     {
         if (file.path().extension() == ".o")
         {
-            const auto exeFile = LoadFile(file.path().string().c_str());
-
             TestRecompiler recompiler;
             recompiler.config.outDirectoryPath = dstDirectoryPath;
-            recompiler.image = Image::ParseImage(exeFile.data(), exeFile.size());
+            recompiler.image = Image::ParseImage(file.path());
 
             auto stem = file.path().stem().string();
             recompiler.Analyse(stem);
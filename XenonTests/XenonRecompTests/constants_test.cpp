@@ -0,0 +1,106 @@
+#include "recompiler_test.h"
+
+using namespace ppc;
+
+// CTR value the constant propagation finds at the first bctrl of the function.
+static uint32_t FindCallTarget(const RecompilerTestImage& image, const RecompilerConfig& config, std::string_view name)
+{
+    RecompilerIRFunction ir;
+    ir.Build(image.FindFunction(name), image.image, image.instructions, config);
+
+    RecompilerConstantPropagation constants;
+    constants.Analyse(ir, image.image);
+
+    for (size_t i = 0; i < ir.instructions.size(); i++)
+    {
+        if (ir.instructions[i].insn.opcode != nullptr && ir.instructions[i].insn.opcode->id == PPC_INST_BCTRL)
+            return constants.ctrValues[i];
+    }
+
+    return 0;
+}
+
+bool ConstantsReadOnlyLoadTest()
+{
+    RecompilerTestCode code;
+    code.Begin("caller");
+    const uint32_t slot = code.AddData(0);
+    code << Lis(11, int32_t(slot >> 16)) << Ori(11, 11, slot & 0xFFFF) << Lwz(11, 11, 0) << Mtctr(11) << c_bctrl << c_blr;
+    const uint32_t callee = code.Begin("callee");
+    code << c_blr;
+
+    code.sections.rdata[0] = callee;
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+
+    TEST_CHECK(Contains(RecompileTestFunction(image, config, "caller"), "\tPPC_CALL_INDIRECT_FUNC(ctx.ctr.u32);\n"));
+
+    config.devirtualizeCalls = true;
+    TEST_CHECK(FindCallTarget(image, config, "caller") == callee);
+
+    const std::string out = RecompileTestFunction(image, config, "caller");
+    TEST_CHECK(Contains(out, "\tcallee(ctx, base);\n"));
+    TEST_CHECK(!Contains(out, "PPC_CALL_INDIRECT_FUNC"));
+
+    return true;
+}
+
+bool ConstantsConflictingJoinTest()
+{
+    // Each path loads a different function into r11 before they meet at the call.
+    RecompilerTestCode code;
+    code.Begin("caller");
+    code << Cmpwi(0, 3, 0) << Beq(0, 16) << Lis(11, 0) << Ori(11, 11, 0) << B(12) << Lis(11, 0) << Ori(11, 11, 0);
+    code << Mtctr(11) << c_bctrl << c_blr;
+    const uint32_t first = code.Begin("first");
+    code << c_blr;
+    const uint32_t second = code.Begin("second");
+    code << c_blr;
+
+    code.sections.text[2] = Lis(11, int32_t(first >> 16));
+    code.sections.text[3] = Ori(11, 11, first & 0xFFFF);
+    code.sections.text[5] = Lis(11, int32_t(second >> 16));
+    code.sections.text[6] = Ori(11, 11, second & 0xFFFF);
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+    config.devirtualizeCalls = true;
+
+    TEST_CHECK(FindCallTarget(image, config, "caller") == 0);
+    TEST_CHECK(Contains(RecompileTestFunction(image, config, "caller"), "\tPPC_CALL_INDIRECT_FUNC(ctx.ctr.u32);\n"));
+
+    // The same code with both paths agreeing is devirtualized.
+    code.sections.text[5] = code.sections.text[2];
+    code.sections.text[6] = code.sections.text[3];
+
+    RecompilerTestImage agreeingImage(code);
+    TEST_CHECK(FindCallTarget(agreeingImage, config, "caller") == first);
+
+    return true;
+}
+
+bool ConstantsUnloadedSectionTest()
+{
+    // The section name table isn't loaded, so it sits at address 0 without being read-only data.
+    RecompilerTestCode code;
+    code.Begin("caller");
+    code << Li(11, 0) << Lwz(11, 11, 0) << Mtctr(11) << c_bctrl << c_blr;
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+    config.devirtualizeCalls = true;
+
+    const Section* section = nullptr;
+    for (const auto& candidate : image.image.sections)
+    {
+        if (candidate.name == ".shstrtab")
+            section = &candidate;
+    }
+
+    TEST_CHECK(section != nullptr && section->base == 0);
+    TEST_CHECK((section->flags & SectionFlags_ReadOnly) == 0);
+    TEST_CHECK(FindCallTarget(image, config, "caller") == 0);
+
+    return true;
+}
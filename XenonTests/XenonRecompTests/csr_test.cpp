@@ -0,0 +1,60 @@
+#include "recompiler_test.h"
+
+using namespace ppc;
+
+bool CSRStateAfterCallTest()
+{
+    RecompilerTestCode code;
+    const uint32_t caller = code.Begin("caller");
+    code << Fadd(1, 1, 2) << 0 << Vaddfp(3, 3, 4) << c_blr;
+    const uint32_t callee = code.Begin("callee");
+    code << Vaddfp(1, 1, 2) << c_blr;
+
+    code.sections.text[1] = Bl(int32_t(callee - (caller + 4)));
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+
+    const std::string unknown = RecompileTestFunction(image, config, "caller");
+    TEST_CHECK(Contains(unknown, "\tcallee(ctx, base);\n\t// vaddfp v3,v3,v4\n\tctx.fpscr.enableFlushMode();\n"));
+
+    // The callee returns in VMX mode, so the caller doesn't switch again after calling it.
+    config.propagateCsrState = true;
+    RecompilerCSRAnalysis csrAnalysis;
+    csrAnalysis.Analyse(image.functions, image.image, image.instructions, config, 1);
+    TEST_CHECK(csrAnalysis.FindSummary(callee) == RecompilerCSRValue::VMX);
+    TEST_CHECK(csrAnalysis.FindSummary(caller) == RecompilerCSRValue::VMX);
+
+    const std::string known = RecompileTestFunction(image, config, "caller");
+    TEST_CHECK(Contains(known, "\tctx.fpscr.disableFlushMode();\n"));
+    TEST_CHECK(Contains(known, "\tcallee(ctx, base);\n\t// vaddfp v3,v3,v4\n\t_mm_store_ps("));
+    TEST_CHECK(!Contains(known, "enableFlushMode"));
+
+    return true;
+}
+
+bool CSRStateAtJoinTest()
+{
+    // Both paths end up in the block at the end, one of them in FPU mode and the other in VMX mode.
+    RecompilerTestCode code;
+    code.Begin("disagree");
+    code << Cmpwi(0, 3, 0) << Beq(0, 12) << Fadd(1, 1, 2) << B(8) << Vaddfp(1, 1, 2);
+    const uint32_t disagreeJoin = code.Address();
+    code << Vaddfp(3, 3, 4) << c_blr;
+    code.Begin("agree");
+    code << Cmpwi(0, 3, 0) << Beq(0, 12) << Vaddfp(1, 1, 2) << B(8) << Vaddfp(1, 1, 2);
+    const uint32_t agreeJoin = code.Address();
+    code << Vaddfp(3, 3, 4) << c_blr;
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+    config.propagateCsrState = true;
+
+    const std::string disagree = RecompileTestFunction(image, config, "disagree");
+    TEST_CHECK(Contains(disagree, fmt::format("loc_{:X}:\n\t// vaddfp v3,v3,v4\n\tctx.fpscr.enableFlushMode();\n", disagreeJoin)));
+
+    const std::string agree = RecompileTestFunction(image, config, "agree");
+    TEST_CHECK(Contains(agree, fmt::format("loc_{:X}:\n\t// vaddfp v3,v3,v4\n\t_mm_store_ps(", agreeJoin)));
+
+    return true;
+}
@@ -0,0 +1,64 @@
+#include "recompiler_test.h"
+
+using namespace ppc;
+
+// Analyses the image like a run of XenonRecomp with the given explicit functions would, and
+// returns the symbols it saved to the database.
+static std::vector<AnalysisDatabase::FunctionSymbol> AnalyseWithDatabase(const SyntheticImage& synthetic,
+    const std::filesystem::path& databaseFilePath, const std::vector<std::pair<uint32_t, uint32_t>>& functions)
+{
+    Recompiler recompiler;
+    recompiler.config.analysisDatabaseFilePath = databaseFilePath.string();
+    for (auto& [address, size] : functions)
+        recompiler.config.functions.emplace(address, size);
+
+    recompiler.image = Image::ParseImage(synthetic.file.data(), synthetic.file.size());
+    recompiler.Analyse();
+
+    AnalysisDatabase database;
+    if (!database.Load(databaseFilePath))
+        return {};
+
+    return database.symbols;
+}
+
+static bool operator==(const AnalysisDatabase::FunctionSymbol& lhs, const AnalysisDatabase::FunctionSymbol& rhs)
+{
+    return lhs.name == rhs.name && lhs.address == rhs.address && lhs.size == rhs.size;
+}
+
+bool DatabaseConfigChangeTest()
+{
+    RecompilerTestCode code;
+    const uint32_t first = code.Begin("first");
+    code << Li(3, 1) << Li(4, 2) << Li(5, 3) << c_blr;
+    code.Begin("second");
+    code << Li(3, 1) << c_blr;
+
+    const SyntheticImage synthetic = BuildSyntheticImage(code.sections);
+    const std::filesystem::path databaseFilePath = std::filesystem::temp_directory_path() / "XenonRecompTests.db";
+    const std::filesystem::path freshDatabaseFilePath = std::filesystem::temp_directory_path() / "XenonRecompTests.fresh.db";
+    std::filesystem::remove(databaseFilePath);
+    std::filesystem::remove(freshDatabaseFilePath);
+
+    // The first run splits a function in the middle, the second one doesn't anymore.
+    const auto firstSymbols = AnalyseWithDatabase(synthetic, databaseFilePath, { { first + 8, 8 } });
+    const auto secondSymbols = AnalyseWithDatabase(synthetic, databaseFilePath, {});
+    const auto freshSymbols = AnalyseWithDatabase(synthetic, freshDatabaseFilePath, {});
+
+    std::filesystem::remove(databaseFilePath);
+    std::filesystem::remove(freshDatabaseFilePath);
+
+    const std::string splitName = fmt::format("sub_{:X}", first + 8);
+    auto hasSplit = [&](const std::vector<AnalysisDatabase::FunctionSymbol>& symbols)
+        {
+            return std::any_of(symbols.begin(), symbols.end(), [&](auto& symbol) { return symbol.name == splitName; });
+        };
+
+    TEST_CHECK(hasSplit(firstSymbols));
+    TEST_CHECK(!freshSymbols.empty());
+    TEST_CHECK(!hasSplit(secondSymbols));
+    TEST_CHECK(secondSymbols == freshSymbols);
+
+    return true;
+}
@@ -0,0 +1,51 @@
+#include "recompiler_test.h"
+
+using namespace ppc;
+
+bool FlagLivenessCrTest()
+{
+    RecompilerTestCode code;
+    code.Begin("overwritten");
+    code << Add(3, 3, 4, true) << Cmpwi(0, 3, 0) << Cmpwi(0, 3, 1) << Beq(0, 8) << Li(3, 1) << c_blr;
+    code.Begin("read");
+    code << Add(3, 3, 4, true) << Beq(0, 8) << Li(3, 1) << c_blr;
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+
+    const std::string plain = RecompileTestFunction(image, config, "overwritten");
+    TEST_CHECK(Count(plain, "ctx.cr0.compare<int32_t>(") == 3);
+
+    // Only the last compare before the branch is read.
+    config.eliminateDeadFlags = true;
+    const std::string overwritten = RecompileTestFunction(image, config, "overwritten");
+    TEST_CHECK(Count(overwritten, "ctx.cr0.compare<int32_t>(") == 1);
+    TEST_CHECK(Contains(overwritten, "\t// cmpwi r3,1\n\tctx.cr0.compare<int32_t>(ctx.r3.s32, 1, ctx.xer);\n"));
+    TEST_CHECK(Contains(overwritten, "\tctx.r3.u64 = ctx.r3.u64 + ctx.r4.u64;\n\t// cmpwi r3,0\n\t// cmpwi r3,1\n"));
+
+    const std::string read = RecompileTestFunction(image, config, "read");
+    TEST_CHECK(Contains(read, "\tctx.r3.u64 = ctx.r3.u64 + ctx.r4.u64;\n\tctx.cr0.compare<int32_t>(ctx.r3.s32, 0, ctx.xer);\n"));
+
+    return true;
+}
+
+bool FlagLivenessCarryTest()
+{
+    RecompilerTestCode code;
+    code.Begin("carry");
+    code << Addic(3, 3, 1) << Addic(3, 3, 1) << Adde(5, 5, 6) << c_blr;
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+
+    const std::string plain = RecompileTestFunction(image, config, "carry");
+    TEST_CHECK(Count(plain, "\tctx.xer.ca = ctx.r3.u32 > 4294967294;\n") == 2);
+
+    // The first carry is overwritten by the second, which adde reads.
+    config.eliminateDeadFlags = true;
+    const std::string out = RecompileTestFunction(image, config, "carry");
+    TEST_CHECK(Count(out, "\tctx.xer.ca = ctx.r3.u32 > 4294967294;\n") == 1);
+    TEST_CHECK(Contains(out, "\t// addic r3,r3,1\n\tctx.r3.s64 = ctx.r3.s64 + 1;\n\t// addic r3,r3,1\n\tctx.xer.ca = ctx.r3.u32 > 4294967294;\n"));
+
+    return true;
+}
@@ -0,0 +1,53 @@
+#include "recompiler_test.h"
+
+bool PromotionLoadsAndStoresTest();
+bool PromotionReloadsAfterCallsTest();
+bool PromotionMismatchFallbackTest();
+bool FlagLivenessCrTest();
+bool FlagLivenessCarryTest();
+bool CSRStateAfterCallTest();
+bool CSRStateAtJoinTest();
+bool ConstantsReadOnlyLoadTest();
+bool ConstantsConflictingJoinTest();
+bool ConstantsUnloadedSectionTest();
+bool TailCallDirectTest();
+bool TailCallDevirtualizedTest();
+bool TailCallExclusionsTest();
+bool DatabaseConfigChangeTest();
+
+static const RecompilerTest Tests[] =
+{
+    { "promotion_loads_and_stores", PromotionLoadsAndStoresTest },
+    { "promotion_reloads_after_calls", PromotionReloadsAfterCallsTest },
+    { "promotion_mismatch_fallback", PromotionMismatchFallbackTest },
+    { "flag_liveness_cr", FlagLivenessCrTest },
+    { "flag_liveness_carry", FlagLivenessCarryTest },
+    { "csr_state_after_call", CSRStateAfterCallTest },
+    { "csr_state_at_join", CSRStateAtJoinTest },
+    { "constants_read_only_load", ConstantsReadOnlyLoadTest },
+    { "constants_conflicting_join", ConstantsConflictingJoinTest },
+    { "constants_unloaded_section", ConstantsUnloadedSectionTest },
+    { "tail_call_direct", TailCallDirectTest },
+    { "tail_call_devirtualized", TailCallDevirtualizedTest },
+    { "tail_call_exclusions", TailCallExclusionsTest },
+    { "database_config_change", DatabaseConfigChangeTest },
+};
+
+int main(int argc, char* argv[])
+{
+    size_t failedCount = 0;
+
+    for (const auto& test : Tests)
+    {
+        if (argc >= 2 && test.name != argv[1])
+            continue;
+
+        const bool passed = test.function();
+        fmt::println("{} {}", passed ? "PASSED" : "FAILED", test.name);
+
+        if (!passed)
+            failedCount++;
+    }
+
+    return failedCount == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
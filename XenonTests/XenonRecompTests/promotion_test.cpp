@@ -0,0 +1,84 @@
+#include "recompiler_test.h"
+
+using namespace ppc;
+
+bool PromotionLoadsAndStoresTest()
+{
+    RecompilerTestCode code;
+    code.Begin("counter");
+    code << Addi(3, 3, 1) << Addi(3, 3, 1) << Addi(3, 3, 1) << c_blr;
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+
+    const std::string plain = RecompileTestFunction(image, config, "counter");
+    TEST_CHECK(!Contains(plain, "PPCRegister r3{};"));
+    TEST_CHECK(Count(plain, "ctx.r3.s64 + 1;") == 3);
+
+    // Loaded once on entry and stored once before the return.
+    config.promoteRegisters = true;
+    const std::string promoted = RecompileTestFunction(image, config, "counter");
+    TEST_CHECK(Contains(promoted, "\tPPCRegister r3{};\n\tr3 = ctx.r3;\n"));
+    TEST_CHECK(Count(promoted, "\tr3.s64 = r3.s64 + 1;\n") == 3);
+    TEST_CHECK(Contains(promoted, "\tctx.r3 = r3;\n\t// blr"));
+    TEST_CHECK(Count(promoted, "ctx.r3") == 2);
+
+    return true;
+}
+
+bool PromotionReloadsAfterCallsTest()
+{
+    RecompilerTestCode code;
+    code.Begin("caller");
+    code << Addi(31, 31, 1) << Addi(31, 31, 1) << Addi(31, 31, 1);
+    const size_t call = code.sections.text.size();
+    code << 0;
+    code << Addi(31, 31, 1) << Addi(31, 31, 1) << Addi(31, 31, 1) << c_blr;
+    const uint32_t callee = code.Begin("callee");
+    code << c_blr;
+
+    code.sections.text[call] = Bl(int32_t(callee - (c_syntheticTextBase + call * sizeof(uint32_t))));
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+    config.promoteRegisters = true;
+
+    // The callee sees the new value, and the caller picks up whatever it left behind.
+    const std::string out = RecompileTestFunction(image, config, "caller");
+    TEST_CHECK(Contains(out, "\tctx.r31 = r31;\n\t// bl "));
+    TEST_CHECK(Contains(out, "\tcallee(ctx, base);\n\tr31 = ctx.r31;\n"));
+    TEST_CHECK(Count(out, "\tr31 = ctx.r31;\n") == 2);
+    TEST_CHECK(Count(out, "\tctx.r31 = r31;\n") == 2);
+
+    return true;
+}
+
+bool PromotionMismatchFallbackTest()
+{
+    RecompilerTestCode code;
+    code.Begin("counter");
+    code << Addi(3, 3, 1) << Addi(3, 3, 1) << Addi(3, 3, 1) << Addi(3, 3, 1) << c_blr;
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+    const std::string plain = RecompileTestFunction(image, config, "counter");
+
+    config.promoteRegisters = true;
+    TEST_CHECK(RecompileTestFunction(image, config, "counter") != plain);
+
+    RecompilerEmitter emitter(image.image, image.instructions, config);
+    emitter.ir.Build(image.functions[0], image.image, image.instructions, config);
+
+    // An IR that misses the accesses of the first instruction still promotes r3, but the
+    // printer notices and prints the whole function again without promoted registers.
+    auto& first = emitter.ir.instructions[0];
+    first.uses = {};
+    first.defs = {};
+    first.operandUses = {};
+
+    TEST_CHECK(emitter.RecompileIR(image.functions[0]));
+    TEST_CHECK(emitter.out == plain);
+    TEST_CHECK(!emitter.promotionDisabled);
+
+    return true;
+}
@@ -0,0 +1,59 @@
+#include "recompiler_test.h"
+
+uint32_t RecompilerTestCode::Begin(std::string_view name)
+{
+    functions.emplace_back(name, sections.text.size());
+    return Address();
+}
+
+uint32_t RecompilerTestCode::AddData(uint32_t value)
+{
+    sections.rdata.push_back(value);
+    return sections.rdataBase + uint32_t((sections.rdata.size() - 1) * sizeof(uint32_t));
+}
+
+RecompilerTestImage::RecompilerTestImage(const RecompilerTestCode& code)
+    : synthetic(BuildSyntheticImage(code.sections))
+{
+    image = Image::ParseImage(synthetic.file.data(), synthetic.file.size());
+    instructions.Build(image);
+
+    for (size_t i = 0; i < code.functions.size(); i++)
+    {
+        const size_t end = i + 1 < code.functions.size() ? code.functions[i + 1].second : code.sections.text.size();
+        const uint32_t base = c_syntheticTextBase + uint32_t(code.functions[i].second * sizeof(uint32_t));
+        const uint32_t size = uint32_t((end - code.functions[i].second) * sizeof(uint32_t));
+
+        functions.emplace_back(base, size);
+        image.symbols.emplace(code.functions[i].first, base, size, Symbol_Function);
+    }
+
+    image.symbols.freeze();
+}
+
+const Function& RecompilerTestImage::FindFunction(std::string_view name) const
+{
+    for (const auto& fn : functions)
+    {
+        if (image.symbols.find(fn.base)->name == name)
+            return fn;
+    }
+
+    fmt::println("ERROR: Unknown test function {}", name);
+    std::abort();
+}
+
+std::string RecompileTestFunction(const RecompilerTestImage& image, const RecompilerConfig& config, std::string_view name)
+{
+    RecompilerCSRAnalysis csrAnalysis;
+    RecompilerEmitter emitter(image.image, image.instructions, config);
+
+    if (config.propagateCsrState)
+    {
+        csrAnalysis.Analyse(image.functions, image.image, image.instructions, config, 1);
+        emitter.csrAnalysis = &csrAnalysis;
+    }
+
+    emitter.Recompile(image.FindFunction(name));
+    return std::move(emitter.out);
+}
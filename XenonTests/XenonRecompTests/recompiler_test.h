@@ -0,0 +1,108 @@
+#pragma once
+
+#include <recompiler.h>
+#include <synthetic_image.h>
+
+struct RecompilerTest
+{
+    std::string_view name;
+    bool (*function)();
+};
+
+#define TEST_CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            fmt::println("{}:{}: check failed: {}", __FILE__, __LINE__, #condition); \
+            return false; \
+        } \
+    } while (0)
+
+// Handwritten code, split into functions that start at the marked instructions.
+struct RecompilerTestCode
+{
+    SyntheticSections sections{ {}, 0x82100000 };
+    std::vector<std::pair<std::string, size_t>> functions;
+
+    // Starts a function at the next instruction and returns its address.
+    uint32_t Begin(std::string_view name);
+
+    uint32_t Address() const
+    {
+        return c_syntheticTextBase + uint32_t(sections.text.size() * sizeof(uint32_t));
+    }
+
+    RecompilerTestCode& operator<<(uint32_t instruction)
+    {
+        sections.text.push_back(instruction);
+        return *this;
+    }
+
+    // Places a word in .rdata and returns its address.
+    uint32_t AddData(uint32_t value);
+};
+
+// The image of the code with a function symbol for each of its functions.
+struct RecompilerTestImage
+{
+    SyntheticImage synthetic;
+    Image image;
+    InstructionStore instructions;
+    std::vector<Function> functions;
+
+    explicit RecompilerTestImage(const RecompilerTestCode& code);
+
+    const Function& FindFunction(std::string_view name) const;
+};
+
+// Prints a single function of the image with the given config, which runs the CSR analysis
+// over every function of the image first if it's enabled.
+std::string RecompileTestFunction(const RecompilerTestImage& image, const RecompilerConfig& config, std::string_view name);
+
+inline bool Contains(std::string_view text, std::string_view value)
+{
+    return text.find(value) != std::string_view::npos;
+}
+
+inline size_t Count(std::string_view text, std::string_view value)
+{
+    size_t count = 0;
+    for (size_t i = text.find(value); i != std::string_view::npos; i = text.find(value, i + value.size()))
+        count++;
+
+    return count;
+}
+
+// Instruction encodings for the tests.
+namespace ppc
+{
+    inline uint32_t DForm(uint32_t op, uint32_t d, uint32_t a, int32_t immediate) { return (op << 26) | (d << 21) | (a << 16) | (uint32_t(immediate) & 0xFFFF); }
+    inline uint32_t XForm(uint32_t op, uint32_t d, uint32_t a, uint32_t b, uint32_t xo, uint32_t rc = 0) { return (op << 26) | (d << 21) | (a << 16) | (b << 11) | (xo << 1) | rc; }
+    inline uint32_t AForm(uint32_t op, uint32_t d, uint32_t a, uint32_t b, uint32_t c, uint32_t xo) { return (op << 26) | (d << 21) | (a << 16) | (b << 11) | (c << 6) | (xo << 1); }
+
+    inline uint32_t Li(uint32_t d, int32_t immediate) { return DForm(14, d, 0, immediate); }
+    inline uint32_t Lis(uint32_t d, int32_t immediate) { return DForm(15, d, 0, immediate); }
+    inline uint32_t Addi(uint32_t d, uint32_t a, int32_t immediate) { return DForm(14, d, a, immediate); }
+    inline uint32_t Addic(uint32_t d, uint32_t a, int32_t immediate) { return DForm(12, d, a, immediate); }
+    inline uint32_t Ori(uint32_t a, uint32_t s, uint32_t immediate) { return DForm(24, s, a, int32_t(immediate)); }
+    inline uint32_t Lwz(uint32_t d, uint32_t a, int32_t offset) { return DForm(32, d, a, offset); }
+    inline uint32_t Stw(uint32_t s, uint32_t a, int32_t offset) { return DForm(36, s, a, offset); }
+    inline uint32_t Cmpwi(uint32_t cr, uint32_t a, int32_t immediate) { return DForm(11, cr << 2, a, immediate); }
+    inline uint32_t Add(uint32_t d, uint32_t a, uint32_t b, bool record = false) { return XForm(31, d, a, b, 266, record); }
+    inline uint32_t Adde(uint32_t d, uint32_t a, uint32_t b) { return XForm(31, d, a, b, 138); }
+    inline uint32_t Mr(uint32_t a, uint32_t s) { return XForm(31, s, a, s, 444); }
+    inline uint32_t Mtctr(uint32_t s) { return XForm(31, s, 9, 0, 467); }
+    inline uint32_t Fadd(uint32_t d, uint32_t a, uint32_t b) { return AForm(63, d, a, b, 0, 21); }
+    inline uint32_t Vaddfp(uint32_t d, uint32_t a, uint32_t b) { return (4 << 26) | (d << 21) | (a << 16) | (b << 11) | 10; }
+
+    // Branch offsets are relative to the branch instruction.
+    inline uint32_t B(int32_t offset) { return (18 << 26) | (uint32_t(offset) & 0x3FFFFFC); }
+    inline uint32_t Bl(int32_t offset) { return B(offset) | 1; }
+    inline uint32_t Bc(uint32_t bo, uint32_t bi, int32_t offset) { return (16 << 26) | (bo << 21) | (bi << 16) | (uint32_t(offset) & 0xFFFC); }
+    inline uint32_t Beq(uint32_t cr, int32_t offset) { return Bc(12, cr * 4 + 2, offset); }
+
+    constexpr uint32_t c_blr = 0x4E800020;
+    constexpr uint32_t c_bctr = 0x4E800420;
+    constexpr uint32_t c_bctrl = 0x4E800421;
+}
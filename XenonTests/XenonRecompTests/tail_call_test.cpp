@@ -0,0 +1,94 @@
+#include "recompiler_test.h"
+
+using namespace ppc;
+
+bool TailCallDirectTest()
+{
+    RecompilerTestCode code;
+    const uint32_t caller = code.Begin("caller");
+    code << Cmpwi(0, 3, 0) << 0 << 0;
+    const uint32_t callee = code.Begin("callee");
+    code << c_blr;
+
+    code.sections.text[1] = Beq(0, int32_t(callee - (caller + 4)));
+    code.sections.text[2] = B(int32_t(callee - (caller + 8)));
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+
+    const std::string plain = RecompileTestFunction(image, config, "caller");
+    TEST_CHECK(!Contains(plain, "PPC_TAIL_CALL_FUNC"));
+    TEST_CHECK(Contains(plain, "\tif (ctx.cr0.eq) {\n\t\tcallee(ctx, base);\n\t\treturn;\n\t}\n"));
+
+    config.guaranteedTailCalls = true;
+    const std::string out = RecompileTestFunction(image, config, "caller");
+    TEST_CHECK(Contains(out, "\tif (ctx.cr0.eq) {\n\t\tPPC_TAIL_CALL_FUNC(callee);\n\t}\n"));
+    TEST_CHECK(Contains(out, "\t// b 0x8200100c\n\tPPC_TAIL_CALL_FUNC(callee);\n"));
+    TEST_CHECK(!Contains(out, "callee(ctx, base);"));
+
+    return true;
+}
+
+bool TailCallDevirtualizedTest()
+{
+    RecompilerTestCode code;
+    const uint32_t callee = code.Begin("callee");
+    code << c_blr;
+    code.Begin("caller");
+    code << Lis(11, int32_t(callee >> 16)) << Ori(11, 11, callee & 0xFFFF) << Mtctr(11) << c_bctr;
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+    config.devirtualizeCalls = true;
+
+    TEST_CHECK(Contains(RecompileTestFunction(image, config, "caller"), "\t// bctr \n\tcallee(ctx, base);\n\treturn;\n"));
+
+    config.guaranteedTailCalls = true;
+    const std::string out = RecompileTestFunction(image, config, "caller");
+    TEST_CHECK(Contains(out, "\t// bctr \n\tPPC_TAIL_CALL_FUNC(callee);\n"));
+    TEST_CHECK(!Contains(out, "return;"));
+
+    return true;
+}
+
+bool TailCallExclusionsTest()
+{
+    // longjmp and setjmp are printed inline, and __rest helpers are left out with nonvolatile locals.
+    RecompilerTestCode code;
+    const uint32_t longJmp = code.Begin("longjmp");
+    code << c_blr;
+    const uint32_t setJmp = code.Begin("setjmp");
+    code << c_blr;
+    const uint32_t rest = code.Begin("__restgprlr_29");
+    code << c_blr;
+    const uint32_t callsLongJmp = code.Begin("calls_longjmp");
+    code << B(int32_t(longJmp - callsLongJmp));
+    const uint32_t callsSetJmp = code.Begin("calls_setjmp");
+    code << B(int32_t(setJmp - callsSetJmp));
+    const uint32_t callsRest = code.Begin("calls_rest");
+    code << B(int32_t(rest - callsRest));
+
+    RecompilerTestImage image(code);
+    RecompilerConfig config;
+    config.guaranteedTailCalls = true;
+    config.longJmpAddress = longJmp;
+    config.setJmpAddress = setJmp;
+
+    const std::string longJmpOut = RecompileTestFunction(image, config, "calls_longjmp");
+    TEST_CHECK(!Contains(longJmpOut, "PPC_TAIL_CALL_FUNC"));
+    TEST_CHECK(Contains(longJmpOut, "\tlongjmp(*reinterpret_cast<jmp_buf*>(base + ctx.r3.u32), ctx.r4.s32);\n\treturn;\n"));
+
+    const std::string setJmpOut = RecompileTestFunction(image, config, "calls_setjmp");
+    TEST_CHECK(!Contains(setJmpOut, "PPC_TAIL_CALL_FUNC"));
+    TEST_CHECK(Contains(setJmpOut, "setjmp(*reinterpret_cast<jmp_buf*>(base + ctx.r3.u32));\n"));
+
+    TEST_CHECK(Contains(RecompileTestFunction(image, config, "calls_rest"), "\tPPC_TAIL_CALL_FUNC(__restgprlr_29);\n"));
+
+    config.nonVolatileRegistersAsLocalVariables = true;
+    const std::string restOut = RecompileTestFunction(image, config, "calls_rest");
+    TEST_CHECK(!Contains(restOut, "PPC_TAIL_CALL_FUNC"));
+    TEST_CHECK(!Contains(restOut, "__restgprlr_29(ctx, base);"));
+    TEST_CHECK(Contains(restOut, "\t// b 0x82001008\n\treturn;\n"));
+
+    return true;
+}
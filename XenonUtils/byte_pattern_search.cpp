@@ -0,0 +1,205 @@
+#include "byte_pattern_search.h"
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BYTE_PATTERN_SEARCH_SSE2
+#endif
+
+bool BytePattern::Parse(std::string_view text, BytePattern& out)
+{
+    out.bytes.clear();
+    out.mask.clear();
+
+    size_t i = 0;
+    while (i < text.size())
+    {
+        if (text[i] == ' ' || text[i] == '\t')
+        {
+            i++;
+            continue;
+        }
+
+        size_t end = i;
+        while (end < text.size() && text[end] != ' ' && text[end] != '\t')
+            end++;
+
+        auto token = text.substr(i, end - i);
+        if (token == "??" || token == "?")
+        {
+            out.bytes.push_back(0);
+            out.mask.push_back(0);
+        }
+        else
+        {
+            uint8_t value{};
+            auto result = std::from_chars(token.data(), token.data() + token.size(), value, 16);
+            if (token.size() > 2 || result.ec != std::errc() || result.ptr != token.data() + token.size())
+                return false;
+
+            out.bytes.push_back(value);
+            out.mask.push_back(0xFF);
+        }
+
+        i = end;
+    }
+
+    return !out.bytes.empty();
+}
+
+size_t BytePatternSearch::Add(BytePattern pattern)
+{
+    assert(!pattern.bytes.empty() && pattern.bytes.size() == pattern.mask.size());
+
+    // Keep wildcard bytes zero so matching only needs to mask the data.
+    for (size_t i = 0; i < pattern.bytes.size(); i++)
+        pattern.bytes[i] &= pattern.mask[i];
+
+    patterns.emplace_back(std::move(pattern));
+    return patterns.size() - 1;
+}
+
+size_t BytePatternSearch::Add(std::string_view name, const uint8_t* bytes, size_t size)
+{
+    BytePattern pattern;
+    pattern.name = name;
+    pattern.bytes.assign(bytes, bytes + size);
+    pattern.mask.assign(size, 0xFF);
+    return Add(std::move(pattern));
+}
+
+void BytePatternSearch::Search(const uint8_t* data, size_t size, const std::function<bool(size_t, size_t)>& function) const
+{
+    // Patterns that start with the same two bytes share a filter.
+    struct Prefix
+    {
+        uint8_t bytes[2];
+        uint8_t mask[2];
+        std::vector<size_t> patterns;
+    };
+
+    std::vector<Prefix> prefixes;
+    for (size_t i = 0; i < patterns.size(); i++)
+    {
+        const auto& pattern = patterns[i];
+        uint8_t bytes[2]{ pattern.bytes[0], 0 };
+        uint8_t mask[2]{ pattern.mask[0], 0 };
+        if (pattern.bytes.size() > 1)
+        {
+            bytes[1] = pattern.bytes[1];
+            mask[1] = pattern.mask[1];
+        }
+
+        auto it = std::find_if(prefixes.begin(), prefixes.end(), [&](const Prefix& prefix)
+            {
+                return memcmp(prefix.bytes, bytes, 2) == 0 && memcmp(prefix.mask, mask, 2) == 0;
+            });
+
+        if (it == prefixes.end())
+        {
+            it = prefixes.emplace(prefixes.end());
+            memcpy(it->bytes, bytes, 2);
+            memcpy(it->mask, mask, 2);
+        }
+
+        it->patterns.push_back(i);
+    }
+
+    // Returns false once the callback stops the search.
+    auto check = [&](const Prefix& prefix, size_t offset)
+        {
+            for (size_t index : prefix.patterns)
+            {
+                const auto& pattern = patterns[index];
+                if (pattern.bytes.size() > size - offset)
+                    continue;
+
+                size_t i = 0;
+                while (i < pattern.bytes.size() && (data[offset + i] & pattern.mask[i]) == pattern.bytes[i])
+                    i++;
+
+                if (i == pattern.bytes.size() && !function(offset, index))
+                    return false;
+            }
+
+            return true;
+        };
+
+    size_t offset = 0;
+
+#ifdef BYTE_PATTERN_SEARCH_SSE2
+    struct PrefixVector
+    {
+        __m128i bytes[2];
+        __m128i mask[2];
+    };
+
+    std::vector<PrefixVector> vectors(prefixes.size());
+    for (size_t i = 0; i < prefixes.size(); i++)
+    {
+        for (size_t j = 0; j < 2; j++)
+        {
+            vectors[i].bytes[j] = _mm_set1_epi8(char(prefixes[i].bytes[j]));
+            vectors[i].mask[j] = _mm_set1_epi8(char(prefixes[i].mask[j]));
+        }
+    }
+
+    // The second load reads one byte ahead.
+    for (; offset + 17 <= size; offset += 16)
+    {
+        const __m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+        const __m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset + 1));
+
+        for (size_t i = 0; i < prefixes.size(); i++)
+        {
+            const auto& vector = vectors[i];
+            const __m128i matches = _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_and_si128(first, vector.mask[0]), vector.bytes[0]),
+                _mm_cmpeq_epi8(_mm_and_si128(second, vector.mask[1]), vector.bytes[1]));
+
+            uint32_t bits = uint32_t(_mm_movemask_epi8(matches));
+            for (size_t j = 0; bits != 0; j++, bits >>= 1)
+            {
+                if ((bits & 1) != 0 && !check(prefixes[i], offset + j))
+                    return;
+            }
+        }
+    }
+#endif
+
+    for (; offset < size; offset++)
+    {
+        for (const auto& prefix : prefixes)
+        {
+            const uint8_t next = offset + 1 < size ? data[offset + 1] : 0;
+            if ((data[offset] & prefix.mask[0]) == prefix.bytes[0] && (next & prefix.mask[1]) == prefix.bytes[1] && !check(prefix, offset))
+                return;
+        }
+    }
+}
+
+std::vector<size_t> BytePatternSearch::FindFirst(const uint8_t* data, size_t size) const
+{
+    std::vector<size_t> offsets(patterns.size(), SIZE_MAX);
+    size_t remaining = patterns.size();
+
+    if (remaining != 0)
+    {
+        Search(data, size, [&](size_t offset, size_t index)
+            {
+                if (offsets[index] == SIZE_MAX)
+                {
+                    offsets[index] = offset;
+                    remaining--;
+                }
+
+                return remaining != 0;
+            });
+    }
+
+    return offsets;
+}
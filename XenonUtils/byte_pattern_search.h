@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * \brief Byte signature, where bytes with a zero mask match anything.
+ */
+struct BytePattern
+{
+    std::string name{};
+    std::vector<uint8_t> bytes{};
+    std::vector<uint8_t> mask{};
+
+    /**
+     * \brief Parse space separated hex bytes, "??" being a wildcard, e.g. "39 60 fe e0 ?? cb 60 ce"
+     * \param text Text to parse
+     * \param out Parsed pattern, its name is left untouched
+     * \return Whether the text is a valid, non-empty pattern
+     */
+    static bool Parse(std::string_view text, BytePattern& out);
+};
+
+/**
+ * \brief Finds a set of byte patterns in a single sweep over the data. Candidates are
+ * filtered 16 positions at a time with SSE2 by comparing the first two bytes of every
+ * pattern, and only the positions that pass are compared in full.
+ */
+struct BytePatternSearch
+{
+    std::vector<BytePattern> patterns{};
+
+    /**
+     * \param pattern Pattern to search for, must not be empty
+     * \return Index of the pattern, passed back to the search callbacks
+     */
+    size_t Add(BytePattern pattern);
+    size_t Add(std::string_view name, const uint8_t* bytes, size_t size);
+
+    /**
+     * \brief Call a function for every match, matches of the same pattern come in address order
+     * \param data Data to search
+     * \param size Size of the data
+     * \param function Function taking the offset of the match and the pattern index, returns false to stop the search
+     */
+    void Search(const uint8_t* data, size_t size, const std::function<bool(size_t, size_t)>& function) const;
+
+    /**
+     * \param data Data to search
+     * \param size Size of the data
+     * \return Offset of the first match of each pattern, SIZE_MAX for the ones that weren't found
+     */
+    std::vector<size_t> FindFirst(const uint8_t* data, size_t size) const;
+};
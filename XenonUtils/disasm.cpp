@@ -4,6 +4,10 @@ thread_local ppc::DisassemblerEngine ppc::gBigEndianDisassembler{ BFD_ENDIAN_BIG
 
 ppc::DisassemblerEngine::DisassemblerEngine(bfd_endian endian, const char* options)
 {
+    // Engines are thread local, build the shared decode table exactly once before any of them decodes.
+    static const bool decodeTableInitialized = (init_decode_table_ppc(), true);
+    (void)decodeTableInitialized;
+
     INIT_DISASSEMBLE_INFO(info, stdout, fprintf);
     info.arch = bfd_arch_powerpc;
     info.endian = endian;
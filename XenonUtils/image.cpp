@@ -1,6 +1,7 @@
 #include "image.h"
 #include "elf.h"
 #include "xex.h"
+#include "memory_mapped_file.h"
 #include <cassert>
 #include <cstring>
 
@@ -43,17 +44,46 @@ Image Image::ParseImage(const uint8_t* data, size_t size)
     return {};
 }
 
-Image ElfLoadImage(const uint8_t* data, size_t size)
+Image Image::ParseImage(const std::filesystem::path& path)
 {
-    const auto* header = (elf32_hdr*)data;
-    assert(header->e_ident[EI_DATA] == 2);
+    auto file = std::make_shared<MemoryMappedFile>();
+    if (!file->open(path) || file->size() < 4)
+    {
+        return {};
+    }
+
+    const uint8_t* data = file->data();
+    if (data[0] == ELFMAG0 && data[1] == ELFMAG1 && data[2] == ELFMAG2 && data[3] == ELFMAG3)
+    {
+        Image image{};
+        image.size = file->size();
+        ElfMapImage(image, file->data());
+        image.file = std::move(file);
+        return image;
+    }
+
+    // XEX images are always decompressed into their own buffer, the mapping can be released afterwards.
+    return ParseImage(data, file->size());
+}
 
+Image ElfLoadImage(const uint8_t* data, size_t size)
+{
     Image image{};
     image.size = size;
     image.data = std::make_unique<uint8_t[]>(size);
-    image.entry_point = ByteSwap(header->e_entry);
     memcpy(image.data.get(), data, size);
 
+    ElfMapImage(image, image.data.get());
+    return image;
+}
+
+void ElfMapImage(Image& image, uint8_t* data)
+{
+    const auto* header = (elf32_hdr*)data;
+    assert(header->e_ident[EI_DATA] == 2);
+
+    image.entry_point = ByteSwap(header->e_entry);
+
     auto stringTableIndex = ByteSwap(header->e_shstrndx);
 
     const auto numSections = ByteSwap(header->e_shnum);
@@ -88,12 +118,16 @@ Image ElfLoadImage(const uint8_t* data, size_t size)
             flags |= SectionFlags_Code;
         }
 
+        // Sections that aren't loaded, like the symbol table, sit at address 0 and hold no program data.
+        if ((section.sh_flags & ByteSwap(SHF_ALLOC)) && !(section.sh_flags & ByteSwap(SHF_WRITE)))
+        {
+            flags |= SectionFlags_ReadOnly;
+        }
+
         auto* name = section.sh_name != 0 ? stringTable + ByteSwap(section.sh_name) : nullptr;
         const auto rva = ByteSwap(section.sh_addr) - image.base;
         const auto size = ByteSwap(section.sh_size);
 
-        image.Map(name, rva, size, flags, image.data.get() + ByteSwap(section.sh_offset));
+        image.Map(name, rva, size, flags, data + ByteSwap(section.sh_offset));
     }
-
-    return image;
 }
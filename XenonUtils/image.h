@@ -1,13 +1,17 @@
 #pragma once
+#include <filesystem>
 #include <memory>
 #include <string>
 #include <set>
 #include <section.h>
 #include "symbol_table.h"
 
+struct MemoryMappedFile;
+
 struct Image
 {
     std::unique_ptr<uint8_t[]> data{};
+    std::shared_ptr<MemoryMappedFile> file{};
     size_t base{};
     uint32_t size{};
 
@@ -44,6 +48,21 @@ struct Image
      * \return Parsed image
      */
     static Image ParseImage(const uint8_t* data, size_t size);
+
+    /**
+     * \brief Map given file and parse it to an image without reading it into memory first.
+     * ELF sections point directly into the mapping, which the image keeps alive.
+     * \param path Path to file
+     * \return Parsed image
+     */
+    static Image ParseImage(const std::filesystem::path& path);
 };
 
 Image ElfLoadImage(const uint8_t* data, size_t size);
+
+/**
+ * \brief Map the sections of an ELF file to an image in place
+ * \param image Image to map the sections to
+ * \param data ELF file data, must outlive the image
+ */
+void ElfMapImage(Image& image, uint8_t* data);
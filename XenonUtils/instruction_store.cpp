@@ -0,0 +1,138 @@
+#include "instruction_store.h"
+#include "image.h"
+#include "byteswap.h"
+#include "parallel.h"
+#include <cstring>
+
+void InstructionStore::Build(const Image& image, size_t threadCount)
+{
+    constexpr size_t c_chunkSize = 0x4000;
+
+    struct Chunk
+    {
+        const uint32_t* code;
+        size_t count;
+        size_t base;
+        size_t index;
+        std::string text;
+    };
+
+    std::vector<Chunk> chunks;
+    size_t index = opcodes.size();
+
+    for (const auto& section : image.sections)
+    {
+        if (!(section.flags & SectionFlags_Code))
+            continue;
+
+        const size_t count = section.size / sizeof(uint32_t);
+        ranges.push_back({ section.base, count * sizeof(uint32_t), index });
+
+        for (size_t i = 0; i < count; i += c_chunkSize)
+        {
+            const auto* code = reinterpret_cast<const uint32_t*>(section.data) + i;
+            chunks.push_back({ code, std::min(c_chunkSize, count - i), section.base + i * sizeof(uint32_t), index + i });
+        }
+
+        index += count;
+    }
+
+    opcodes.resize(index);
+    operands.resize(index * c_operandCount);
+    textOffsets.resize(index);
+
+    // The decode table is built lazily, which isn't safe to race on.
+    init_decode_table_ppc();
+
+    ParallelFor(threadCount, chunks.size(), [&](size_t i)
+        {
+            auto& chunk = chunks[i];
+            Decode(chunk.code, chunk.count, chunk.base, chunk.index, chunk.text);
+        });
+
+    for (auto& chunk : chunks)
+    {
+        const auto textBase = static_cast<uint32_t>(text.size());
+        for (size_t i = 0; i < chunk.count; i++)
+            textOffsets[chunk.index + i] += textBase;
+
+        text += chunk.text;
+    }
+}
+
+void InstructionStore::Add(const void* code, size_t size, size_t base)
+{
+    const size_t count = size / sizeof(uint32_t);
+    const size_t index = opcodes.size();
+    ranges.push_back({ base, count * sizeof(uint32_t), index });
+
+    opcodes.resize(index + count);
+    operands.resize((index + count) * c_operandCount);
+    textOffsets.resize(index + count);
+
+    std::string rangeText;
+    Decode(code, count, base, index, rangeText);
+
+    const auto textBase = static_cast<uint32_t>(text.size());
+    for (size_t i = 0; i < count; i++)
+        textOffsets[index + i] += textBase;
+
+    text += rangeText;
+}
+
+void InstructionStore::Decode(const void* code, size_t count, size_t base, size_t index, std::string& textOut)
+{
+    const auto* data = static_cast<const uint32_t*>(code);
+    ppc_insn insn;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ppc::Disassemble(data + i, base + i * sizeof(uint32_t), insn);
+
+        opcodes[index + i] = insn.opcode != nullptr ? static_cast<uint16_t>(insn.opcode - powerpc_opcodes) : c_invalidOpcode;
+        memcpy(&operands[(index + i) * c_operandCount], insn.operands, sizeof(insn.operands));
+        textOffsets[index + i] = static_cast<uint32_t>(textOut.size());
+        textOut.append(insn.op_str, strlen(insn.op_str) + 1);
+    }
+}
+
+size_t InstructionStore::FindIndex(size_t address) const
+{
+    for (const auto& range : ranges)
+    {
+        if (address >= range.base && address < range.base + range.size && (address & 3) == 0)
+        {
+            return range.index + (address - range.base) / sizeof(uint32_t);
+        }
+    }
+
+    return -1;
+}
+
+const powerpc_opcode* InstructionStore::FindOpcode(const void* code, size_t address) const
+{
+    const size_t index = FindIndex(address);
+    if (index != -1)
+    {
+        return GetOpcode(index);
+    }
+
+    ppc_insn insn;
+    ppc::Disassemble(code, address, insn);
+    return insn.opcode;
+}
+
+void InstructionStore::Disassemble(const void* code, size_t address, ppc_insn& out) const
+{
+    const size_t index = FindIndex(address);
+    if (index == -1)
+    {
+        ppc::Disassemble(code, address, out);
+        return;
+    }
+
+    out.opcode = GetOpcode(index);
+    out.instruction = ByteSwap(*static_cast<const uint32_t*>(code));
+    memcpy(out.operands, GetOperands(index), sizeof(out.operands));
+    strcpy(out.op_str, GetText(index));
+}
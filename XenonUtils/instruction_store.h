@@ -0,0 +1,93 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "disasm.h"
+
+struct Image;
+
+/**
+ * \brief Decoded instructions of a set of code ranges, stored as parallel arrays indexed
+ * by (address - range base) / 4. Analysis and code generation read from here instead of
+ * running the disassembler on the same words over and over.
+ */
+struct InstructionStore
+{
+    static constexpr uint16_t c_invalidOpcode = 0xFFFF;
+    static constexpr size_t c_operandCount = sizeof(ppc_insn::operands) / sizeof(uint32_t);
+
+    struct Range
+    {
+        size_t base{};
+        size_t size{};
+        size_t index{};
+    };
+
+    std::vector<Range> ranges{};
+
+    // Index into powerpc_opcodes, or c_invalidOpcode.
+    std::vector<uint16_t> opcodes{};
+
+    // c_operandCount values per instruction.
+    std::vector<uint32_t> operands{};
+
+    // Offset of the null terminated operand text of each instruction.
+    std::vector<uint32_t> textOffsets{};
+    std::string text{};
+
+    /**
+     * \brief Decode every code section of the image
+     * \param image Image to decode
+     * \param threadCount Amount of threads to decode with
+     */
+    void Build(const Image& image, size_t threadCount = 1);
+
+    /**
+     * \brief Decode a range of big endian instructions
+     * \param code Pointer to instructions
+     * \param size Size of the range in bytes
+     * \param base Address of the first instruction
+     */
+    void Add(const void* code, size_t size, size_t base);
+
+    /**
+     * \param address Virtual Address
+     * \return Index of the instruction, -1 if the address is not stored
+     */
+    size_t FindIndex(size_t address) const;
+
+    const powerpc_opcode* GetOpcode(size_t index) const
+    {
+        return opcodes[index] != c_invalidOpcode ? &powerpc_opcodes[opcodes[index]] : nullptr;
+    }
+
+    const uint32_t* GetOperands(size_t index) const
+    {
+        return &operands[index * c_operandCount];
+    }
+
+    const char* GetText(size_t index) const
+    {
+        return &text[textOffsets[index]];
+    }
+
+    /**
+     * \brief Look up the opcode of an instruction, decoding it if the address is not stored
+     * \param code Pointer to instruction
+     * \param address Virtual Address of instruction
+     * \return Opcode, nullptr if the instruction is invalid
+     */
+    const powerpc_opcode* FindOpcode(const void* code, size_t address) const;
+
+    /**
+     * \brief Fill in a decoded instruction, decoding it if the address is not stored
+     * \param code Pointer to instruction
+     * \param address Virtual Address of instruction
+     * \param out Decoded instruction
+     */
+    void Disassemble(const void* code, size_t address, ppc_insn& out) const;
+
+private:
+    // Decodes instructions into preallocated slots starting at index, appending their text to a separate arena.
+    void Decode(const void* code, size_t count, size_t base, size_t index, std::string& textOut);
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Call a function for every index of a range, spreading the indices over threads
+ * \param threadCount Maximum amount of threads to use, the calling thread included
+ * \param count Amount of indices
+ * \param function Function taking the index, called concurrently
+ */
+template<typename TFunction>
+void ParallelFor(size_t threadCount, size_t count, const TFunction& function)
+{
+    threadCount = std::min(threadCount, count);
+    if (threadCount <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            function(i);
+
+        return;
+    }
+
+    std::atomic<size_t> nextIndex = 0;
+    auto work = [&]()
+        {
+            size_t i;
+            while ((i = nextIndex++) < count)
+                function(i);
+        };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+
+    for (size_t i = 1; i < threadCount; i++)
+        threads.emplace_back(work);
+
+    work();
+
+    for (auto& thread : threads)
+        thread.join();
+}
@@ -105,6 +105,22 @@
 #define PPC_CALL_FUNC(x) x(ctx, base)
 #endif
 
+// Branches to other functions. With Clang and GCC 15 they never grow the host stack, other
+// compilers are left to turn the call and return into a jump on their own.
+#ifndef PPC_TAIL_CALL_FUNC
+#if defined(__clang__)
+#define PPC_TAIL_CALL_FUNC(x) [[clang::musttail]] return x(ctx, base)
+#elif defined(__has_cpp_attribute)
+#if __has_cpp_attribute(gnu::musttail)
+#define PPC_TAIL_CALL_FUNC(x) [[gnu::musttail]] return x(ctx, base)
+#endif
+#endif
+#endif
+
+#ifndef PPC_TAIL_CALL_FUNC
+#define PPC_TAIL_CALL_FUNC(x) do { x(ctx, base); return; } while (0)
+#endif
+
 #define PPC_MEMORY_SIZE 0x100000000ull
 
 #define PPC_LOOKUP_FUNC(x, y) *(PPCFunc**)(x + PPC_IMAGE_BASE + PPC_IMAGE_SIZE + (uint64_t(uint32_t(y) - PPC_CODE_BASE) * 2))
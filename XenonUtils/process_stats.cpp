@@ -0,0 +1,68 @@
+#include "process_stats.h"
+#include <chrono>
+#include <cstdint>
+
+#if defined(_WIN32)
+#   include <Windows.h>
+#   include <psapi.h>
+#else
+#   include <ctime>
+#   include <sys/resource.h>
+#endif
+
+#if defined(_WIN32)
+static double ToSeconds(const FILETIME& time)
+{
+    // 100 nanosecond units.
+    return ((uint64_t(time.dwHighDateTime) << 32) | time.dwLowDateTime) / 10000000.0;
+}
+#endif
+
+ProcessStats ProcessStats::Capture()
+{
+    ProcessStats stats;
+    stats.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+#if defined(_WIN32)
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+        stats.cpuSeconds = ToSeconds(kernelTime) + ToSeconds(userTime);
+
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        stats.peakResidentBytes = counters.PeakWorkingSetSize;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        stats.cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0 +
+            usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+
+#if defined(__APPLE__)
+        stats.peakResidentBytes = size_t(usage.ru_maxrss);
+#else
+        // Kilobytes everywhere else.
+        stats.peakResidentBytes = size_t(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+
+    return stats;
+}
+
+double GetThreadCpuSeconds()
+{
+#if defined(_WIN32)
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+        return ToSeconds(kernelTime) + ToSeconds(userTime);
+
+    return 0.0;
+#else
+    timespec time{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0)
+        return time.tv_sec + time.tv_nsec / 1000000000.0;
+
+    return 0.0;
+#endif
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * \brief Resource usage of the process at a point in time, subtract two snapshots to measure what happened in between.
+ */
+struct ProcessStats
+{
+    // Steady clock time.
+    double wallSeconds{};
+
+    // User and system time of every thread of the process.
+    double cpuSeconds{};
+
+    // Highest resident set size the process reached so far.
+    size_t peakResidentBytes{};
+
+    static ProcessStats Capture();
+};
+
+/**
+ * \return User and system time of the calling thread
+ */
+double GetThreadCpuSeconds();
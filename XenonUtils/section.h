@@ -6,7 +6,8 @@ enum SectionFlags : uint8_t
 {
     SectionFlags_None = 0,
     SectionFlags_Data = 1,
-    SectionFlags_Code = 2
+    SectionFlags_Code = 2,
+    SectionFlags_ReadOnly = 4
 };
 
 struct Section
@@ -1,5 +1,5 @@
 #pragma once
-#include <string>
+#include <string_view>
 #include <cstdint>
 
 enum SymbolType
@@ -12,17 +12,18 @@ enum SymbolType
 
 struct Symbol
 {
-    mutable std::string name{};
+    // Points into the name arena of the owning symbol table.
+    std::string_view name{};
     size_t address{};
     size_t size{};
-    mutable SymbolType type{};
+    SymbolType type{};
 
     Symbol()
     {
     }
 
-    Symbol(std::string name, size_t address, size_t size, SymbolType type)
-        : name(std::move(name)), address(address), size(size), type(type)
+    Symbol(std::string_view name, size_t address, size_t size, SymbolType type)
+        : name(name), address(address), size(size), type(type)
     {
     }
 };
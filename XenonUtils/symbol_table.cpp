@@ -0,0 +1,99 @@
+#include "symbol_table.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+template<typename T>
+static T* FindExact(T* begin, T* end, size_t address)
+{
+    // Last match wins to keep the behavior of the old multiset lookup.
+    auto [rangeBegin, rangeEnd] = std::equal_range(begin, end, address, SymbolComparer());
+    for (auto it = rangeEnd; it != rangeBegin; --it)
+    {
+        if ((it - 1)->size != 0)
+        {
+            return it - 1;
+        }
+    }
+
+    return nullptr;
+}
+
+const Symbol* SymbolTable::find(size_t address) const
+{
+    if (auto symbol = FindExact(pending.data(), pending.data() + pending.size(), address))
+    {
+        return symbol;
+    }
+
+    return FindExact(symbols.data(), symbols.data() + symbols.size(), address);
+}
+
+Symbol* SymbolTable::find(size_t address)
+{
+    return const_cast<Symbol*>(static_cast<const SymbolTable*>(this)->find(address));
+}
+
+void SymbolTable::emplace(std::string_view name, size_t address, size_t size, SymbolType type)
+{
+    insert({ name, address, size, type });
+}
+
+void SymbolTable::insert(const Symbol& symbol)
+{
+    auto it = std::upper_bound(pending.begin(), pending.end(), symbol.address, SymbolComparer());
+    pending.insert(it, { StoreName(symbol.name), symbol.address, symbol.size, symbol.type });
+
+    if (pending.size() >= c_minPendingSize && pending.size() * pending.size() >= symbols.size() * 2)
+    {
+        freeze();
+    }
+}
+
+void SymbolTable::freeze()
+{
+    if (pending.empty())
+    {
+        return;
+    }
+
+    const size_t mergeBegin = symbols.size();
+    symbols.insert(symbols.end(), pending.begin(), pending.end());
+    pending.clear();
+
+    std::inplace_merge(symbols.begin(), symbols.begin() + mergeBegin, symbols.end(), SymbolComparer());
+}
+
+SymbolTable::const_iterator SymbolTable::begin() const
+{
+    assert(pending.empty() && "Symbol table must be frozen before iterating.");
+    return symbols.data();
+}
+
+SymbolTable::const_iterator SymbolTable::end() const
+{
+    assert(pending.empty() && "Symbol table must be frozen before iterating.");
+    return symbols.data() + symbols.size();
+}
+
+std::string_view SymbolTable::StoreName(std::string_view name)
+{
+    if (name.size() > c_nameBlockSize)
+    {
+        auto& block = nameBlocks.emplace_back(std::make_unique<char[]>(name.size()));
+        memcpy(block.get(), name.data(), name.size());
+        nameBlockOffset = c_nameBlockSize;
+        return { block.get(), name.size() };
+    }
+
+    if (nameBlockOffset + name.size() > c_nameBlockSize)
+    {
+        nameBlocks.emplace_back(std::make_unique<char[]>(c_nameBlockSize));
+        nameBlockOffset = 0;
+    }
+
+    char* dest = nameBlocks.back().get() + nameBlockOffset;
+    memcpy(dest, name.data(), name.size());
+    nameBlockOffset += name.size();
+    return { dest, name.size() };
+}
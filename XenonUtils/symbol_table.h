@@ -1,63 +1,73 @@
 #pragma once
 #include "symbol.h"
-#include <set>
+#include <memory>
+#include <vector>
 
-class SymbolTable : public std::multiset<Symbol, SymbolComparer>
+/**
+ * \brief Symbols sorted by address in contiguous storage, with names kept in an arena.
+ * New symbols go to a small sorted buffer that gets merged into the main list once it
+ * grows, so lookups stay O(log n) while the analysis interleaves inserts and lookups.
+ * Symbols with the same address keep their insertion order.
+ */
+class SymbolTable
 {
 public:
-    const_iterator find(size_t address) const
+    using iterator = Symbol*;
+    using const_iterator = const Symbol*;
+
+    /**
+     * \param address Virtual Address
+     * \return Last inserted symbol that starts at the address and is not empty, nullptr if there is none
+     */
+    const Symbol* find(size_t address) const;
+    Symbol* find(size_t address);
+
+    /**
+     * \brief Add a symbol, copying its name to the arena
+     */
+    void emplace(std::string_view name, size_t address, size_t size, SymbolType type);
+    void insert(const Symbol& symbol);
+
+    /**
+     * \brief Merge buffered symbols into the main list. Lookups never need this, iteration does.
+     */
+    void freeze();
+
+    size_t size() const
+    {
+        return symbols.size() + pending.size();
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    iterator begin()
     {
-        auto [beginIt, endIt] = equal_range(address);
-        if (beginIt == endIt)
-        {
-            return end();
-        }
-
-        size_t closest{ address - beginIt->address };
-        auto match = end();
-        for (auto it = beginIt; it != endIt; ++it)
-        {
-            if (address < it->address || address >= it->address + it->size)
-            {
-                continue;
-            }
-
-            const size_t distance = address - it->address;
-            if (distance <= closest)
-            {
-                match = it;
-                closest = distance;
-            }
-        }
-
-        return match;
+        freeze();
+        return symbols.data();
     }
 
-    iterator find(size_t address)
+    iterator end()
     {
-        auto [beginIt, endIt] = equal_range(address);
-        if (beginIt == endIt)
-        {
-            return end();
-        }
-
-        size_t closest{ address - beginIt->address };
-        auto match = end();
-        for (auto it = beginIt; it != endIt; ++it)
-        {
-            if (address < it->address || address >= it->address + it->size)
-            {
-                continue;
-            }
-
-            const size_t distance = address - it->address;
-            if (distance <= closest)
-            {
-                match = it;
-                closest = distance;
-            }
-        }
-
-        return match;
+        freeze();
+        return symbols.data() + symbols.size();
     }
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+private:
+    static constexpr size_t c_nameBlockSize = 0x10000;
+    static constexpr size_t c_minPendingSize = 64;
+
+    std::vector<Symbol> symbols;
+
+    std::vector<Symbol> pending;
+
+    std::vector<std::unique_ptr<char[]>> nameBlocks;
+    size_t nameBlockOffset{ c_nameBlockSize };
+
+    std::string_view StoreName(std::string_view name);
 };
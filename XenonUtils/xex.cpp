@@ -111,6 +111,7 @@ typedef struct _IMAGE_SECTION_HEADER {
 } IMAGE_SECTION_HEADER, * PIMAGE_SECTION_HEADER;
 
 #define IMAGE_SCN_CNT_CODE                   0x00000020
+#define IMAGE_SCN_MEM_WRITE                  0x80000000
 
 #endif
 
@@ -140,37 +141,48 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
         assert(fileFormatInfo->compressionType <= XEX_COMPRESSION_NORMAL);
 
         std::unique_ptr<uint8_t[]> decryptedData;
-        const uint8_t* srcData = nullptr;
+        const uint8_t* srcData = data + header->headerSize;
+        const size_t srcSize = dataSize - header->headerSize;
 
-        if (fileFormatInfo->encryptionType == XEX_ENCRYPTION_NORMAL)
+        const bool encrypted = fileFormatInfo->encryptionType == XEX_ENCRYPTION_NORMAL;
+        AES_ctx aesContext;
+
+        if (encrypted)
         {
             constexpr uint32_t KeySize = 16;
-            AES_ctx aesContext;
 
             uint8_t decryptedKey[KeySize];
             memcpy(decryptedKey, security->aesKey, KeySize);
             AES_init_ctx_iv(&aesContext, Xex2RetailKey, AESBlankIV);
             AES_CBC_decrypt_buffer(&aesContext, decryptedKey, KeySize);
 
-            decryptedData = std::make_unique<uint8_t[]>(dataSize - header->headerSize);
-            memcpy(decryptedData.get(), data + header->headerSize, dataSize - header->headerSize);
             AES_init_ctx_iv(&aesContext, decryptedKey, AESBlankIV);
-            AES_CBC_decrypt_buffer(&aesContext, decryptedData.get(), dataSize - header->headerSize);
-
-            srcData = decryptedData.get();
-        }
-        else
-        {
-            srcData = data + header->headerSize;
         }
 
+        // Copies the start of the file data to the given buffer, decrypting it in place if necessary.
+        // This way the (possibly memory mapped) input is never duplicated as a whole.
+        auto readData = [&](uint8_t* destData, size_t size)
+            {
+                memcpy(destData, srcData, size);
+
+                if (encrypted)
+                    AES_CBC_decrypt_buffer(&aesContext, destData, size & ~(AES_BLOCKLEN - 1));
+            };
+
         if (fileFormatInfo->compressionType == XEX_COMPRESSION_NONE)
         {
             result = std::make_unique<uint8_t[]>(imageSize);
-            memcpy(result.get(), srcData, imageSize);
+            readData(result.get(), imageSize);
         }
         else if (fileFormatInfo->compressionType == XEX_COMPRESSION_BASIC)
         {
+            if (encrypted)
+            {
+                decryptedData = std::make_unique<uint8_t[]>(srcSize);
+                readData(decryptedData.get(), srcSize);
+                srcData = decryptedData.get();
+            }
+
             auto* blocks = reinterpret_cast<const Xex2FileBasicCompressionBlock*>(fileFormatInfo + 1);
             const size_t numBlocks = (fileFormatInfo->infoSize / sizeof(Xex2FileBasicCompressionInfo)) - 1;
 
@@ -199,31 +211,35 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
             result = std::make_unique<uint8_t[]>(imageSize);
             auto* destData = result.get();
 
-            const Xex2CompressedBlockInfo* blocks = &((const Xex2FileNormalCompressionInfo*)(fileFormatInfo + 1))->firstBlock;
+            Xex2CompressedBlockInfo block = ((const Xex2FileNormalCompressionInfo*)(fileFormatInfo + 1))->firstBlock;
             const uint32_t headerSize = header->headerSize.get();
 
             const uint32_t exeLength = dataSize - headerSize;
-            const uint8_t* exeBuffer = srcData;
 
+            // The compressed chunks are gathered in place. Chunk data always moves towards the
+            // start of the buffer, so it never overwrites a block that was not read yet.
             auto compressBuffer = std::make_unique<uint8_t[]>(exeLength);
+            readData(compressBuffer.get(), exeLength);
+
             const uint8_t* p = NULL;
             uint8_t* d = NULL;
             sha1::SHA1 s;
 
-            p = exeBuffer;
+            p = compressBuffer.get();
             d = compressBuffer.get();
 
             uint8_t blockCalcedDigest[0x14];
-            while (blocks->blockSize) 
+            while (block.blockSize) 
             {
-                const uint8_t* pNext = p + blocks->blockSize;
-                const auto* nextBlock = (const Xex2CompressedBlockInfo*)p;
+                const uint8_t* pNext = p + block.blockSize;
+                Xex2CompressedBlockInfo nextBlock;
+                memcpy(&nextBlock, p, sizeof(nextBlock));
 
                 s.reset();
-                s.processBytes(p, blocks->blockSize);
+                s.processBytes(p, block.blockSize);
                 s.finalize(blockCalcedDigest);
 
-                if (memcmp(blockCalcedDigest, blocks->blockHash, 0x14) != 0)
+                if (memcmp(blockCalcedDigest, block.blockHash, 0x14) != 0)
                     return {};
 
                 p += 4;
@@ -237,13 +253,13 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
                     if (!chunkSize)
                         break;
 
-                    memcpy(d, p, chunkSize);
+                    memmove(d, p, chunkSize);
                     p += chunkSize;
                     d += chunkSize;
                 }
 
                 p = pNext;
-                blocks = nextBlock;
+                block = nextBlock;
             }
 
             int resultCode = 0;
@@ -289,6 +305,11 @@ Image Xex2LoadImage(const uint8_t* data, size_t dataSize)
             flags |= SectionFlags_Code;
         }
 
+        if (!(section.Characteristics & IMAGE_SCN_MEM_WRITE))
+        {
+            flags |= SectionFlags_ReadOnly;
+        }
+
         image.Map(reinterpret_cast<const char*>(section.Name), section.VirtualAddress, 
             section.Misc.VirtualSize, flags, image.data.get() + section.VirtualAddress);
     }
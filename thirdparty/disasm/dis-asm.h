@@ -467,6 +467,26 @@ int print_insn_microblaze       (bfd_vma, disassemble_info*);
 int print_insn_ia64             (bfd_vma, disassemble_info*);
 
 int decode_insn_ppc(bfd_vma, disassemble_info*, ppc_insn*);
+void init_decode_table_ppc(void);
+
+/* The opcode table searched by decode_insn_ppc.  */
+extern const powerpc_opcode powerpc_opcodes[];
+extern const int powerpc_num_opcodes;
+
+/* Register file named by an operand of a decoded instruction.  */
+enum ppc_operand_kind
+{
+    PPC_OPERAND_KIND_NONE,
+    PPC_OPERAND_KIND_GPR,
+    PPC_OPERAND_KIND_GPR_0, /* r0 reads as zero */
+    PPC_OPERAND_KIND_FPR,
+    PPC_OPERAND_KIND_VR,
+    PPC_OPERAND_KIND_CR_FIELD,
+    PPC_OPERAND_KIND_CR_BIT
+};
+
+/* Kind of operand INDEX of OPCODE, indexed like ppc_insn::operands.  */
+enum ppc_operand_kind ppc_get_operand_kind(const powerpc_opcode* opcode, int index);
 
 #if 0
 /* Fetch the disassembler for a given BFD, if that support is available.  */
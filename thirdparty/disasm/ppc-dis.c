@@ -20,6 +20,7 @@ along with this file; see the file COPYING.  If not,
 see <http://www.gnu.org/licenses/>.  */
 #include "dis-asm.h"
 #include "ppc.h"
+#include <stdlib.h>
 
 #define BFD_DEFAULT_TARGET_SIZE 64
 
@@ -5637,19 +5638,142 @@ again:
     return 4;
 }
 
+/* Two-level decode table.  The major opcode and the low 11 bits of an
+   instruction (which hold the extended opcode of most forms) select the
+   list of opcode table entries that can possibly match it, in table
+   order.  Decoding then only has to check a handful of candidates
+   instead of walking every entry of the major opcode.  */
+
+#define DECODE_TABLE_XO_BITS 11
+#define DECODE_TABLE_XO_MASK ((1ul << DECODE_TABLE_XO_BITS) - 1)
+
+static unsigned long decode_table_xo_masks[64];
+static unsigned int decode_table_offsets[(64 << DECODE_TABLE_XO_BITS) + 1];
+static unsigned short* decode_table_candidates;
+
+static int decode_table_candidate_matches(const struct powerpc_opcode* opcode, unsigned long xo)
+{
+    return (xo & opcode->mask & DECODE_TABLE_XO_MASK) == (opcode->opcode & opcode->mask & DECODE_TABLE_XO_MASK);
+}
+
+enum ppc_operand_kind ppc_get_operand_kind(const powerpc_opcode* opcode, int index)
+{
+    const struct powerpc_operand* operand;
+    int i;
+
+    for (i = 0; i < index; i++)
+    {
+        if (opcode->operands[i] == 0)
+            return PPC_OPERAND_KIND_NONE;
+    }
+
+    if (opcode->operands[index] == 0)
+        return PPC_OPERAND_KIND_NONE;
+
+    operand = powerpc_operands + opcode->operands[index];
+    if ((operand->flags & PPC_OPERAND_FAKE) != 0)
+        return PPC_OPERAND_KIND_NONE;
+    if ((operand->flags & PPC_OPERAND_GPR) != 0)
+        return PPC_OPERAND_KIND_GPR;
+    if ((operand->flags & PPC_OPERAND_GPR_0) != 0)
+        return PPC_OPERAND_KIND_GPR_0;
+    if ((operand->flags & PPC_OPERAND_FPR) != 0)
+        return PPC_OPERAND_KIND_FPR;
+    if ((operand->flags & PPC_OPERAND_VR) != 0)
+        return PPC_OPERAND_KIND_VR;
+    if ((operand->flags & PPC_OPERAND_CR) != 0)
+        return operand->bitm == 0x7 ? PPC_OPERAND_KIND_CR_FIELD : PPC_OPERAND_KIND_CR_BIT;
+
+    return PPC_OPERAND_KIND_NONE;
+}
+
+/* Builds the decode table.  This is not thread safe, callers decoding on
+   multiple threads must make sure it runs once before any decoding.  */
+void init_decode_table_ppc(void)
+{
+    const struct powerpc_opcode* opcode_end = powerpc_opcodes + powerpc_num_opcodes;
+    unsigned short* candidates;
+    unsigned int count;
+    unsigned long op;
+    unsigned long xo;
+    int pass;
+
+    if (decode_table_candidates != NULL)
+        return;
+
+    /* Only the bits that any entry of the major opcode actually checks
+       are used to index its table.  */
+    for (op = 0; op < 64; op++)
+    {
+        const struct powerpc_opcode* opcode;
+
+        for (opcode = powerpc_opcodes; opcode < opcode_end; opcode++)
+        {
+            if (PPC_OP(opcode->opcode) == op)
+                decode_table_xo_masks[op] |= opcode->mask & DECODE_TABLE_XO_MASK;
+        }
+    }
+
+    /* Count the candidates first, then fill them in.  The entries
+       considered for a major opcode mirror the linear search, which stops
+       at the first entry with a greater major opcode.  */
+    candidates = NULL;
+    for (pass = 0; pass < 2; pass++)
+    {
+        count = 0;
+
+        for (op = 0; op < 64; op++)
+        {
+            for (xo = 0; xo <= DECODE_TABLE_XO_MASK; xo++)
+            {
+                const struct powerpc_opcode* opcode;
+
+                decode_table_offsets[(op << DECODE_TABLE_XO_BITS) | xo] = count;
+                if ((xo & ~decode_table_xo_masks[op]) != 0)
+                    continue;
+
+                for (opcode = powerpc_opcodes; opcode < opcode_end; opcode++)
+                {
+                    unsigned long table_op = PPC_OP(opcode->opcode);
+                    if (op < table_op)
+                        break;
+                    if (op > table_op || !decode_table_candidate_matches(opcode, xo))
+                        continue;
+
+                    if (candidates != NULL)
+                        candidates[count] = (unsigned short)(opcode - powerpc_opcodes);
+
+                    count++;
+                }
+            }
+        }
+
+        decode_table_offsets[64 << DECODE_TABLE_XO_BITS] = count;
+
+        if (candidates == NULL)
+            candidates = (unsigned short*)malloc(count * sizeof(unsigned short));
+    }
+
+    decode_table_candidates = candidates;
+}
+
 static int decode_insn_powerpc(bfd_vma memaddr, disassemble_info* info, int bigendian, int dialect, ppc_insn* oinsn)
 {
     bfd_byte buffer[4];
     int status;
     unsigned long insn;
     const struct powerpc_opcode* opcode;
-    const struct powerpc_opcode* opcode_end;
+    const unsigned short* candidate;
+    const unsigned short* candidate_end;
     unsigned long op;
+    unsigned long index;
     char* stream = oinsn->op_str;
 
     if (dialect == 0)
         dialect = powerpc_dialect(info);
 
+    init_decode_table_ppc();
+
     oinsn->op_str[0] = 0;
     status = (*info->read_memory_func) (memaddr, buffer, 4, info);
     if (status != 0)
@@ -5669,13 +5793,12 @@ static int decode_insn_powerpc(bfd_vma memaddr, disassemble_info* info, int bige
     /* Get the major opcode of the instruction.  */
     op = PPC_OP(insn);
 
-    /* Find the first match in the opcode table.  We could speed this up
-       a bit by doing a binary search on the major opcode.  */
-    opcode_end = powerpc_opcodes + powerpc_num_opcodes;
+    /* Find the first match among the candidates of the decode table.  */
+    index = (op << DECODE_TABLE_XO_BITS) | (insn & decode_table_xo_masks[op]);
+    candidate_end = decode_table_candidates + decode_table_offsets[index + 1];
 again:
-    for (opcode = powerpc_opcodes; opcode < opcode_end; opcode++)
+    for (candidate = decode_table_candidates + decode_table_offsets[index]; candidate < candidate_end; candidate++)
     {
-        unsigned long table_op;
         unsigned long i_op;
         const unsigned char* opindex;
         const struct powerpc_operand* operand;
@@ -5684,11 +5807,7 @@ again:
         int need_paren;
         int skip_optional;
 
-        table_op = PPC_OP(opcode->opcode);
-        if (op < table_op)
-            break;
-        if (op > table_op)
-            continue;
+        opcode = powerpc_opcodes + *candidate;
 
         if ((insn & opcode->mask) != opcode->opcode
             || (opcode->flags & dialect) == 0)